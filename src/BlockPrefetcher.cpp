@@ -0,0 +1,116 @@
+#include "BlockPrefetcher.hpp"
+#include <base-logging/Logging.hpp>
+#include <stdexcept>
+#include <algorithm>
+
+namespace pocolog_cpp
+{
+
+BlockPrefetcher::BlockPrefetcher(const std::string& fileName, std::streampos startPos, size_t numBlocks, size_t readAheadSize)
+    : ring(std::max<size_t>(numBlocks, 1))
+    , ringHead(0)
+    , ringCount(0)
+    , endReached(false)
+    , stopRequested(false)
+    , readPos(startPos)
+    , nextBlockPos(startPos)
+{
+    file.setReadAheadSize(readAheadSize);
+    if(!file.open(fileName.c_str(), std::ifstream::binary | std::ifstream::in))
+        throw std::runtime_error("BlockPrefetcher: Error, could not open " + fileName);
+
+    thread = std::thread(&BlockPrefetcher::run, this);
+}
+
+BlockPrefetcher::~BlockPrefetcher()
+{
+    stop();
+}
+
+void BlockPrefetcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    notFull.notify_all();
+    notEmpty.notify_all();
+
+    if(thread.joinable())
+        thread.join();
+}
+
+bool BlockPrefetcher::readBlock(Block& block, std::streampos pos)
+{
+    file.seekg(pos);
+    if(file.eof())
+        return false;
+
+    file.read(reinterpret_cast<char *>(&block.header), sizeof(BlockHeader));
+    if(!file.good())
+        return false;
+
+    //the last block might still be incomplete
+    if(static_cast<off_t>(pos) + sizeof(BlockHeader) + block.header.data_size > static_cast<size_t>(file.size()))
+        return false;
+
+    block.headerPos = pos;
+    block.data.resize(block.header.data_size);
+    file.read(reinterpret_cast<char *>(block.data.data()), block.header.data_size);
+    return file.good();
+}
+
+void BlockPrefetcher::run()
+{
+    while(true)
+    {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this] { return stopRequested || ringCount < ring.size(); });
+            if(stopRequested)
+                return;
+            block = &ring[(ringHead + ringCount) % ring.size()];
+        }
+
+        //the slot is not visible to the consumer until ringCount
+        //is increased, so it can be filled without holding the lock
+        bool valid = readBlock(*block, readPos);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!valid)
+            {
+                endReached = true;
+                notEmpty.notify_all();
+                return;
+            }
+            readPos += sizeof(BlockHeader) + block->header.data_size;
+            ringCount++;
+        }
+        notEmpty.notify_all();
+    }
+}
+
+bool BlockPrefetcher::next(Block& block)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return stopRequested || endReached || ringCount > 0; });
+        if(ringCount == 0)
+            return false;
+
+        Block &slot(ring[ringHead]);
+        block.header = slot.header;
+        block.headerPos = slot.headerPos;
+        block.data.swap(slot.data);
+
+        ringHead = (ringHead + 1) % ring.size();
+        ringCount--;
+        nextBlockPos = block.headerPos + std::streamoff(sizeof(BlockHeader) + block.header.data_size);
+    }
+    notFull.notify_all();
+    return true;
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef POCOLOG_CPP_BLOCKPREFETCHER_HPP
+#define POCOLOG_CPP_BLOCKPREFETCHER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Format.hpp"
+#include "FileStream.hpp"
+
+namespace pocolog_cpp
+{
+
+/**
+ * Reads the blocks of a log file sequentially in a background thread.
+ *
+ * The blocks are stored in a bounded ring of buffers. The reader thread
+ * waits as soon as the ring is full, and resumes when the consumer took
+ * a block out of it. The thread is stopped on destruction.
+ * */
+class BlockPrefetcher
+{
+public:
+    struct Block
+    {
+        BlockHeader header;
+        std::streampos headerPos;
+        /** The block content, i.e. for data blocks the sample header
+         * followed by the payload */
+        std::vector<uint8_t> data;
+    };
+
+    /**
+     * @param fileName the log file to read
+     * @param startPos position of the first block header to read
+     * @param numBlocks size of the ring, i.e. how many blocks may be
+     *        read ahead of the consumer
+     * @param readAheadSize read ahead window of the reader thread,
+     *        see FileStream::setReadAheadSize
+     * */
+    BlockPrefetcher(const std::string &fileName, std::streampos startPos, size_t numBlocks, size_t readAheadSize = 4 * 1024 * 1024);
+    ~BlockPrefetcher();
+
+    /**
+     * Waits for the next block and moves it into \c block. The previous
+     * buffer of \c block is recycled into the ring.
+     *
+     * @return false if the end of file was reached
+     * */
+    bool next(Block &block);
+
+    /** Position of the header of the block returned by the next call
+     * to next() */
+    std::streampos getNextBlockPos() const
+    {
+        return nextBlockPos;
+    }
+
+    /** Stops the reader thread, no more blocks are read afterwards */
+    void stop();
+
+private:
+    void run();
+    bool readBlock(Block &block, std::streampos pos);
+
+    FileStream file;
+    std::vector<Block> ring;
+    size_t ringHead;
+    size_t ringCount;
+    bool endReached;
+    bool stopRequested;
+    std::streampos readPos;
+    std::streampos nextBlockPos;
+
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::thread thread;
+};
+
+}
+
+#endif
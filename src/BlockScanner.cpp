@@ -0,0 +1,181 @@
+#include "BlockScanner.hpp"
+#include <base-logging/Logging.hpp>
+#include <stdexcept>
+
+namespace pocolog_cpp
+{
+
+/** Number of consecutive plausible blocks needed to accept a
+ * synchronization point */
+static const int SYNC_CHAIN_LENGTH = 8;
+
+BlockScanner::BlockScanner(const std::string& fileName, off_t fileSize)
+{
+    file.setReadAheadSize(64 * 1024);
+    if(!file.open(fileName.c_str(), std::ifstream::binary | std::ifstream::in))
+        throw std::runtime_error("BlockScanner: Error, could not open " + fileName);
+
+    if(fileSize < 0 || fileSize > file.size())
+        fileSize = file.size();
+    this->fileSize = fileSize;
+}
+
+void BlockScanner::scan(Result& result, off_t pos, off_t end)
+{
+    result.syncPos = pos;
+
+    while(pos < end)
+    {
+        BlockHeader header;
+        file.seekg(pos);
+        if(file.eof())
+            break;
+        file.read((char *) &header, sizeof(BlockHeader));
+        if(!file.good())
+            break;
+
+        //a block that is still being written is left for the next update of the index
+        off_t nextPos = pos + sizeof(BlockHeader) + header.data_size;
+        if(nextPos > fileSize)
+            break;
+
+        switch(header.type)
+        {
+            case UnknownBlockType:
+                result.error = true;
+                result.endPos = pos;
+                return;
+            case StreamBlockType:
+                result.streamDeclarations.push_back(pos);
+                break;
+            case DataBlockType:
+            {
+                SampleHeaderData sampleHeader;
+                file.read((char *) &sampleHeader, sizeof(SampleHeaderData));
+                if(!file.good())
+                {
+                    LOG_WARN_S << "IndexFile: Warning, log file seems to be truncated";
+                    break;
+                }
+
+                if(result.samples.size() <= header.stream_idx)
+                {
+                    result.samples.resize(header.stream_idx + 1);
+                    result.firstSamplePos.resize(header.stream_idx + 1, -1);
+                }
+                if(result.firstSamplePos[header.stream_idx] < 0)
+                    result.firstSamplePos[header.stream_idx] = pos;
+
+                Index::IndexInfo info;
+                info.samplePosInLogFile = pos + sizeof(BlockHeader) + sizeof(SampleHeaderData);
+                if(sampleHeader.compressed == SuperBlockDictionary)
+                    break;
+                if(sampleHeader.compressed == SuperBlockSample)
+                {
+                    if(!scanSuperBlock(result.samples[header.stream_idx], info.samplePosInLogFile, sampleHeader.data_size))
+                    {
+                        result.error = true;
+                        result.endPos = pos;
+                        return;
+                    }
+                    break;
+                }
+
+                info.sampleTime = base::Time::fromSeconds(sampleHeader.realtime_tv_sec, sampleHeader.realtime_tv_usec).microseconds;
+                info.sampleLogicalTime = base::Time::fromSeconds(sampleHeader.timestamp_tv_sec, sampleHeader.timestamp_tv_usec).microseconds;
+                info.sampleDataSize = sampleHeader.data_size;
+                result.samples[header.stream_idx].push_back(info);
+                break;
+            }
+            default:
+                break;
+        }
+        pos = nextPos;
+    }
+
+    result.endPos = pos;
+}
+
+bool BlockScanner::scanSuperBlock(std::vector<Index::IndexInfo>& samples, off_t pos, size_t size)
+{
+    SuperBlock::Header header;
+    try {
+        if(!SuperBlock::readEntries(file, pos, size, header, superBlockEntries))
+            return false;
+    }
+    catch(std::runtime_error const&) {
+        return false;
+    }
+
+    for(const SuperBlock::Entry &entry : superBlockEntries)
+    {
+        Index::IndexInfo info;
+        info.samplePosInLogFile = pos;
+        info.sampleTime = entry.getRealtime().microseconds;
+        info.sampleLogicalTime = entry.getTimestamp().microseconds;
+        info.sampleDataSize = entry.data_size;
+        samples.push_back(info);
+    }
+    return true;
+}
+
+bool BlockScanner::isPlausibleBlock(off_t pos, off_t& nextPos)
+{
+    BlockHeader header;
+    file.seekg(pos);
+    file.read((char *) &header, sizeof(BlockHeader));
+    if(!file.good())
+        return false;
+
+    nextPos = pos + sizeof(BlockHeader) + header.data_size;
+    if(nextPos > fileSize)
+        return false;
+
+    switch(header.type)
+    {
+        case StreamBlockType:
+        {
+            uint8_t streamType;
+            file.read((char *) &streamType, sizeof(streamType));
+            return file.good() && (streamType == DataStreamType || streamType == ControlStreamType);
+        }
+        case DataBlockType:
+        {
+            SampleHeaderData sampleHeader;
+            file.read((char *) &sampleHeader, sizeof(SampleHeaderData));
+            return file.good()
+                && header.data_size == sampleHeader.data_size + sizeof(SampleHeaderData)
+                && sampleHeader.realtime_tv_usec < 1000000
+                && sampleHeader.timestamp_tv_usec < 1000000
+                && sampleHeader.compressed <= SuperBlockDictionary;
+        }
+        case ControlBlockType:
+            return true;
+        default:
+            return false;
+    }
+}
+
+off_t BlockScanner::synchronize(off_t start, off_t end)
+{
+    for(off_t candidate = start; candidate < end; candidate++)
+    {
+        off_t pos = candidate;
+        int chainLength = 0;
+        while(chainLength < SYNC_CHAIN_LENGTH && pos < fileSize)
+        {
+            off_t nextPos;
+            if(!isPlausibleBlock(pos, nextPos))
+                break;
+            pos = nextPos;
+            chainLength++;
+        }
+
+        //a chain that ends exactly at the end of the file is accepted as well
+        if(chainLength == SYNC_CHAIN_LENGTH || (chainLength > 0 && pos == fileSize))
+            return candidate;
+    }
+    return -1;
+}
+
+}
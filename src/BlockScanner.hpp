@@ -0,0 +1,73 @@
+#ifndef POCOLOG_CPP_BLOCKSCANNER_HPP
+#define POCOLOG_CPP_BLOCKSCANNER_HPP
+
+#include <string>
+#include <vector>
+#include "Format.hpp"
+#include "FileStream.hpp"
+#include "Index.hpp"
+#include "SuperBlock.hpp"
+
+namespace pocolog_cpp
+{
+
+/**
+ * Scans the block headers of a byte range of a log file, without going
+ * through LogFile. This is the worker of the parallel index creation,
+ * see IndexFile::createIndexFile.
+ * */
+class BlockScanner
+{
+public:
+    struct Result
+    {
+        /** Position of the first block of the range, -1 if none was found */
+        off_t syncPos = -1;
+        /** Position of the first block after the range */
+        off_t endPos = -1;
+        /** Set if the scan hit something the sequential indexer
+         * would report as an error */
+        bool error = false;
+        /** Positions of the stream declaration blocks, in file order */
+        std::vector<off_t> streamDeclarations;
+        /** The complete samples, per stream index, in file order */
+        std::vector<std::vector<Index::IndexInfo> > samples;
+        /** Position of the first sample of each stream in the range */
+        std::vector<off_t> firstSamplePos;
+    };
+
+    /**
+     * @param fileSize only the first fileSize bytes of the file are
+     *        scanned, which gives the same view on a file that is still
+     *        being written as the one of a LogFile. -1 for the whole file.
+     * */
+    BlockScanner(const std::string &fileName, off_t fileSize = -1);
+
+    /**
+     * Reads the blocks starting exactly at \c pos, until reaching the
+     * first block at or after \c end, or an incomplete block
+     * */
+    void scan(Result &result, off_t pos, off_t end);
+
+    /**
+     * Searches the first position in [start, end) where a chain of
+     * plausible block headers begins.
+     *
+     * @return the position, or -1 if none was found
+     * */
+    off_t synchronize(off_t start, off_t end);
+
+private:
+    bool isPlausibleBlock(off_t pos, off_t &nextPos);
+    /** Adds the samples of the super-block whose data starts at \c pos,
+     * returns false if it is corrupted */
+    bool scanSuperBlock(std::vector<Index::IndexInfo> &samples, off_t pos, size_t size);
+
+    FileStream file;
+    off_t fileSize;
+    std::vector<SuperBlock::Entry> superBlockEntries;
+};
+
+}
+
+#endif
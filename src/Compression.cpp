@@ -0,0 +1,328 @@
+#include "Compression.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <algorithm>
+#include <typelib/endian_swap.hh>
+
+#ifdef POCOLOG_CPP_HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef POCOLOG_CPP_HAS_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+#ifdef POCOLOG_CPP_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace pocolog_cpp
+{
+
+const std::string Compression::METADATA_KEY("pocolog_cpp_compression");
+
+/** Size of the uncompressed size in front of the lz4 and zstd payloads */
+static const size_t SIZE_PREFIX = sizeof(uint32_t);
+
+/** The best compression ratios of lz4 and deflate. A payload that claims
+ * to expand further is corrupted, and is not worth allocating for */
+static const size_t LZ4_MAX_RATIO = 255;
+static const size_t ZLIB_MAX_RATIO = 1032;
+
+#ifdef POCOLOG_CPP_HAS_ZSTD
+/** The default level of the zstd command line tool */
+static const int ZSTD_LEVEL = 3;
+
+/** zstd contexts are reused, as creating them is costly */
+static ZSTD_CCtx *getZstdCompressionContext()
+{
+    static thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    return context.get();
+}
+
+static ZSTD_DCtx *getZstdDecompressionContext()
+{
+    static thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    return context.get();
+}
+#endif
+
+#ifdef POCOLOG_CPP_HAS_LZ4
+/** Compression with a dictionary needs a stream, which LZ4_loadDict resets */
+static LZ4_stream_t *getLz4Stream()
+{
+    static thread_local std::unique_ptr<LZ4_stream_t, int (*)(LZ4_stream_t *)> stream(LZ4_createStream(), LZ4_freeStream);
+    return stream.get();
+}
+#endif
+
+#ifdef POCOLOG_CPP_HAS_ZLIB
+/** Same as compress2, with an optional preset dictionary */
+static size_t zlibCompress(const uint8_t *data, size_t size, uint8_t *dest, size_t capacity,
+                           const uint8_t *dictionary, size_t dictionarySize)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        return 0;
+
+    stream.next_in = const_cast<Bytef *>(data);
+    stream.avail_in = size;
+    stream.next_out = dest;
+    stream.avail_out = capacity;
+    size_t compressedSize = 0;
+    if((!dictionarySize || deflateSetDictionary(&stream, dictionary, dictionarySize) == Z_OK)
+        && deflate(&stream, Z_FINISH) == Z_STREAM_END)
+        compressedSize = stream.total_out;
+    deflateEnd(&stream);
+    return compressedSize;
+}
+
+/** Same as uncompress, with an optional preset dictionary. zlib payloads
+ * are plain zlib streams like the ones of the Ruby pocolog tools, so
+ * their uncompressed size is not known in advance */
+static bool zlibDecompress(const uint8_t *data, size_t size, std::vector<uint8_t> &result,
+                           const uint8_t *dictionary, size_t dictionarySize)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if(inflateInit(&stream) != Z_OK)
+        return false;
+
+    stream.next_in = const_cast<Bytef *>(data);
+    stream.avail_in = size;
+    size_t maxSize = ZLIB_MAX_RATIO * size;
+    result.resize(std::min(std::max<size_t>(std::max(result.capacity(), 4 * size), 64), maxSize));
+    int ret = Z_DATA_ERROR;
+    do
+    {
+        if(stream.total_out == result.size())
+        {
+            if(result.size() == maxSize)
+                break;
+            result.resize(std::min(2 * result.size(), maxSize));
+        }
+        stream.next_out = result.data() + stream.total_out;
+        stream.avail_out = result.size() - stream.total_out;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if(ret == Z_NEED_DICT && dictionarySize && inflateSetDictionary(&stream, dictionary, dictionarySize) == Z_OK)
+            ret = Z_OK;
+    }
+    while(ret == Z_OK || (ret == Z_BUF_ERROR && stream.avail_out == 0));
+    result.resize(stream.total_out);
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END;
+}
+#endif
+
+std::string Compression::getName(CompressionCodec codec)
+{
+    switch(codec)
+    {
+        case NoCompression:
+            return "none";
+        case Lz4Compression:
+            return "lz4";
+        case ZstdCompression:
+            return "zstd";
+        case ZlibCompression:
+            return "zlib";
+    }
+    throw std::invalid_argument("Compression: unknown codec");
+}
+
+CompressionCodec Compression::fromName(const std::string& name)
+{
+    for(CompressionCodec codec : { NoCompression, Lz4Compression, ZstdCompression, ZlibCompression })
+    {
+        if(getName(codec) == name)
+            return codec;
+    }
+    throw std::invalid_argument("Compression: unknown codec " + name);
+}
+
+CompressionCodec Compression::fromMetadata(const std::map<std::string, std::string>& metadata)
+{
+    std::map<std::string, std::string>::const_iterator it = metadata.find(METADATA_KEY);
+    if(it == metadata.end())
+        return NoCompression;
+    return fromName(it->second);
+}
+
+bool Compression::isAvailable(CompressionCodec codec)
+{
+    switch(codec)
+    {
+        case NoCompression:
+            return true;
+        case Lz4Compression:
+#ifdef POCOLOG_CPP_HAS_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case ZstdCompression:
+#ifdef POCOLOG_CPP_HAS_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        case ZlibCompression:
+#ifdef POCOLOG_CPP_HAS_ZLIB
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+bool Compression::compress(CompressionCodec codec, const uint8_t* data, size_t size, std::vector<uint8_t>& result,
+                           const uint8_t* dictionary, size_t dictionarySize)
+{
+    if(!isAvailable(codec))
+        throw std::runtime_error("Compression: pocolog_cpp was built without support for " + getName(codec));
+    if(codec == NoCompression || size < SIZE_PREFIX || size > UINT32_MAX)
+        return false;
+
+    //anything that does not fit in here is not worth it. zlib payloads
+    //have no size prefix, see decompress
+    size_t capacity = size - SIZE_PREFIX;
+    size_t prefix = codec == ZlibCompression ? 0 : SIZE_PREFIX;
+    result.resize(size);
+    size_t compressedSize = 0;
+    switch(codec)
+    {
+#ifdef POCOLOG_CPP_HAS_LZ4
+        case Lz4Compression:
+            if(size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE))
+                return false;
+            if(dictionarySize)
+            {
+                LZ4_loadDict(getLz4Stream(), reinterpret_cast<const char *>(dictionary), static_cast<int>(dictionarySize));
+                compressedSize = LZ4_compress_fast_continue(getLz4Stream(), reinterpret_cast<const char *>(data), reinterpret_cast<char *>(result.data() + prefix),
+                                                            static_cast<int>(size), static_cast<int>(capacity), 1);
+            }
+            else
+                compressedSize = LZ4_compress_default(reinterpret_cast<const char *>(data), reinterpret_cast<char *>(result.data() + prefix),
+                                                      static_cast<int>(size), static_cast<int>(capacity));
+            break;
+#endif
+#ifdef POCOLOG_CPP_HAS_ZSTD
+        case ZstdCompression:
+        {
+            size_t ret = ZSTD_compress_usingDict(getZstdCompressionContext(), result.data() + prefix, capacity, data, size,
+                                                 dictionary, dictionarySize, ZSTD_LEVEL);
+            compressedSize = ZSTD_isError(ret) ? 0 : ret;
+            break;
+        }
+#endif
+#ifdef POCOLOG_CPP_HAS_ZLIB
+        case ZlibCompression:
+            compressedSize = zlibCompress(data, size, result.data() + prefix, capacity, dictionary, dictionarySize);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if(compressedSize == 0)
+        return false;
+
+    if(prefix)
+    {
+        uint32_t uncompressedSize = Typelib::Endian::to_little<uint32_t>(size);
+        memcpy(result.data(), &uncompressedSize, SIZE_PREFIX);
+    }
+    result.resize(prefix + compressedSize);
+    return true;
+}
+
+void Compression::decompress(CompressionCodec codec, const uint8_t* data, size_t size, std::vector<uint8_t>& result,
+                             const uint8_t* dictionary, size_t dictionarySize)
+{
+    //the Ruby pocolog tools compress with zlib, without recording the codec
+    if(codec == NoCompression)
+        codec = ZlibCompression;
+    if(!isAvailable(codec))
+        throw std::runtime_error("Compression: sample is compressed with " + getName(codec) + ", but pocolog_cpp was built without support for it");
+
+#ifdef POCOLOG_CPP_HAS_ZLIB
+    if(codec == ZlibCompression)
+    {
+        if(!zlibDecompress(data, size, result, dictionary, dictionarySize))
+            throw std::runtime_error("Compression: could not decompress sample, the payload is corrupted");
+        return;
+    }
+#endif
+
+    if(size < SIZE_PREFIX)
+        throw std::runtime_error("Compression: compressed sample is truncated");
+
+    uint32_t uncompressedSize;
+    memcpy(&uncompressedSize, data, SIZE_PREFIX);
+    uncompressedSize = Typelib::Endian::from_little(uncompressedSize);
+    data += SIZE_PREFIX;
+    size -= SIZE_PREFIX;
+
+    //the size prefix is checked against the payload before allocating
+    //for it, a corrupted one could ask for up to 4GB
+    bool valid = false;
+    switch(codec)
+    {
+#ifdef POCOLOG_CPP_HAS_LZ4
+        case Lz4Compression:
+            if(uncompressedSize > LZ4_MAX_RATIO * size)
+                break;
+            result.resize(uncompressedSize);
+            valid = LZ4_decompress_safe_usingDict(reinterpret_cast<const char *>(data), reinterpret_cast<char *>(result.data()),
+                                                  static_cast<int>(size), static_cast<int>(uncompressedSize),
+                                                  reinterpret_cast<const char *>(dictionary), static_cast<int>(dictionarySize)) == static_cast<int>(uncompressedSize);
+            break;
+#endif
+#ifdef POCOLOG_CPP_HAS_ZSTD
+        case ZstdCompression:
+            if(ZSTD_getFrameContentSize(data, size) != uncompressedSize)
+                break;
+            result.resize(uncompressedSize);
+            valid = ZSTD_decompress_usingDict(getZstdDecompressionContext(), result.data(), uncompressedSize, data, size,
+                                              dictionary, dictionarySize) == uncompressedSize;
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if(!valid)
+        throw std::runtime_error("Compression: could not decompress sample, the payload is corrupted");
+}
+
+void Compression::trainDictionary(CompressionCodec codec, const uint8_t* samples, const std::vector<size_t>& sampleSizes,
+                                  size_t maxSize, std::vector<uint8_t>& dictionary)
+{
+    size_t totalSize = std::accumulate(sampleSizes.begin(), sampleSizes.end(), size_t(0));
+    dictionary.clear();
+    if(codec == NoCompression)
+        return;
+
+#ifdef POCOLOG_CPP_HAS_ZSTD
+    if(codec == ZstdCompression)
+    {
+        dictionary.resize(maxSize);
+        size_t ret = ZDICT_trainFromBuffer(dictionary.data(), maxSize, samples, sampleSizes.data(), sampleSizes.size());
+        if(!ZDICT_isError(ret))
+        {
+            dictionary.resize(ret);
+            return;
+        }
+        //the training needs plenty of samples, zstd accepts the raw
+        //content of the samples as dictionary as well
+    }
+#endif
+
+    size_t size = std::min(maxSize, totalSize);
+    dictionary.assign(samples + totalSize - size, samples + totalSize);
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef POCOLOG_CPP_COMPRESSION_HPP
+#define POCOLOG_CPP_COMPRESSION_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+namespace pocolog_cpp
+{
+
+enum CompressionCodec
+{
+    NoCompression = 0,
+    Lz4Compression = 1,   ///< fast, for streams limited by disk bandwidth
+    ZstdCompression = 2,  ///< better ratio at a higher cost
+    ZlibCompression = 3
+};
+
+/**
+ * Compression of sample payloads.
+ *
+ * The codec of a stream is recorded in its metadata under METADATA_KEY.
+ * Samples that were compressed have the compressed flag of their sample
+ * header set. The payload of lz4 and zstd samples consists of the
+ * uncompressed size as a little endian uint32_t, followed by the
+ * compressed data. zlib samples are plain zlib streams, as written by the
+ * Ruby pocolog tools, which set the flag without recording the codec.
+ * Samples that do not get smaller are stored uncompressed, so a stream
+ * may contain both.
+ *
+ * The codecs are optional dependencies, see isAvailable.
+ * */
+class Compression
+{
+public:
+    /** Metadata key of the codec, the value is the name of the codec */
+    static const std::string METADATA_KEY;
+
+    static std::string getName(CompressionCodec codec);
+
+    /** Returns the codec with the given name, throws if there is none */
+    static CompressionCodec fromName(const std::string &name);
+
+    /** Returns the codec recorded in the given stream metadata */
+    static CompressionCodec fromMetadata(const std::map<std::string, std::string> &metadata);
+
+    /** Returns true if pocolog_cpp was built with support for the codec */
+    static bool isAvailable(CompressionCodec codec);
+
+    /**
+     * Compresses a payload into \c result.
+     *
+     * @param dictionary optional dictionary, see trainDictionary. The
+     *        same dictionary has to be given to decompress.
+     * @return false if the compressed payload would not be smaller, in
+     *         which case the sample should be stored uncompressed
+     * */
+    static bool compress(CompressionCodec codec, const uint8_t *data, size_t size, std::vector<uint8_t> &result,
+                         const uint8_t *dictionary = nullptr, size_t dictionarySize = 0);
+
+    /**
+     * Decompresses a payload written by compress into \c result.
+     * NoCompression stands for a stream without codec, whose compressed
+     * samples were written by the Ruby pocolog tools with zlib.
+     * Throws if the payload is corrupted or the codec is not available.
+     * */
+    static void decompress(CompressionCodec codec, const uint8_t *data, size_t size, std::vector<uint8_t> &result,
+                           const uint8_t *dictionary = nullptr, size_t dictionarySize = 0);
+
+    /**
+     * Builds a dictionary of at most \c maxSize bytes for payloads that
+     * are similar to the given samples, which are stored back to back in
+     * \c samples. zstd trains a dictionary, the other codecs use the
+     * content of the last samples. The result may be empty.
+     * */
+    static void trainDictionary(CompressionCodec codec, const uint8_t *samples, const std::vector<size_t> &sampleSizes,
+                                size_t maxSize, std::vector<uint8_t> &dictionary);
+};
+
+}
+
+#endif
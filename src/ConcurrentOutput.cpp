@@ -0,0 +1,248 @@
+#include "ConcurrentOutput.hpp"
+#include "Write.hpp"
+#include <cstring>
+#include <cstdint>
+
+namespace pocolog_cpp
+{
+
+static size_t roundUpToPowerOfTwo(size_t value)
+{
+    size_t result = 2;
+    while(result < value)
+        result *= 2;
+    return result;
+}
+
+ConcurrentOutput::ConcurrentOutput(Output& output, size_t numSlots, size_t maxSampleSize, OverflowPolicy policy)
+    : output(output)
+    , slotMask(roundUpToPowerOfTwo(numSlots) - 1)
+    , maxSampleSize(maxSampleSize)
+    , policy(policy)
+    , enqueuePos(0)
+    , droppedSamples(0)
+    , writtenSamples(0)
+    , flushTarget(0)
+    , writerWaiting(false)
+    , stopRequested(false)
+    , failed(false)
+    , flushedPos(0)
+{
+    slots.reset(new Slot[slotMask + 1]);
+    for(size_t i = 0; i <= slotMask; i++)
+    {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+        slots[i].size = 0;
+    }
+
+    thread = std::thread(&ConcurrentOutput::run, this);
+}
+
+ConcurrentOutput::~ConcurrentOutput()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    wakeWriter.notify_one();
+    thread.join();
+}
+
+ConcurrentOutput::Slot* ConcurrentOutput::reserve(bool block, size_t& pos)
+{
+    pos = enqueuePos.load(std::memory_order_relaxed);
+    while(true)
+    {
+        Slot &slot = slots[pos & slotMask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if(diff == 0)
+        {
+            //on failure, pos is updated to the current position
+            if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                return &slot;
+        }
+        else if(diff < 0)
+        {
+            //the writer thread did not free this slot yet, the ring is full
+            if(!block)
+                return nullptr;
+            std::this_thread::yield();
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            //another producer took the slot
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void ConcurrentOutput::publish(Slot& slot, size_t pos)
+{
+    //sequentially consistent, so that either the writer sees the slot
+    //before it goes to sleep or we see that it sleeps
+    slot.sequence.store(pos + 1);
+    if(writerWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeWriter.notify_one();
+    }
+}
+
+uint16_t ConcurrentOutput::registerStream(const std::string& name, const std::string& typeName,
+                                          const std::string& typeDef, const std::vector<StreamMetadata>& metadata)
+{
+    std::lock_guard<std::mutex> lock(declarationMutex);
+
+    std::unique_ptr<Declaration> declaration(new Declaration{output.newStreamIndex(), name, typeName, typeDef, metadata});
+    uint16_t streamIdx = declaration->streamIdx;
+
+    size_t pos;
+    Slot *slot = reserve(true, pos);
+    slot->declaration = std::move(declaration);
+    publish(*slot, pos);
+    return streamIdx;
+}
+
+bool ConcurrentOutput::writeSample(uint16_t streamIdx, const base::Time& realtime, const base::Time& logical,
+                                   const void* payload, uint32_t payloadSize)
+{
+    //the writer thread discards everything after a write error
+    if(payloadSize > maxSampleSize || failed.load(std::memory_order_relaxed))
+    {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    size_t pos;
+    Slot *slot = reserve(policy == BLOCK_PRODUCERS, pos);
+    if(!slot)
+    {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    slot->size = Output::DATA_BLOCK_HEADERS_SIZE + payloadSize;
+    if(slot->data.size() < slot->size)
+        slot->data.resize(slot->size);
+    Output::encodeSampleHeader(slot->data.data(), streamIdx, realtime, logical, payloadSize);
+    memcpy(slot->data.data() + Output::DATA_BLOCK_HEADERS_SIZE, payload, payloadSize);
+
+    publish(*slot, pos);
+    return true;
+}
+
+void ConcurrentOutput::flush()
+{
+    size_t target = enqueuePos.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if(flushTarget.load() < target)
+        flushTarget.store(target);
+    wakeWriter.notify_one();
+    flushed.wait(lock, [&] { return flushedPos >= target; });
+    if(writeError)
+        std::rethrow_exception(writeError);
+}
+
+void ConcurrentOutput::fail(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!writeError)
+        writeError = error;
+    failed.store(true);
+}
+
+void ConcurrentOutput::flushOutput(size_t pos)
+{
+    if(!failed.load())
+    {
+        try
+        {
+            output.flush();
+        }
+        catch(...)
+        {
+            fail(std::current_exception());
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        flushedPos = pos;
+    }
+    flushed.notify_all();
+}
+
+void ConcurrentOutput::run()
+{
+    size_t pos = 0;
+    while(true)
+    {
+        Slot &slot = slots[pos & slotMask];
+        bool ready = slot.sequence.load(std::memory_order_acquire) == pos + 1;
+        if(ready)
+        {
+            //the state of the output is unknown after an error, so the
+            //remaining slots are only freed
+            if(failed.load())
+            {
+                if(!slot.declaration)
+                    droppedSamples.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                try
+                {
+                    if(slot.declaration)
+                    {
+                        Declaration &declaration = *slot.declaration;
+                        output.writeStreamDeclaration(declaration.streamIdx, DataStreamType, declaration.name,
+                                                      declaration.typeName, declaration.typeDef, declaration.metadata);
+                    }
+                    else
+                    {
+                        output.writeEncoded(slot.data.data(), slot.size);
+                        writtenSamples.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                catch(...)
+                {
+                    fail(std::current_exception());
+                    if(!slot.declaration)
+                        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            slot.declaration.reset();
+
+            //hand the slot to the producers of the next round
+            slot.sequence.store(pos + slotMask + 1, std::memory_order_release);
+            pos++;
+        }
+
+        //flushedPos is only written by this thread
+        size_t target = flushTarget.load();
+        if(flushedPos < target && target <= pos)
+            flushOutput(pos);
+
+        if(ready)
+            continue;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        writerWaiting.store(true);
+        wakeWriter.wait(lock, [&] {
+            size_t target = flushTarget.load();
+            return slot.sequence.load() == pos + 1
+                || (flushedPos < target && target <= pos)
+                || (stopRequested && enqueuePos.load() == pos);
+        });
+        writerWaiting.store(false);
+
+        if(slot.sequence.load() != pos + 1 && stopRequested && enqueuePos.load() == pos)
+            break;
+    }
+
+    flushOutput(pos);
+}
+
+}
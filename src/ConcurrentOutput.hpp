@@ -0,0 +1,172 @@
+#ifndef POCOLOG_CPP_CONCURRENTOUTPUT_HPP
+#define POCOLOG_CPP_CONCURRENTOUTPUT_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+#include <vector>
+#include <string>
+#include <base/Time.hpp>
+#include "Format.hpp"
+
+namespace pocolog_cpp
+{
+class Output;
+
+/**
+ * Front-end that lets several threads log into one Output.
+ *
+ * The producers encode their samples into the slots of a bounded,
+ * lock-free ring, and a writer thread moves them to the output in the
+ * order in which the slots were reserved. Writing a sample neither takes
+ * a lock nor waits for the file, as long as the ring is not full.
+ *
+ * The memory is bounded by the number of slots times the maximum sample
+ * size. The slot buffers grow up to the size of the biggest sample they
+ * held, so the front-end does not allocate anymore once it is warmed up.
+ *
+ * The Output must not be used directly while the front-end exists.
+ * Buffered data is written to it by flush() and on destruction.
+ *
+ * If the output throws, the writer thread stops writing to it and
+ * discards the remaining samples. The error is rethrown by flush(), and
+ * writeSample returns false from then on.
+ * */
+class ConcurrentOutput
+{
+public:
+    /** What writeSample does if the ring is full */
+    enum OverflowPolicy
+    {
+        /** The sample is dropped and counted in getDroppedSamples() */
+        DROP_SAMPLES,
+        /** The producer waits until the writer thread freed a slot */
+        BLOCK_PRODUCERS
+    };
+
+    /**
+     * @param output the output the samples are written to
+     * @param numSlots size of the ring, rounded up to a power of two
+     * @param maxSampleSize payload size above which samples are dropped
+     * @param policy what to do if the ring is full
+     * */
+    ConcurrentOutput(Output &output, size_t numSlots = 1024, size_t maxSampleSize = 64 * 1024, OverflowPolicy policy = DROP_SAMPLES);
+
+    /** Writes all queued samples and stops the writer thread */
+    ~ConcurrentOutput();
+
+    ConcurrentOutput(const ConcurrentOutput &) = delete;
+    ConcurrentOutput &operator = (const ConcurrentOutput &) = delete;
+
+    /**
+     * Declares a new data stream and returns its index. Declarations are
+     * never dropped, if the ring is full the caller waits regardless of
+     * the overflow policy.
+     * */
+    uint16_t registerStream(const std::string &name, const std::string &typeName,
+                            const std::string &typeDef, const std::vector<StreamMetadata> &metadata);
+
+    /**
+     * Queues a sample of a stream returned by registerStream. Can be called
+     * from any thread.
+     *
+     * @return false if the sample was dropped, either because it is bigger
+     *         than the maximum sample size, because the ring was full
+     *         and the policy is DROP_SAMPLES or because writing to the
+     *         output failed
+     * */
+    bool writeSample(uint16_t streamIdx, const base::Time &realtime, const base::Time &logical,
+                     const void *payload, uint32_t payloadSize);
+
+    /**
+     * Waits until all samples queued before the call are written, and
+     * flushes the output. Rethrows the error of the output if writing to
+     * it failed.
+     * */
+    void flush();
+
+    /** Number of samples dropped since the creation of the front-end */
+    uint64_t getDroppedSamples() const
+    {
+        return droppedSamples.load(std::memory_order_relaxed);
+    }
+
+    /** Number of samples handed to the output by the writer thread */
+    uint64_t getWrittenSamples() const
+    {
+        return writtenSamples.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Declaration
+    {
+        uint16_t streamIdx;
+        std::string name;
+        std::string typeName;
+        std::string typeDef;
+        std::vector<StreamMetadata> metadata;
+    };
+
+    /**
+     * A slot of the ring. Its sequence tells who owns it: it is free for
+     * the producer of position pos if sequence == pos, and ready for the
+     * writer thread if sequence == pos + 1.
+     * */
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        /** The encoded data block */
+        std::vector<char> data;
+        size_t size;
+        /** Set instead of data for stream declarations */
+        std::unique_ptr<Declaration> declaration;
+    };
+
+    /** Reserves the next slot, returns nullptr if the ring is full and
+     * \c block is false */
+    Slot *reserve(bool block, size_t &pos);
+    /** Hands a filled slot over to the writer thread */
+    void publish(Slot &slot, size_t pos);
+    void run();
+    void flushOutput(size_t pos);
+    /** Records the first error of the output, called by the writer thread */
+    void fail(std::exception_ptr error);
+
+    Output &output;
+    std::unique_ptr<Slot[]> slots;
+    size_t slotMask;
+    size_t maxSampleSize;
+    OverflowPolicy policy;
+
+    /** Position of the next slot to reserve, on its own cache line as all
+     * producers write it */
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<uint64_t> droppedSamples;
+    std::atomic<uint64_t> writtenSamples;
+    /** Position up to which a flush was requested */
+    std::atomic<size_t> flushTarget;
+    std::atomic<bool> writerWaiting;
+    std::atomic<bool> stopRequested;
+    /** Set once writing to the output failed */
+    std::atomic<bool> failed;
+
+    /** Serializes the declarations of new streams */
+    std::mutex declarationMutex;
+
+    std::mutex mutex;
+    std::condition_variable wakeWriter;
+    std::condition_variable flushed;
+    /** Position up to which all slots are written and flushed */
+    size_t flushedPos;
+    /** The first error of the output, protected by mutex */
+    std::exception_ptr writeError;
+
+    std::thread thread;
+};
+
+}
+
+#endif
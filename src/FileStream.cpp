@@ -2,20 +2,31 @@
 #include <base-logging/Logging.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <stdexcept>
 #include <unistd.h>
 
-pocolog_cpp::FileStream::FileStream() : fd(-1), goodFlag(false), fileName("")
+#ifdef POCOLOG_CPP_HAS_IO_URING
+#include <liburing.h>
+#endif
+
+pocolog_cpp::FileStream::FileStream() : fd(-1), readAheadSize(0), mappedData(nullptr), mappedSize(0), batchQueueDepth(32), ring(nullptr), ringUnavailable(false), goodFlag(false), fileName("")
 {
 
 }
 
-pocolog_cpp::FileStream::FileStream(const char* __s, std::ios_base::openmode mode)
+pocolog_cpp::FileStream::FileStream(const char* __s, std::ios_base::openmode mode, bool memoryMapped) : fd(-1), readAheadSize(0), mappedData(nullptr), mappedSize(0), batchQueueDepth(32), ring(nullptr), ringUnavailable(false)
 {
-    if(!open(__s, mode))
+    if(!open(__s, mode, memoryMapped))
     {
         throw std::runtime_error(std::string("Error opening file") + __s);
     }
@@ -28,8 +39,11 @@ pocolog_cpp::FileStream::~FileStream()
 }
 
 
-bool pocolog_cpp::FileStream::open(const char* fileName, std::ios_base::openmode mode)
+bool pocolog_cpp::FileStream::open(const char* fileName, std::ios_base::openmode mode, bool memoryMapped)
 {
+    if(fd != -1)
+        close();
+
     fd = ::open(fileName, O_NONBLOCK);
     if(fd < 0)
     {
@@ -51,48 +65,69 @@ bool pocolog_cpp::FileStream::open(const char* fileName, std::ios_base::openmode
     goodFlag = true;
     readBufferPosition = -1;
     readBufferEndPosition = -1;
-    readBuffer.resize(blockSize);
+    setReadAheadSize(readAheadSize);
     readPos = 0;
     writePos = 0;
     this->fileName = fileName;
     
-    LOG_DEBUG_S << "File opened " << (fd > 0) << " file size " << fileSize  << " blk size " << blockSize;
+    if(memoryMapped && !mapFile(fileSize))
+        LOG_WARN_S << "FileStream: Could not memory map " << fileName << ", falling back to buffered reads";
+    
+    LOG_DEBUG_S << "File opened " << (fd > 0) << " file size " << fileSize  << " blk size " << blockSize << " mapped " << isMemoryMapped();
     
     return true;
 }
 
-bool pocolog_cpp::FileStream::reloadBuffer(off_t position)
+bool pocolog_cpp::FileStream::mapFile(size_t length)
 {
-    LOG_DEBUG_S << "Loading Buffer " << position;
-    off_t newPos = ::lseek(fd, position, SEEK_SET);
-    if(newPos == -1)
-    {
-        goodFlag = false;
-        LOG_ERROR_S << "Seek Failed";
+    if(length == 0)
         return false;
-    }
 
-    assert(position == newPos);
-    
-    off_t blockNr = position / blockSize;
-    
-    off_t bytesToBlockEnd = (blockNr + 1) * blockSize - position;
-    
-    LOG_DEBUG_S << "Reading " << bytesToBlockEnd << " bytes ";
-    
-    readBufferPosition = position;
-    readBufferEndPosition = position + bytesToBlockEnd;
-    
-    size_t toRead = bytesToBlockEnd;
-    if(readBufferEndPosition > fileSize)
-        toRead = fileSize - readBufferPosition;
-    
+    void *data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+        return false;
+
+    //log files are mostly read front to back
+    ::madvise(data, length, MADV_SEQUENTIAL);
+
+    if(mappedData)
+        retiredMappings.emplace_back(mappedData, mappedSize);
+    mappedData = static_cast<const uint8_t *>(data);
+    mappedSize = length;
+    return true;
+}
+
+void pocolog_cpp::FileStream::unmapFile()
+{
+    for(const FileView &mapping : retiredMappings)
+        ::munmap(const_cast<uint8_t *>(mapping.data), mapping.size);
+    retiredMappings.clear();
+
+    if(!mappedData)
+        return;
+
+    ::munmap(const_cast<uint8_t *>(mappedData), mappedSize);
+    mappedData = nullptr;
+}
+
+pocolog_cpp::FileView pocolog_cpp::FileStream::view(off_t pos, size_t size) const
+{
+    if(!mappedData || pos < 0 || pos + static_cast<off_t>(size) > fileSize)
+        return FileView();
+
+    return FileView(mappedData + pos, size);
+}
+
+bool pocolog_cpp::FileStream::readFromFile(char* buffer, off_t position, size_t size)
+{
     size_t readSize = 0;
-    while(readSize < toRead)
+    while(readSize < size)
     {
-        int ret = ::read(fd, readBuffer.data() + readSize, toRead - readSize);
+        ssize_t ret = ::pread(fd, buffer + readSize, size - readSize, position + readSize);
         if(ret < 0)
         {
+            if(errno == EINTR)
+                continue;
             goodFlag = false;
             LOG_ERROR_S << "Read Error";
             return false;
@@ -101,11 +136,37 @@ bool pocolog_cpp::FileStream::reloadBuffer(off_t position)
         {
             //should not happen
             throw std::runtime_error("Internal error in FileStream, Read returned EOF");
-            //end of file reached
-            break;
         }
         readSize += ret;
     }
+    return true;
+}
+
+bool pocolog_cpp::FileStream::reloadBuffer(off_t position)
+{
+    LOG_DEBUG_S << "Loading Buffer " << position;
+    
+    //the window always ends on a block boundary, so that
+    //consecutive reloads stay aligned
+    off_t blockStart = (position / blockSize) * blockSize;
+    
+    off_t bytesToWindowEnd = blockStart + readBuffer.size() - position;
+    
+    LOG_DEBUG_S << "Reading " << bytesToWindowEnd << " bytes ";
+    
+    size_t toRead = bytesToWindowEnd;
+    if(position + bytesToWindowEnd > fileSize)
+        toRead = fileSize - position;
+    
+    //invalidate the buffer in case the read fails
+    readBufferPosition = -1;
+    readBufferEndPosition = -1;
+    
+    if(!readFromFile(readBuffer.data(), position, toRead))
+        return false;
+    
+    readBufferPosition = position;
+    readBufferEndPosition = position + toRead;
     
     LOG_DEBUG_S << "Buffer Loaded " << readBufferPosition << " end " << readBufferEndPosition;
     
@@ -116,9 +177,19 @@ void pocolog_cpp::FileStream::read(char* buffer, size_t size)
 {
     LOG_DEBUG_S << "Reading Bytes from pos " << readPos;
 
-    size_t posInBuf = readPos - readBufferPosition;
-    
-    for(size_t i = 0; i < size; i++)
+    if(mappedData)
+    {
+        size_t available = readPos < fileSize ? fileSize - readPos : 0;
+        size_t toCopy = std::min(size, available);
+        memcpy(buffer, mappedData + readPos, toCopy);
+        readPos += toCopy;
+        if(toCopy != size)
+            goodFlag = false;
+        return;
+    }
+
+    size_t done = 0;
+    while(done < size)
     {
         if(eof())
         {
@@ -126,23 +197,53 @@ void pocolog_cpp::FileStream::read(char* buffer, size_t size)
             return;
         }
         
+        size_t remaining = size - done;
         if(!posInBuffer(readPos))
         {
+            if(remaining >= readBuffer.size())
+            {
+                //large payload, read directly into the caller's
+                //buffer instead of going through the read buffer
+                size_t toRead = std::min<off_t>(remaining, fileSize - readPos);
+                if(!readFromFile(buffer + done, readPos, toRead))
+                    return;
+                done += toRead;
+                readPos += toRead;
+                continue;
+            }
+            
             //load new buffer
             if(!reloadBuffer(readPos))
                 return;
-            
-            posInBuf = readPos - readBufferPosition;
-            assert(posInBuf == 0);
         }
         
-        buffer[i] = readBuffer[posInBuf];
-        posInBuf++;
-        readPos++;
+        size_t chunk = std::min<off_t>(remaining, readBufferEndPosition - readPos);
+        memcpy(buffer + done, readBuffer.data() + (readPos - readBufferPosition), chunk);
+        done += chunk;
+        readPos += chunk;
     }
     
 }
 
+void pocolog_cpp::FileStream::setReadAheadSize(size_t size)
+{
+    readAheadSize = size;
+    if(fd == -1)
+        return;
+
+    //round up to full blocks, the window is at least one block
+    size_t numBlocks = std::max<size_t>(1, (size + blockSize - 1) / blockSize);
+    readBuffer.resize(numBlocks * blockSize);
+    readBuffer.shrink_to_fit();
+    readBufferPosition = -1;
+    readBufferEndPosition = -1;
+}
+
+size_t pocolog_cpp::FileStream::getReadAheadSize() const
+{
+    return readBuffer.size();
+}
+
 bool pocolog_cpp::FileStream::good() const
 {
     return goodFlag;
@@ -182,11 +283,258 @@ off_t pocolog_cpp::FileStream::size() const
     return fileSize;
 }
 
+bool pocolog_cpp::FileStream::refreshSize()
+{
+    struct stat stats;
+    if(fd < 0 || ::fstat(fd, &stats) < 0 || stats.st_size <= fileSize)
+        return false;
+
+    //map twice the current size, so that a growing file does not
+    //need to be mapped again on every refresh. The part of the
+    //mapping beyond the end of file is never accessed.
+    if(mappedData && static_cast<size_t>(stats.st_size) > mappedSize
+        && !mapFile(stats.st_size * 2))
+    {
+        LOG_ERROR_S << "FileStream: Could not map the grown file " << fileName;
+        return false;
+    }
+
+    fileSize = stats.st_size;
+    return true;
+}
+
 void pocolog_cpp::FileStream::close()
 {
     goodFlag = false;
+    unmapFile();
+    releaseRing();
     if(fd > 0)
         ::close(fd);
     fd = -1;
 }
 
+
+void pocolog_cpp::FileStream::setBatchQueueDepth(size_t depth)
+{
+    batchQueueDepth = std::max<size_t>(depth, 1);
+    //the ring is sized after the queue depth
+    releaseRing();
+}
+
+bool pocolog_cpp::FileStream::readBatch(std::vector<ReadRequest>& requests)
+{
+    for(const ReadRequest &request : requests)
+    {
+        if(request.pos < 0 || request.pos + static_cast<off_t>(request.size) > fileSize)
+            return false;
+    }
+
+    if(mappedData)
+    {
+        for(const ReadRequest &request : requests)
+        {
+            //the buffer of an empty request may be null
+            if(request.size)
+                memcpy(request.buffer, mappedData + request.pos, request.size);
+        }
+        return true;
+    }
+
+#ifdef POCOLOG_CPP_HAS_IO_URING
+    if(setupRing())
+    {
+        //empty requests are complete already, and reads that hit the end
+        //of the file are finished with single reads like in the preadv
+        //path below
+        std::vector<size_t> pending;
+        std::vector<size_t> shortReads;
+        std::vector<size_t> bytesRead(requests.size(), 0);
+        for(size_t i = requests.size(); i > 0; i--)
+        {
+            if(requests[i - 1].size)
+                pending.push_back(i - 1);
+        }
+
+        size_t inFlight = 0;
+        bool failed = false;
+        while(inFlight || (!failed && !pending.empty()))
+        {
+            while(!failed && !pending.empty() && inFlight < batchQueueDepth)
+            {
+                io_uring_sqe *sqe = io_uring_get_sqe(ring);
+                if(!sqe)
+                    break;
+
+                size_t idx = pending.back();
+                pending.pop_back();
+                const ReadRequest &request(requests[idx]);
+                io_uring_prep_read(sqe, fd, request.buffer + bytesRead[idx],
+                                   request.size - bytesRead[idx], request.pos + bytesRead[idx]);
+                io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(idx));
+                inFlight++;
+            }
+
+            int ret = io_uring_submit_and_wait(ring, 1);
+            if(ret < 0 && ret != -EINTR && ret != -EBUSY)
+            {
+                //tearing down the ring cancels the reads in flight
+                LOG_ERROR_S << "FileStream: io_uring submission failed";
+                releaseRing();
+                goodFlag = false;
+                return false;
+            }
+
+            io_uring_cqe *cqe;
+            unsigned head;
+            unsigned numCompleted = 0;
+            io_uring_for_each_cqe(ring, head, cqe)
+            {
+                size_t idx = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+                numCompleted++;
+                inFlight--;
+
+                if(cqe->res == -EINTR || cqe->res == -EAGAIN)
+                {
+                    pending.push_back(idx);
+                    continue;
+                }
+                if(cqe->res < 0)
+                {
+                    failed = true;
+                    continue;
+                }
+                if(cqe->res == 0)
+                {
+                    shortReads.push_back(idx);
+                    continue;
+                }
+
+                bytesRead[idx] += cqe->res;
+                //short read, queue the remainder
+                if(bytesRead[idx] < requests[idx].size)
+                    pending.push_back(idx);
+            }
+            io_uring_cq_advance(ring, numCompleted);
+        }
+
+        if(failed)
+        {
+            LOG_ERROR_S << "FileStream: Batched read failed";
+            goodFlag = false;
+            return false;
+        }
+
+        for(size_t idx : shortReads)
+        {
+            const ReadRequest &request(requests[idx]);
+            if(!readFromFile(request.buffer + bytesRead[idx], request.pos + bytesRead[idx], request.size - bytesRead[idx]))
+                return false;
+        }
+        return true;
+    }
+#endif
+
+    //sort the requests by position, so that nearby reads can be merged
+    std::vector<size_t> order(requests.size());
+    for(size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&requests](size_t a, size_t b) {
+        return requests[a].pos < requests[b].pos;
+    });
+
+    //gaps of up to one block between requests are read into a
+    //scratch buffer, as this is cheaper than an additional syscall
+    std::vector<char> gapBuffer(blockSize);
+    std::vector<iovec> iov;
+    size_t i = 0;
+    while(i < order.size())
+    {
+        iov.clear();
+        off_t start = requests[order[i]].pos;
+        off_t end = start;
+        size_t j = i;
+        while(j < order.size() && iov.size() + 2 <= IOV_MAX)
+        {
+            const ReadRequest &request(requests[order[j]]);
+            if(request.pos < end || request.pos - end > blockSize)
+                break;
+            if(request.pos > end)
+                iov.push_back({gapBuffer.data(), static_cast<size_t>(request.pos - end)});
+            iov.push_back({request.buffer, request.size});
+            end = request.pos + request.size;
+            j++;
+        }
+
+        ssize_t ret = ::preadv(fd, iov.data(), iov.size(), start);
+        if(ret != end - start)
+        {
+            //short or interrupted read, fall back to single reads
+            for(size_t k = i; k < j; k++)
+            {
+                const ReadRequest &request(requests[order[k]]);
+                if(!readFromFile(request.buffer, request.pos, request.size))
+                    return false;
+            }
+        }
+        i = j;
+    }
+
+    return true;
+}
+
+bool pocolog_cpp::FileStream::setupRing()
+{
+#ifdef POCOLOG_CPP_HAS_IO_URING
+    if(ring)
+        return true;
+    if(ringUnavailable)
+        return false;
+
+    ring = new io_uring;
+    int ret = io_uring_queue_init(batchQueueDepth, ring, 0);
+    if(ret < 0)
+    {
+        LOG_WARN_S << "FileStream: io_uring is not available, using preadv for batched reads";
+        delete ring;
+        ring = nullptr;
+        //don't try again on every batch
+        ringUnavailable = true;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void pocolog_cpp::FileStream::releaseRing()
+{
+#ifdef POCOLOG_CPP_HAS_IO_URING
+    if(!ring)
+        return;
+
+    io_uring_queue_exit(ring);
+    delete ring;
+    ring = nullptr;
+#endif
+}
+
+std::string pocolog_cpp::createTemporaryFile(const std::string& fileName)
+{
+    //the pid separates the processes, the counter the threads
+    static std::atomic<unsigned> counter(0);
+    std::string pid(std::to_string(::getpid()));
+    while(true)
+    {
+        std::string tmpFileName(fileName + "." + pid + "." + std::to_string(counter++) + ".tmp");
+        int tmpFd = ::open(tmpFileName.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if(tmpFd >= 0)
+        {
+            ::close(tmpFd);
+            return tmpFileName;
+        }
+        //left behind by a crashed process that had the same pid
+        if(errno != EEXIST)
+            return std::string();
+    }
+}
@@ -2,10 +2,39 @@
 #define FILESTREAM_H
 
 #include <fstream>
+#include <string>
 #include <vector>
+#include <stdint.h>
+
+struct io_uring;
 
 namespace pocolog_cpp
 {
+
+/**
+ * Read only view on a contiguous byte range of a file.
+ *
+ * The view does not own the memory it points to. See the methods
+ * returning it for the lifetime of the data.
+ * */
+struct FileView
+{
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    FileView() {}
+    FileView(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+    const uint8_t *begin() const
+    {
+        return data;
+    }
+
+    const uint8_t *end() const
+    {
+        return data + size;
+    }
+};
     
 /**
  * Reimplementation of the std::fstream class.
@@ -18,6 +47,11 @@ namespace pocolog_cpp
  * that seekp/seekg is called often. The std::fstream implementation
  * discards its buffer every time seek is called, resulting in a
  * horrible runtime performance in our usecase.
+ *
+ * Optionally, the whole file can be memory mapped on open. In this
+ * case reads are served directly from the mapping, and view() gives
+ * access to the file content without any copy. If the mapping fails,
+ * the stream falls back to the buffered read path.
  * */
 class FileStream
 {
@@ -30,6 +64,15 @@ private:
     off_t writePos;
     off_t fileSize;
     off_t blockSize;
+    size_t readAheadSize;
+    const uint8_t *mappedData;
+    size_t mappedSize;
+    /** Mappings replaced by refreshSize, kept until close so that
+     * the views into them stay valid */
+    std::vector<FileView> retiredMappings;
+    size_t batchQueueDepth;
+    io_uring *ring;
+    bool ringUnavailable;
     
     bool posInBuffer(off_t pos) const
     {
@@ -37,6 +80,11 @@ private:
     }
     
     bool reloadBuffer(off_t position);
+    bool readFromFile(char* buffer, off_t position, size_t size);
+    bool mapFile(size_t length);
+    void unmapFile();
+    bool setupRing();
+    void releaseRing();
     bool goodFlag;
     std::string fileName;
     
@@ -44,13 +92,72 @@ public:
     FileStream();
     
     FileStream(const char* __s,
-           std::ios_base::openmode mode);
+           std::ios_base::openmode mode, bool memoryMapped = false);
     ~FileStream();
     
-    bool open(const char* fileName, std::ios_base::openmode mode);
+    /**
+     * Opens the given file for reading.
+     * @param memoryMapped if true, the file is mapped into memory
+     *        instead of being read through the internal buffer
+     * */
+    bool open(const char* fileName, std::ios_base::openmode mode, bool memoryMapped = false);
     
     void read(char* buffer, size_t size);
     
+    /**
+     * Sets the size of the read ahead window. It is rounded up to a
+     * multiple of the file system block size. Reads that are bigger
+     * than the window bypass it and go directly into the caller's buffer.
+     *
+     * Use a big window (e.g. 4MB) for sequential scans and a single
+     * block (the default, given by 0) for random access.
+     * */
+    void setReadAheadSize(size_t size);
+    
+    /** Returns the size of the read ahead window in bytes */
+    size_t getReadAheadSize() const;
+    
+    /**
+     * Returns a view on the bytes [pos, pos + size) of the file.
+     *
+     * The view points directly into the memory mapping and stays valid
+     * until the stream is closed. An empty view is returned if the file
+     * is not memory mapped or the range is outside of the file.
+     * */
+    FileView view(off_t pos, size_t size) const;
+    
+    bool isMemoryMapped() const
+    {
+        return mappedData != nullptr;
+    }
+    
+    struct ReadRequest
+    {
+        off_t pos;
+        size_t size;
+        char *buffer;
+    };
+    
+    /**
+     * Performs all given reads, independently of the current read position.
+     *
+     * If the library was built with io_uring support, the reads are
+     * submitted asynchronously, with at most getBatchQueueDepth() reads
+     * in flight. Otherwise, reads of nearby ranges are merged into
+     * single preadv calls.
+     *
+     * @return false if one of the requests could not be read completely
+     * */
+    bool readBatch(std::vector<ReadRequest> &requests);
+    
+    /** Sets the maximum number of reads in flight in readBatch */
+    void setBatchQueueDepth(size_t depth);
+    
+    size_t getBatchQueueDepth() const
+    {
+        return batchQueueDepth;
+    }
+    
     std::streampos tellg();
     std::streampos tellp();
     
@@ -70,8 +177,30 @@ public:
 
     bool fail() const;
     off_t size() const;
+    
+    /**
+     * Updates size() for a file that is still being written. Until
+     * then, the stream treats the size at open() as the end of file.
+     *
+     * If the file is memory mapped, it gets mapped again once it
+     * outgrows the current mapping. Views returned so far stay valid.
+     *
+     * @return true if the file grew
+     * */
+    bool refreshSize();
     void close();
     
 };
+
+/**
+ * Creates a new, empty file next to \c fileName, whose name is unique
+ * among all processes and threads. Files that replace \c fileName are
+ * written there first and then renamed, so that concurrent writers of
+ * the same file never write into each other's temporary file.
+ *
+ * @return the name of the created file, or an empty string if it could
+ *         not be created
+ * */
+std::string createTemporaryFile(const std::string &fileName);
 }
 #endif // FILESTREAM_H
@@ -0,0 +1,60 @@
+#include "FileWatcher.hpp"
+#include <base-logging/Logging.hpp>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+
+namespace pocolog_cpp
+{
+
+/** Sleep interval used if inotify is not available */
+static const int POLL_INTERVAL_MS = 5;
+
+FileWatcher::FileWatcher(const std::string& fileName)
+{
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotifyFd < 0)
+    {
+        LOG_WARN_S << "FileWatcher: inotify is not available, polling " << fileName;
+        return;
+    }
+
+    if(::inotify_add_watch(inotifyFd, fileName.c_str(), IN_MODIFY) < 0)
+    {
+        LOG_WARN_S << "FileWatcher: Could not watch " << fileName << ", polling it instead";
+        ::close(inotifyFd);
+        inotifyFd = -1;
+    }
+}
+
+FileWatcher::~FileWatcher()
+{
+    if(inotifyFd >= 0)
+        ::close(inotifyFd);
+}
+
+void FileWatcher::wait(int timeoutMs)
+{
+    if(inotifyFd < 0)
+    {
+        int sleepMs = timeoutMs < 0 ? POLL_INTERVAL_MS : std::min(timeoutMs, POLL_INTERVAL_MS);
+        ::usleep(sleepMs * 1000);
+        return;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = inotifyFd;
+    pfd.events = POLLIN;
+    int ret = ::poll(&pfd, 1, timeoutMs);
+    if(ret <= 0)
+        return;
+
+    //drain the pending events, they all mean the same
+    char events[4096];
+    while(::read(inotifyFd, events, sizeof(events)) > 0)
+        ;
+}
+
+}
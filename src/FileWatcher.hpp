@@ -0,0 +1,39 @@
+#ifndef POCOLOG_CPP_FILEWATCHER_HPP
+#define POCOLOG_CPP_FILEWATCHER_HPP
+
+#include <string>
+
+namespace pocolog_cpp
+{
+
+/**
+ * Waits for modifications of a file that is still being written.
+ *
+ * The notifications come from inotify. If inotify is not available,
+ * wait() sleeps for a short poll interval instead.
+ * */
+class FileWatcher
+{
+public:
+    FileWatcher(const std::string &fileName);
+    ~FileWatcher();
+
+    /**
+     * Waits until the file was modified or the timeout expired.
+     *
+     * Modifications that happened since the last call, or since the
+     * construction of the watcher, make it return immediately. The
+     * caller has to check the file content anyway, as the wakeup does
+     * not tell what changed.
+     *
+     * @param timeoutMs timeout in milliseconds, negative to wait forever
+     * */
+    void wait(int timeoutMs);
+
+private:
+    int inotifyFd;
+};
+
+}
+
+#endif
@@ -92,9 +92,33 @@
  *  <tr><td>+20</td><td>4</td><td>logical time (sec)</td></tr>
  *  <tr><td>+24</td><td>4</td><td>logical time (usec)</td></tr>
  *  <tr><td>+32</td><td>4</td><td>data size</td></tr>
- *  <tr><td>+36</td><td>1</td><td>compression flag</td></tr>
+ *  <tr><td>+36</td><td>1</td><td>compression flag (SampleEncoding)</td></tr>
  *  <tr><td>+37</td><td>data_size</td><td>data</td></tr>
  * </table>
+ *
+ * The Ruby pocolog tools set the compression flag to 1 on samples whose data
+ * is a zlib stream, without recording the codec, and inflate the data of any
+ * sample whose flag is nonzero. pocolog_cpp writes zlib samples the same way,
+ * and reads the flagged samples of streams without codec as zlib ones. The
+ * samples of streams compressed with lz4 or zstd, and super-blocks and their
+ * dictionaries (flags 2 and 3) can not be read by these tools.
+ *
+ * The data of a sample block whose compression flag is SuperBlockSample is
+ * a super-block, which holds several consecutive samples of its stream.
+ * All little endian, see SuperBlock.
+ *
+ * <table>
+ *  <caption>Super-Block</caption>
+ *  <tr><td>Offset</td><td>Size</td><td>Field</td></tr>
+ *  <tr><td>+0 </td><td>4</td><td>number of samples</td></tr>
+ *  <tr><td>+4 </td><td>1</td><td>codec (CompressionCodec)</td></tr>
+ *  <tr><td>+5 </td><td>1</td><td>flags, which of table and body are compressed</td></tr>
+ *  <tr><td>+6 </td><td>4</td><td>stored size of the table</td></tr>
+ *  <tr><td>+10</td><td>8</td><td>distance back to the data of the dictionary block, 0 if none</td></tr>
+ *  <tr><td>+18</td><td>4</td><td>size of the dictionary</td></tr>
+ *  <tr><td>+22</td><td>table size</td><td>table, i.e. real time, logical time and data size of each sample (20 bytes each)</td></tr>
+ *  <tr><td></td><td></td><td>body, i.e. the data of all samples</td></tr>
+ * </table>
  */
 
 namespace pocolog_cpp
@@ -154,6 +178,14 @@ namespace pocolog_cpp
 	DataBlockType = 2,    /// a data block in an already declared stream
 	ControlBlockType = 3  /// a control block
     };
+    /** Values of the compression flag of a sample block */
+    enum SampleEncoding
+    {
+	RawSample = 0,
+	CompressedSample = 1,    /// compressed with the codec of the stream, zlib if it has none
+	SuperBlockSample = 2,    /// a super-block of several samples
+	SuperBlockDictionary = 3 /// the compression dictionary of the super-blocks of a stream
+    };
     enum StreamType 
     { 
 	UnknownStreamType = 0, 
@@ -6,29 +6,54 @@
 #include <unistd.h>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 
 namespace pocolog_cpp
 {
 
-Index::Index(std::string indexFileName, size_t streamIdx):  firstAdd(true), curSampleNr(-1), indexFile(indexFileName.c_str(), std::ifstream::binary | std::ifstream::in)
+Index::Index(FileStream &indexFile, size_t streamIdx):  firstAdd(true), mappedData(nullptr)
 {
     indexFile.seekg(streamIdx * sizeof(IndexPrologue) + sizeof(IndexFile::IndexFileHeader));
 
     indexFile.read((char *) & prologue, sizeof(IndexPrologue));
+    if(!indexFile.good())
+        throw std::runtime_error("Internal Error, index file is corrupted");
+
+    size_t dataSize = prologue.numSamples * sizeof(IndexInfo);
+    if(indexFile.isMemoryMapped())
+    {
+        //use the index data in place
+        FileView dataView = indexFile.view(prologue.dataPos, dataSize);
+        if(!dataView.data)
+            throw std::runtime_error("Internal Error, index file is corrupted");
+        mappedData = reinterpret_cast<const IndexInfo *>(dataView.data);
+    }
+    else
+    {
+        buildBuffer.resize(prologue.numSamples);
+        indexFile.seekg(prologue.dataPos);
+        indexFile.read((char *) buildBuffer.data(), dataSize);
+        if(!indexFile.good())
+            throw std::runtime_error("Internal Error, index file is corrupted");
+    }
 
     firstSampleTime = base::Time::fromMicroseconds(prologue.firstSampleTime);
     lastSampleTime = base::Time::fromMicroseconds(prologue.lastSampleTime);
+    firstAdd = prologue.numSamples == 0;
+}
+
+Index::Index(const pocolog_cpp::StreamDescription& desc, off_t posOfStreamDesc) : Index(desc.getIndex(), desc.getName(), posOfStreamDesc)
+{
 }
 
-Index::Index(const pocolog_cpp::StreamDescription& desc, off_t posOfStreamDesc) : firstAdd(true), curSampleNr(-1)
+Index::Index(size_t streamIdx, const std::string& name, off_t posOfStreamDesc) : name(name), firstAdd(true), mappedData(nullptr)
 {
-    prologue.streamIdx = desc.getIndex();
+    prologue.streamIdx = streamIdx;
     prologue.nameCrc = 0;
     prologue.numSamples = 0;
     prologue.streamDescPos = posOfStreamDesc;
     prologue.firstSampleTime = 0;
     prologue.lastSampleTime = 0;
-    name = desc.getName();
 }
 
 bool Index::matches(const StreamDescription& odesc) const
@@ -37,23 +62,56 @@ bool Index::matches(const StreamDescription& odesc) const
 }
 
 
-void Index::addSample(off_t filePosition, const base::Time& sampleTime)
+void Index::addSample(off_t filePosition, const base::Time& sampleTime, const base::Time& sampleLogicalTime, uint32_t sampleDataSize)
 {
+    //an index that is used in place gets copied on the first
+    //sample that is added to it, see LogFile::setFollow
+    if(mappedData)
+    {
+        buildBuffer.assign(mappedData, mappedData + prologue.numSamples);
+        mappedData = nullptr;
+    }
+
     if(firstAdd)
     {
         prologue.firstSampleTime = sampleTime.microseconds;
+        firstSampleTime = sampleTime;
         firstAdd = false;
     }
 
     IndexInfo info;
     info.samplePosInLogFile = filePosition;
     info.sampleTime = sampleTime.microseconds;
+    info.sampleLogicalTime = sampleLogicalTime.microseconds;
+    info.sampleDataSize = sampleDataSize;
     buildBuffer.push_back(info);
 
     prologue.lastSampleTime = sampleTime.microseconds;
+    lastSampleTime = sampleTime;
     prologue.numSamples++;
 }
 
+off_t Index::writePrologueToFile(std::fstream& indexFile, off_t prologPos, off_t indexDataPos,
+                                 size_t streamIdx, off_t posOfStreamDesc, size_t numSamples,
+                                 int64_t firstSampleTime, int64_t lastSampleTime)
+{
+    IndexPrologue prologue;
+    prologue.numSamples = numSamples;
+    prologue.streamIdx = streamIdx;
+    prologue.nameCrc = 0;
+    prologue.firstSampleTime = firstSampleTime;
+    prologue.lastSampleTime = lastSampleTime;
+    prologue.dataPos = indexDataPos;
+    prologue.streamDescPos = posOfStreamDesc;
+
+    indexFile.seekp(prologPos, std::fstream::beg);
+    indexFile.write((char *) &prologue, sizeof(IndexPrologue));
+    if(!indexFile.good())
+        throw std::runtime_error("Error writing index file");
+
+    return indexDataPos + numSamples * sizeof(IndexInfo);
+}
+
 off_t Index::getPrologueSize()
 {
     return sizeof(IndexPrologue);
@@ -87,45 +145,38 @@ off_t Index::writeIndexToFile(std::fstream& indexFile, off_t prologPos, off_t in
     return indexFile.tellp();
 }
 
-void Index::loadIndex(size_t sampleNr)
+size_t Index::findSampleAtOrAfter(const base::Time& time) const
 {
-    if(sampleNr >= prologue.numSamples)
-        throw std::runtime_error("Index::loadIndex : Error sample out of index requested");
-
-    if(sampleNr != curSampleNr)
-    {
-        std::streampos pos(prologue.dataPos + sampleNr * sizeof(IndexInfo));
-        LOG_DEBUG_S << "Seeking to " << pos << " start of index Data " << prologue.dataPos << " pos in data " << sampleNr * sizeof(IndexInfo);
-        indexFile.seekg(std::streampos(prologue.dataPos + sampleNr * sizeof(IndexInfo)));
-        if(!indexFile.good())
-            throw std::runtime_error("Internal Error, index file is corrupted");
-        indexFile.read((char *) &curIndexInfo, sizeof(IndexInfo));
-        if(!indexFile.good())
-            throw std::runtime_error("Internal Error, index file is corrupted");
-
-        curSampleNr = sampleNr;
-    }
+    const IndexInfo *begin = getIndexData();
+    const IndexInfo *end = begin + prologue.numSamples;
+    const IndexInfo *it = std::lower_bound(begin, end, time.microseconds,
+        [](const IndexInfo &info, int64_t time) { return info.sampleTime < time; });
+    return it - begin;
 }
 
-
-std::streampos Index::getSamplePos(size_t sampleNr)
+size_t Index::findSampleBefore(const base::Time& time) const
 {
-
-    loadIndex(sampleNr);
-
-    return std::streampos(curIndexInfo.samplePosInLogFile);
-
+    const IndexInfo *begin = getIndexData();
+    const IndexInfo *end = begin + prologue.numSamples;
+    const IndexInfo *it = std::upper_bound(begin, end, time.microseconds,
+        [](int64_t time, const IndexInfo &info) { return time < info.sampleTime; });
+    if(it == begin)
+        return prologue.numSamples;
+    return (it - begin) - 1;
 }
 
-base::Time Index::getSampleTime(size_t sampleNr)
+size_t Index::findFirstSampleAt(std::streampos pos) const
 {
-    loadIndex(sampleNr);
-
-    return base::Time::fromMicroseconds(curIndexInfo.sampleTime);
+    const IndexInfo *begin = getIndexData();
+    const IndexInfo *end = begin + prologue.numSamples;
+    const IndexInfo *it = std::lower_bound(begin, end, static_cast<int64_t>(pos),
+        [](const IndexInfo &info, int64_t pos) { return info.samplePosInLogFile < pos; });
+    if(it == end || it->samplePosInLogFile != pos)
+        return prologue.numSamples;
+    return it - begin;
 }
 
 Index::~Index()
 {
-    indexFile.close();
 }
 }
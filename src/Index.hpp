@@ -5,6 +5,7 @@
 #include <vector>
 #include <stdint.h>
 #include <fstream>
+#include <stdexcept>
 #include <base/Time.hpp>
 #include "StreamDescription.hpp"
 #include "FileStream.hpp"
@@ -14,11 +15,16 @@ namespace pocolog_cpp
 
 class Index
 {
+public:
     struct IndexInfo {
         int64_t samplePosInLogFile;
         int64_t sampleTime;
+        int64_t sampleLogicalTime;
+        uint32_t sampleDataSize;
     } __attribute__((packed));
 
+private:
+
     struct IndexPrologue {
         size_t numSamples;
         int16_t streamIdx;
@@ -29,12 +35,26 @@ class Index
         int64_t streamDescPos;
     } __attribute__ ((packed));
     
-    void loadIndex(size_t sampleNr);
+    const IndexInfo &getIndexInfo(size_t sampleNr) const
+    {
+        if(sampleNr >= prologue.numSamples)
+            throw std::runtime_error("Index::getIndexInfo : Error sample out of index requested");
+        return getIndexData()[sampleNr];
+    }
     
 public:
-    Index(std::string indexFileName, size_t streamIdx);
+    /**
+     * Loads the index of the given stream from an opened index file.
+     *
+     * If the index file is memory mapped, the index data is used in place,
+     * i.e. the Index must not outlive \c indexFile. Otherwise it is copied.
+     * */
+    Index(FileStream &indexFile, size_t streamIdx);
 
     Index(const StreamDescription &desc, off_t posOfStreamDesc);
+
+    /** Creates an empty index for the stream with the given index */
+    Index(size_t streamIdx, const std::string &name, off_t posOfStreamDesc);
     
     bool matches(const StreamDescription &desc) const;
     
@@ -46,15 +66,77 @@ public:
      * */
     off_t writeIndexToFile(std::fstream &indexFile, off_t prologPos, off_t indexDataPos);
     
+    /**
+     * Writes the prologue of an index whose \c numSamples entries are
+     * written to \c indexDataPos separately, see IndexFile::mergeJournal
+     * @return the offset from the start of the file, were the index Data ENDS + 1
+     * */
+    static off_t writePrologueToFile(std::fstream &indexFile, off_t prologPos, off_t indexDataPos,
+                                     size_t streamIdx, off_t posOfStreamDesc, size_t numSamples,
+                                     int64_t firstSampleTime, int64_t lastSampleTime);
+
     /**
      * Returns the size of the prologue written to the file
      * */
     static off_t getPrologueSize();
     
-    void addSample(off_t filePosition, const base::Time &sampleTime);
+    void addSample(off_t filePosition, const base::Time &sampleTime, const base::Time &sampleLogicalTime, uint32_t sampleDataSize);
     
-    std::streampos getSamplePos(size_t sampleNr);
-    base::Time getSampleTime(size_t sampleNr);
+    std::streampos getSamplePos(size_t sampleNr) const
+    {
+        return std::streampos(getIndexInfo(sampleNr).samplePosInLogFile);
+    }
+
+    base::Time getSampleTime(size_t sampleNr) const
+    {
+        return base::Time::fromMicroseconds(getIndexInfo(sampleNr).sampleTime);
+    }
+
+    base::Time getSampleLogicalTime(size_t sampleNr) const
+    {
+        return base::Time::fromMicroseconds(getIndexInfo(sampleNr).sampleLogicalTime);
+    }
+    
+    /** Returns the payload size of the given sample */
+    uint32_t getSampleSize(size_t sampleNr) const
+    {
+        return getIndexInfo(sampleNr).sampleDataSize;
+    }
+    
+    /**
+     * Returns the first sample whose time is equal to or after \c time,
+     * or getNumSamples() if there is none.
+     *
+     * This is a binary search, it relies on the sample times of the
+     * stream being monotonic.
+     * */
+    size_t findSampleAtOrAfter(const base::Time &time) const;
+
+    /**
+     * Returns the last sample whose time is equal to or before \c time,
+     * or getNumSamples() if all samples are after \c time.
+     *
+     * This is a binary search, it relies on the sample times of the
+     * stream being monotonic.
+     * */
+    size_t findSampleBefore(const base::Time &time) const;
+
+    /**
+     * Returns the first sample whose data is at \c pos, or getNumSamples()
+     * if there is none. The samples of a super-block share the position
+     * of its data, see SuperBlock.
+     *
+     * This is a binary search, it relies on the positions of the samples
+     * of the stream being monotonic, which they are in a log file.
+     * */
+    size_t findFirstSampleAt(std::streampos pos) const;
+
+    /** Returns the index entries of all samples, ordered by sample number.
+     * The array contains getNumSamples() entries. */
+    const IndexInfo *getIndexData() const
+    {
+        return mappedData ? mappedData : buildBuffer.data();
+    }
     
     const base::Time &getFirstSampleTime() const
     {
@@ -85,9 +167,7 @@ public:
 private:
     std::string name;
     bool firstAdd;
-    size_t curSampleNr;
-    IndexInfo curIndexInfo;
-    FileStream indexFile;
+    const IndexInfo *mappedData;
     std::vector<IndexInfo> buildBuffer;
     IndexPrologue prologue;
     base::Time firstSampleTime;
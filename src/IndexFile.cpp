@@ -8,27 +8,47 @@
 #include <cassert>
 #include <boost/lexical_cast.hpp>
 #include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include "BlockScanner.hpp"
 
 using namespace std;
 
 namespace pocolog_cpp
 {
 
-IndexFile::IndexFileHeader::IndexFileHeader() : numStreams(0)
+IndexFile::IndexFileHeader::IndexFileHeader() : numStreams(0), indexedPos(0), logFileSize(0)
 {
     memcpy(magic, getMagic().c_str(), sizeof(magic));
 }
 
 std::string IndexFile::IndexFileHeader::getMagic()
 {
-    return std::string("IndexV2");
+    return std::string("IndexV4");
+}
+
+std::string IndexFile::getJournalMagic()
+{
+    return std::string("IdxJrn1");
+}
+
+std::string IndexFile::getJournalFileName(const std::string& indexFileName)
+{
+    return indexFileName + ".journal";
 }
 
 
 IndexFile::IndexFile(std::string indexFileName, LogFile &logFile, bool verbose)
 {
     if(!loadIndexFile(indexFileName, logFile))
-        throw std::runtime_error("Error, index is corrupted");
+    {
+        if(!outdated)
+            throw std::runtime_error("Error, index is corrupted");
+
+        //upgrade the index in place
+        if(!createIndexFile(indexFileName, logFile) || !loadIndexFile(indexFileName, logFile))
+            throw std::runtime_error("Error, could not upgrade outdated index");
+    }
 }
 
 IndexFile::IndexFile(LogFile &logFile, bool verbose)
@@ -61,30 +81,62 @@ void IndexFile::remove() {
 bool IndexFile::loadIndexFile(std::string indexFileName, pocolog_cpp::LogFile& logFile)
 {
     LOG_DEBUG_S << "Loading Index File ";
-    std::ifstream indexFile(indexFileName.c_str(), std::fstream::in | std::fstream::binary );
-
-    if(!indexFile.good())
+    if(!indexFileStream.open(indexFileName.c_str(), std::fstream::in | std::fstream::binary, true))
         return false;
 
     IndexFileHeader header;
 
-    indexFile.read((char *) &header, sizeof(IndexFileHeader));
-    if(!indexFile.good())
+    indexFileStream.read((char *) &header, sizeof(IndexFileHeader));
+    if(!indexFileStream.good())
+    {
+        indexFileStream.close();
         return false;
+    }
+
+    std::string magic(header.magic, strnlen(header.magic, sizeof(header.magic)));
+    if(magic == "IndexV2" || magic == "IndexV3")
+    {
+        LOG_INFO_S << "Index file " << indexFileName << " uses the outdated format " << magic << ", it will be rebuilt";
+        outdated = true;
+        indexFileStream.close();
+        return false;
+    }
 
     if(header.magic != header.getMagic())
     {
         LOG_ERROR_S << "Magic is " << header.magic;;
         LOG_ERROR_S << "Magic should be " << header.getMagic();;
         LOG_ERROR_S << "Error, index magic does not match";
+        indexFileStream.close();
+        return false;
+    }
+
+    off_t logFileSize = logFile.getFileSize();
+    if(header.logFileSize > logFileSize)
+    {
+        LOG_INFO_S << "Log file " << logFile.getFileName() << " is smaller than when it was indexed, the index will be rebuilt";
+        outdated = true;
+        indexFileStream.close();
         return false;
     }
-    indexFile.close();
+
+    if(header.logFileSize < logFileSize)
+    {
+        LOG_INFO_S << "Log file " << logFile.getFileName() << " grew since it was indexed, indexing the new blocks";
+        indexFileStream.close();
+        if(!updateIndexFile(indexFileName, logFile))
+        {
+            outdated = true;
+            return false;
+        }
+        return loadIndexFile(indexFileName, logFile);
+    }
 
     indexFilePath = indexFileName;
+    indexedPos = header.indexedPos;
     for(uint32_t i = 0; i < header.numStreams; i++)
     {
-        Index *idx = new Index(indexFileName, i);
+        Index *idx = new Index(indexFileStream, i);
         //load streams
         indices.push_back(idx);
 
@@ -117,23 +169,51 @@ Index& IndexFile::getIndexForStream(const StreamDescription& desc)
     throw std::runtime_error("IndexFile does not contain valid index for Stream ");
 }
 
+Index& IndexFile::addStream(const StreamDescription& desc, off_t descPos)
+{
+    if(desc.getIndex() != indices.size())
+        throw std::runtime_error("IndexFile: Error, unexpected stream index of new stream " + desc.getName());
+
+    indices.push_back(new Index(desc, descPos));
+    streams.push_back(desc);
+    return *indices.back();
+}
+
 bool IndexFile::createIndexFile(std::string indexFileName, LogFile& logFile)
 {
-    LOG_DEBUG_S << "IndexFile: Creating Index File for logfile " << logFile.getFileName();
-    std::vector<char> writeBuffer;
-    writeBuffer.resize(8096 * 1024);
-    std::fstream indexFile;
-    indexFile.rdbuf()->pubsetbuf(writeBuffer.data(), writeBuffer.size());
+    //a log that is or was recorded with an index only needs to be scanned
+    //after the last checkpoint, which loadIndexFile does
+    if(mergeJournal(getJournalFileName(indexFileName), indexFileName, logFile.getFileSize()))
+        return true;
 
-    indexFile.open(indexFileName.c_str(), std::fstream::out | std::fstream::binary | std::fstream::trunc);
+    return createIndexFile(indexFileName, logFile, logFile.getIndexThreads());
+}
 
-    std::vector<Index> foundIndices;
-    std::vector<StreamDescription> foundStreams;
+void IndexFile::scanLogFile(LogFile& logFile, std::vector<Index>& foundIndices, off_t& indexedPos, size_t numThreads, off_t minRangeSize)
+{
+    if(numThreads >= 2 && scanBlocksParallel(logFile, foundIndices, indexedPos, numThreads, minRangeSize))
+        return;
 
+    scannedRanges = 1;
+    logFile.seekBlock(indexedPos);
+    scanBlocks(logFile, foundIndices, indexedPos);
+}
 
+void IndexFile::scanBlocks(LogFile& logFile, std::vector<Index>& foundIndices, off_t& indexedPos)
+{
+    off_t fileSize = logFile.getFileSize();
     while(logFile.readNextBlockHeader())
     {
         const BlockHeader &curBlockHeader(logFile.getCurBlockHeader());
+
+        //a block that is still being written is left for the next update of the index
+        off_t blockEndPos = logFile.getBlockHeaderPos() + std::streamoff(sizeof(BlockHeader) + curBlockHeader.data_size);
+        if(blockEndPos > fileSize)
+        {
+            LOG_WARN_S << "IndexFile: Warning, log file seems to be truncated";
+            break;
+        }
+
         switch(curBlockHeader.type)
         {
             case UnknownBlockType:
@@ -148,8 +228,6 @@ bool IndexFile::createIndexFile(std::string indexFileName, LogFile& logFile)
                     throw std::runtime_error("IndexFile: Error loading stream description");
                 }
 
-                foundStreams.push_back(newStream);
-
                 size_t index = newStream.getIndex();
                 if(index != foundIndices.size() )
                 {
@@ -174,14 +252,8 @@ bool IndexFile::createIndexFile(std::string indexFileName, LogFile& logFile)
                 if(idx >= foundIndices.size())
                     throw std::runtime_error("Error: Corrupt log file " + logFile.getFileName() + ", got sample for nonexisting stream " + boost::lexical_cast<std::string>(idx) );
 
-                if(logFile.checkSampleComplete())
-                {
-                    foundIndices[idx].addSample(logFile.getSamplePos(), logFile.getSampleTime());
-                }
-                else
-                {
-                    LOG_WARN_S << "IndexFile: Warning, ignoring truncated sample for stream " << foundIndices[idx].getName();
-                }
+                if(!logFile.addCurSamplesToIndex(foundIndices[idx]))
+                    throw std::runtime_error("IndexFile: Error building index, log file seems corrupted");
             }
                 break;
             case ControlBlockType:
@@ -189,36 +261,368 @@ bool IndexFile::createIndexFile(std::string indexFileName, LogFile& logFile)
 
         }
 
+        indexedPos = blockEndPos;
+    }
+}
+
+bool IndexFile::scanBlocksParallel(LogFile& logFile, std::vector<Index>& foundIndices, off_t& indexedPos, size_t numThreads, off_t minRangeSize)
+{
+    off_t startPos = indexedPos;
+    off_t fileSize = logFile.getFileSize();
+    minRangeSize = std::max<off_t>(minRangeSize, 1);
+    size_t numRanges = std::min<off_t>(numThreads, (fileSize - startPos) / minRangeSize);
+    if(numRanges < 2)
+        return false;
+
+    LOG_DEBUG_S << "IndexFile: Scanning " << logFile.getFileName() << " in " << numRanges << " parallel ranges";
+
+    off_t rangeSize = (fileSize - startPos) / numRanges;
+    std::vector<off_t> rangeEnd(numRanges);
+    for(size_t i = 0; i < numRanges; i++)
+        rangeEnd[i] = startPos + rangeSize * (i + 1);
+    rangeEnd.back() = fileSize;
+
+    //each range but the first one has to find the beginning of a block first
+    std::vector<BlockScanner::Result> results(numRanges);
+    std::vector<std::thread> workers;
+    for(size_t i = 0; i < numRanges; i++)
+    {
+        workers.emplace_back([&, i]() {
+            try
+            {
+                BlockScanner scanner(logFile.getFileName(), fileSize);
+                off_t start = i ? rangeEnd[i - 1] : startPos;
+                if(i)
+                    start = scanner.synchronize(start, rangeEnd[i]);
+                if(start >= 0)
+                    scanner.scan(results[i], start, rangeEnd[i]);
+            }
+            catch(std::exception &e)
+            {
+                results[i].error = true;
+            }
+        });
+    }
+    for(std::thread &worker : workers)
+        worker.join();
+
+    //check the ranges in file order. A range is only used if it starts exactly
+    //where the previous one ended, otherwise its synchronization point was wrong
+    //and it gets rescanned from the right position. Nothing is added to
+    //foundIndices before all ranges were checked, so that the sequential
+    //scan can take over from the same state.
+    BlockScanner scanner(logFile.getFileName(), fileSize);
+    std::vector<StreamDescription> newStreams;
+    std::vector<off_t> descriptionPos;
+    for(const Index &index : foundIndices)
+        descriptionPos.push_back(index.getDescriptionPos());
+
+    off_t pos = startPos;
+    for(size_t i = 0; i < numRanges; i++)
+    {
+        BlockScanner::Result &result(results[i]);
+
+        //the range lies within a block of the previous range
+        if(pos >= rangeEnd[i])
+        {
+            result = BlockScanner::Result();
+            continue;
+        }
+
+        if(result.syncPos != pos)
+        {
+            LOG_DEBUG_S << "IndexFile: Rescanning range " << i << " from " << pos;
+            result = BlockScanner::Result();
+            scanner.scan(result, pos, rangeEnd[i]);
+        }
+
+        //anything unusual is left to the sequential indexer, so
+        //that it gets reported the same way
+        if(result.error)
+            return false;
+
+        for(off_t descPos : result.streamDeclarations)
+        {
+            StreamDescription newStream;
+            if(!logFile.loadStreamDescription(newStream, descPos))
+                return false;
+            if(newStream.getIndex() != descriptionPos.size())
+                return false;
+
+            newStreams.push_back(newStream);
+            descriptionPos.push_back(descPos);
+        }
+
+        for(size_t idx = 0; idx < result.samples.size(); idx++)
+        {
+            if(result.firstSamplePos[idx] < 0)
+                continue;
+            if(idx >= descriptionPos.size() || descriptionPos[idx] > result.firstSamplePos[idx])
+                return false;
+        }
+
+        pos = result.endPos;
     }
-    LOG_DEBUG_S << "IndexFile: Found " << foundStreams.size() << " datastreams " << std::flush;
+
+    for(const StreamDescription &newStream : newStreams)
+        foundIndices.emplace_back(newStream, descriptionPos[newStream.getIndex()]);
+
+    for(const BlockScanner::Result &result : results)
+    {
+        for(size_t idx = 0; idx < result.samples.size(); idx++)
+        {
+            for(const Index::IndexInfo &info : result.samples[idx])
+            {
+                foundIndices[idx].addSample(info.samplePosInLogFile, base::Time::fromMicroseconds(info.sampleTime),
+                                            base::Time::fromMicroseconds(info.sampleLogicalTime), info.sampleDataSize);
+            }
+        }
+    }
+
+    indexedPos = pos;
+    scannedRanges = numRanges;
+    return true;
+}
+
+bool IndexFile::createIndexFile(std::string indexFileName, LogFile& logFile, size_t numThreads, off_t minRangeSize)
+{
+    LOG_DEBUG_S << "IndexFile: Creating Index File for logfile " << logFile.getFileName();
+
+    std::vector<Index> foundIndices;
+    off_t indexedPos = logFile.getFirstBlockHeaderPos();
+    scanLogFile(logFile, foundIndices, indexedPos, numThreads, minRangeSize);
+
+    writeIndexFile(indexFileName, foundIndices, indexedPos, logFile.getFileSize());
+    return true;
+}
+
+bool IndexFile::updateIndexFile(std::string indexFileName, LogFile& logFile)
+{
+    //the index file is not memory mapped, so that the indices own
+    //their data and the new samples can be appended
+    FileStream oldIndexFile;
+    if(!oldIndexFile.open(indexFileName.c_str(), std::fstream::in | std::fstream::binary))
+        return false;
 
     IndexFileHeader header;
-    header.numStreams = foundStreams.size();
+    oldIndexFile.read((char *) &header, sizeof(IndexFileHeader));
+    if(!oldIndexFile.good() || header.magic != header.getMagic())
+        return false;
+
+    std::vector<Index> foundIndices;
+    foundIndices.reserve(header.numStreams);
+    for(uint32_t i = 0; i < header.numStreams; i++)
+        foundIndices.emplace_back(oldIndexFile, i);
+    oldIndexFile.close();
 
-    assert(header.magic == header.getMagic());
+    LOG_DEBUG_S << "IndexFile: Updating Index File for logfile " << logFile.getFileName() << " from position " << header.indexedPos;
 
-    indexFile.write((char *) &header, sizeof(header));
-    if(!indexFile.good())
-        throw std::runtime_error("IndexFile: Error writing index header");
+    off_t indexedPos = header.indexedPos;
+    scanLogFile(logFile, foundIndices, indexedPos, logFile.getIndexThreads(), 64 * 1024 * 1024);
 
-    off_t curProloguePos = sizeof(IndexFileHeader);
-    off_t curDataPos = foundIndices.size() * Index::getPrologueSize() + sizeof(IndexFileHeader);
-    for ( auto curIdx : foundIndices )
+    writeIndexFile(indexFileName, foundIndices, indexedPos, logFile.getFileSize());
+    return true;
+}
+
+void IndexFile::writeIndexFile(std::string indexFileName, std::vector<Index>& foundIndices, off_t indexedPos, off_t logFileSize)
+{
+    //the index is written to a temporary file that replaces the old one
+    //at the end, so that mappings of the old index stay valid. Its name is
+    //unique, as a recorder and the tools reading its log may write the
+    //index at the same time
+    std::string tmpFileName(createTemporaryFile(indexFileName));
+    if(tmpFileName.empty())
+        throw std::runtime_error("IndexFile: Error creating a temporary file for " + indexFileName);
+
+    try
     {
-        LOG_INFO_S << "Writing index for stream " << curIdx.getName() << " , num samples " << curIdx.getNumSamples();
+        std::vector<char> writeBuffer;
+        writeBuffer.resize(8096 * 1024);
+        std::fstream indexFile;
+        indexFile.rdbuf()->pubsetbuf(writeBuffer.data(), writeBuffer.size());
+
+        indexFile.open(tmpFileName.c_str(), std::fstream::out | std::fstream::binary | std::fstream::trunc);
+        if(!indexFile.is_open())
+            throw std::runtime_error("IndexFile: Error opening " + tmpFileName);
 
-        //Write index prologue
-        curDataPos = curIdx.writeIndexToFile(indexFile, curProloguePos, curDataPos);
-        curProloguePos += Index::getPrologueSize();
+        LOG_DEBUG_S << "IndexFile: Found " << foundIndices.size() << " datastreams " << std::flush;
 
+        IndexFileHeader header;
+        header.numStreams = foundIndices.size();
+        header.indexedPos = indexedPos;
+        header.logFileSize = logFileSize;
+
+        assert(header.magic == header.getMagic());
+
+        indexFile.write((char *) &header, sizeof(header));
         if(!indexFile.good())
+            throw std::runtime_error("IndexFile: Error writing index header");
+
+        off_t curProloguePos = sizeof(IndexFileHeader);
+        off_t curDataPos = foundIndices.size() * Index::getPrologueSize() + sizeof(IndexFileHeader);
+        for ( auto &curIdx : foundIndices )
+        {
+            LOG_INFO_S << "Writing index for stream " << curIdx.getName() << " , num samples " << curIdx.getNumSamples();
+
+            //Write index prologue
+            curDataPos = curIdx.writeIndexToFile(indexFile, curProloguePos, curDataPos);
+            curProloguePos += Index::getPrologueSize();
+
+            if(!indexFile.good())
+                throw std::runtime_error("IndexFile: Error writing index File");
+
+        }
+
+        indexFile.close();
+        if(indexFile.fail())
             throw std::runtime_error("IndexFile: Error writing index File");
+        filesystem::rename(tmpFileName, indexFileName);
+    }
+    catch(...)
+    {
+        std::error_code error;
+        filesystem::remove(tmpFileName, error);
+        throw;
+    }
+    LOG_DEBUG_S << "done ";
+}
+
+bool IndexFile::mergeJournal(const std::string& journalFileName, const std::string& indexFileName, off_t logFileSize)
+{
+    FileStream journal;
+    if(!journal.open(journalFileName.c_str(), std::fstream::in | std::fstream::binary))
+        return false;
+    journal.setReadAheadSize(1024 * 1024);
+
+    char magic[8];
+    journal.read(magic, sizeof(magic));
+    if(!journal.good() || std::string(magic, strnlen(magic, sizeof(magic))) != getJournalMagic())
+        return false;
 
+    //first pass, the streams and their samples as of the last checkpoint
+    struct JournalStream
+    {
+        off_t descPos;
+        size_t numSamples;
+        int64_t firstSampleTime;
+        int64_t lastSampleTime;
+    };
+    std::vector<JournalStream> journalStreams;
+    std::vector<JournalStream> checkpointStreams;
+    off_t checkpointPos = -1;
+    size_t numEntries = 0;
+    size_t checkpointEntries = 0;
+
+    JournalEntry entry;
+    while(true)
+    {
+        //the last entry is incomplete if the recording crashed
+        journal.read((char *) &entry, sizeof(JournalEntry));
+        if(!journal.good())
+            break;
+        numEntries++;
+
+        switch(entry.type)
+        {
+            case JournalEntry::StreamEntry:
+                if(entry.streamIdx != journalStreams.size())
+                    return false;
+                journalStreams.push_back(JournalStream{entry.info.samplePosInLogFile, 0, 0, 0});
+                break;
+            case JournalEntry::SampleEntry:
+            {
+                if(entry.streamIdx >= journalStreams.size())
+                    return false;
+                JournalStream &stream(journalStreams[entry.streamIdx]);
+                if(!stream.numSamples)
+                    stream.firstSampleTime = entry.info.sampleTime;
+                stream.lastSampleTime = entry.info.sampleTime;
+                stream.numSamples++;
+                break;
+            }
+            case JournalEntry::CheckpointEntry:
+                checkpointPos = entry.info.samplePosInLogFile;
+                checkpointStreams = journalStreams;
+                checkpointEntries = numEntries;
+                break;
+            default:
+                return false;
+        }
     }
 
-    indexFile.close();
-    LOG_DEBUG_S << "done ";
+    if(checkpointPos < 0 || checkpointPos > logFileSize)
+        return false;
+
+    LOG_DEBUG_S << "IndexFile: Merging journal " << journalFileName << " up to position " << checkpointPos;
+
+    std::string tmpFileName(createTemporaryFile(indexFileName));
+    if(tmpFileName.empty())
+        throw std::runtime_error("IndexFile: Error creating a temporary file for " + indexFileName);
+
+    try
+    {
+        std::fstream indexFile;
+        indexFile.open(tmpFileName.c_str(), std::fstream::out | std::fstream::binary | std::fstream::trunc);
+        if(!indexFile.is_open())
+            throw std::runtime_error("IndexFile: Error opening " + tmpFileName);
+
+        IndexFileHeader header;
+        header.numStreams = checkpointStreams.size();
+        header.indexedPos = checkpointPos;
+        header.logFileSize = checkpointPos;
+        indexFile.write((char *) &header, sizeof(header));
+        if(!indexFile.good())
+            throw std::runtime_error("IndexFile: Error writing index header");
+
+        std::vector<off_t> dataPos;
+        off_t curDataPos = checkpointStreams.size() * Index::getPrologueSize() + sizeof(IndexFileHeader);
+        for(size_t i = 0; i < checkpointStreams.size(); i++)
+        {
+            const JournalStream &stream(checkpointStreams[i]);
+            dataPos.push_back(curDataPos);
+            curDataPos = Index::writePrologueToFile(indexFile, sizeof(IndexFileHeader) + i * Index::getPrologueSize(), curDataPos,
+                                                    i, stream.descPos, stream.numSamples, stream.firstSampleTime, stream.lastSampleTime);
+        }
+
+        //second pass, the entries are collected in chunks per stream
+        const size_t chunkSize = 1024;
+        std::vector<std::vector<Index::IndexInfo> > chunks(checkpointStreams.size());
+        auto writeChunk = [&](size_t idx) {
+            indexFile.seekp(dataPos[idx], std::fstream::beg);
+            indexFile.write((char *) chunks[idx].data(), chunks[idx].size() * sizeof(Index::IndexInfo));
+            if(!indexFile.good())
+                throw std::runtime_error("IndexFile: Error writing index File");
+            dataPos[idx] += chunks[idx].size() * sizeof(Index::IndexInfo);
+            chunks[idx].clear();
+        };
+
+        journal.seekg(sizeof(magic));
+        for(size_t i = 0; i < checkpointEntries; i++)
+        {
+            journal.read((char *) &entry, sizeof(JournalEntry));
+            if(!journal.good())
+                throw std::runtime_error("IndexFile: Error reading journal " + journalFileName);
+            if(entry.type != JournalEntry::SampleEntry)
+                continue;
+
+            chunks[entry.streamIdx].push_back(entry.info);
+            if(chunks[entry.streamIdx].size() == chunkSize)
+                writeChunk(entry.streamIdx);
+        }
+        for(size_t i = 0; i < chunks.size(); i++)
+            writeChunk(i);
 
+        indexFile.close();
+        if(indexFile.fail())
+            throw std::runtime_error("IndexFile: Error writing index File");
+        filesystem::rename(tmpFileName, indexFileName);
+    }
+    catch(...)
+    {
+        std::error_code error;
+        filesystem::remove(tmpFileName, error);
+        throw;
+    }
     return true;
 }
 
@@ -6,6 +6,7 @@
 #include <filesystem>
 
 #include "LogFile.hpp"
+#include "Index.hpp"
 
 namespace pocolog_cpp
 {
@@ -17,6 +18,26 @@ class IndexFile
     std::vector<Index *> indices;
     std::vector<StreamDescription> streams;
     std::filesystem::path indexFilePath;
+    /** Position of the first block of the log file that is not indexed */
+    off_t indexedPos = 0;
+    /** The index file, memory mapped and shared by all indices */
+    FileStream indexFileStream;
+    /** Set by loadIndexFile if the index file has to be rebuilt, i.e.
+     * if it has an older format or does not match the log file anymore */
+    bool outdated = false;
+    /** Number of ranges scanned in parallel by the last scan, 1 if it
+     * was sequential */
+    size_t scannedRanges = 0;
+
+    /**
+     * Adds the blocks starting at \c indexedPos to \c foundIndices, and
+     * sets \c indexedPos to the end of the last complete block.
+     * */
+    void scanLogFile(LogFile& logFile, std::vector<Index> &foundIndices, off_t &indexedPos,
+                     size_t numThreads, off_t minRangeSize);
+    void scanBlocks(LogFile& logFile, std::vector<Index> &foundIndices, off_t &indexedPos);
+    bool scanBlocksParallel(LogFile& logFile, std::vector<Index> &foundIndices, off_t &indexedPos,
+                            size_t numThreads, off_t minRangeSize);
 
 public:
     struct IndexFileHeader
@@ -24,9 +45,51 @@ public:
         IndexFileHeader();
         char magic[8];
         uint32_t numStreams;
+        /** Position of the first block of the log file that is not indexed */
+        int64_t indexedPos;
+        /** Size of the log file when the index was written */
+        int64_t logFileSize;
         static std::string getMagic();
     } __attribute__((packed));
 
+    /**
+     * An entry of the journal that IndexWriter appends to while a log is
+     * being recorded. The journal starts with getJournalMagic(), followed
+     * by the entries in the order in which the blocks were written.
+     * */
+    struct JournalEntry
+    {
+        enum Type
+        {
+            StreamEntry = 1,
+            SampleEntry = 2,
+            /** All blocks before info.samplePosInLogFile are on disk */
+            CheckpointEntry = 3
+        };
+        uint32_t type;
+        uint32_t streamIdx;
+        /** The sample. For stream entries, samplePosInLogFile is the
+         * position of the stream declaration */
+        Index::IndexInfo info;
+    } __attribute__((packed));
+
+    static std::string getJournalMagic();
+
+    /** The journal that IndexWriter writes next to \c indexFileName */
+    static std::string getJournalFileName(const std::string &indexFileName);
+
+    /**
+     * Writes the index file from the journal of a recording. It covers the
+     * log up to the last checkpoint of the journal, the rest is left to
+     * updateIndexFile. The journal is read twice instead of being loaded,
+     * so that the memory used does not depend on its size.
+     *
+     * @param logFileSize the current size of the log, journals whose last
+     *        checkpoint is after it do not belong to the log
+     * @return false if there is no valid journal with a checkpoint
+     * */
+    static bool mergeJournal(const std::string &journalFileName, const std::string &indexFileName, off_t logFileSize);
+
     IndexFile(std::string indexFileName, pocolog_cpp::LogFile& logFile, bool verbose = true);
 
     IndexFile(LogFile& logFile, bool verbose = true);
@@ -38,8 +101,57 @@ public:
     bool loadIndexFile(std::string indexFileName, LogFile& logFile);
     bool createIndexFile(std::string indexFileName, LogFile& logFile);
 
+    /**
+     * Adds the blocks that were appended to the log file since the index
+     * file was written, without scanning the already indexed part again.
+     *
+     * @return false if the index file could not be read
+     * */
+    bool updateIndexFile(std::string indexFileName, LogFile& logFile);
+
+    /**
+     * Creates the index, splitting the log file into up to \c numThreads
+     * byte ranges of at least \c minRangeSize bytes that are scanned in
+     * parallel. The result is the same as with the sequential scan, which
+     * is used for small files, for numThreads < 2, and as fallback if the
+     * log file contains anything unusual.
+     * */
+    bool createIndexFile(std::string indexFileName, LogFile& logFile, size_t numThreads, off_t minRangeSize = 64 * 1024 * 1024);
+
+    /**
+     * Number of byte ranges that the last createIndexFile or
+     * updateIndexFile scanned in parallel, 1 if it fell back to the
+     * sequential scan
+     * */
+    size_t getScannedRanges() const
+    {
+        return scannedRanges;
+    }
+
+    /**
+     * Writes the given indices into an index file that covers the log file
+     * up to \c indexedPos. The file is replaced atomically, so that readers
+     * see either the old or the new index. Several processes may write the
+     * same index file at once, the last one wins.
+     * */
+    static void writeIndexFile(std::string indexFileName, std::vector<Index> &foundIndices, off_t indexedPos, off_t logFileSize);
+
     Index &getIndexForStream(const StreamDescription &desc);
 
+    /**
+     * Adds an empty index for a stream that was declared after the index
+     * file got written, see LogFile::setFollow. The index file on disk
+     * is not changed.
+     * */
+    Index &addStream(const StreamDescription &desc, off_t descPos);
+
+    /** Returns the position of the first block of the log file that is
+     * not covered by the index */
+    off_t getIndexedPos() const
+    {
+        return indexedPos;
+    }
+
     const std::vector< StreamDescription >& getStreamDescriptions() const;
 };
 }
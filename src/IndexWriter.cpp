@@ -0,0 +1,85 @@
+#include "IndexWriter.hpp"
+#include "IndexFile.hpp"
+#include <stdexcept>
+#include <filesystem>
+#include <boost/lexical_cast.hpp>
+
+namespace pocolog_cpp
+{
+
+IndexWriter::IndexWriter(const std::string& indexFileName, off_t checkpointSize)
+    : indexFileName(indexFileName)
+    , journalFileName(IndexFile::getJournalFileName(indexFileName))
+    , journalBuffer(64 * 1024)
+    , numStreams(0)
+    , checkpointSize(checkpointSize)
+    , lastCheckpointPos(0)
+{
+    //the index of an older log with the same name must not be used
+    std::error_code error;
+    std::filesystem::remove(indexFileName, error);
+
+    journal.rdbuf()->pubsetbuf(journalBuffer.data(), journalBuffer.size());
+    journal.open(journalFileName.c_str(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+    if(!journal.is_open())
+        throw std::runtime_error("IndexWriter: Error creating the journal " + journalFileName);
+
+    char magic[8] = { 0 };
+    IndexFile::getJournalMagic().copy(magic, sizeof(magic) - 1);
+    journal.write(magic, sizeof(magic));
+}
+
+void IndexWriter::append(uint32_t type, size_t streamIdx, const Index::IndexInfo& info)
+{
+    IndexFile::JournalEntry entry;
+    entry.type = type;
+    entry.streamIdx = streamIdx;
+    entry.info = info;
+    journal.write((const char *) &entry, sizeof(entry));
+}
+
+void IndexWriter::addStream(size_t streamIdx, const std::string& name, off_t descPos)
+{
+    //the index file stores the streams by index
+    if(streamIdx != numStreams)
+        throw std::runtime_error("IndexWriter: Error, stream " + name + " is declared out of order");
+
+    Index::IndexInfo info = { descPos, 0, 0, 0 };
+    append(IndexFile::JournalEntry::StreamEntry, streamIdx, info);
+    numStreams++;
+}
+
+void IndexWriter::addSample(size_t streamIdx, off_t samplePos, const base::Time& time,
+                            const base::Time& logicalTime, uint32_t dataSize)
+{
+    if(streamIdx >= numStreams)
+        throw std::runtime_error("IndexWriter: Error, got sample for nonexisting stream " + boost::lexical_cast<std::string>(streamIdx));
+
+    Index::IndexInfo info = { samplePos, time.microseconds, logicalTime.microseconds, dataSize };
+    append(IndexFile::JournalEntry::SampleEntry, streamIdx, info);
+}
+
+void IndexWriter::checkpoint(off_t logFileSize)
+{
+    Index::IndexInfo info = { logFileSize, 0, 0, 0 };
+    append(IndexFile::JournalEntry::CheckpointEntry, 0, info);
+    journal.flush();
+    if(!journal.good())
+        throw std::runtime_error("IndexWriter: Error writing the journal " + journalFileName);
+    lastCheckpointPos = logFileSize;
+}
+
+void IndexWriter::write()
+{
+    if(!IndexFile::mergeJournal(journalFileName, indexFileName, lastCheckpointPos))
+        throw std::runtime_error("IndexWriter: Error reading the journal " + journalFileName);
+}
+
+void IndexWriter::removeJournal()
+{
+    journal.close();
+    std::error_code error;
+    std::filesystem::remove(journalFileName, error);
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef POCOLOG_CPP_INDEXWRITER_HPP
+#define POCOLOG_CPP_INDEXWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sys/types.h>
+#include <base/Time.hpp>
+#include "Index.hpp"
+
+namespace pocolog_cpp
+{
+
+/**
+ * Builds the index of a log file while it is being recorded, see
+ * Output::setIndexFile. The result is the same index file that
+ * IndexFile creates by scanning the log.
+ *
+ * The index entries are not kept in memory, but appended to a journal
+ * next to the index file, see IndexFile::JournalEntry. Checkpoints in the
+ * journal mark the log as complete up to its size at that time. The index
+ * file is written from the journal by write(), and by IndexFile if the
+ * log is opened while it is recorded or after the recording crashed, in
+ * which case only the blocks after the last checkpoint are scanned.
+ * */
+class IndexWriter
+{
+    std::string indexFileName;
+    std::string journalFileName;
+    std::vector<char> journalBuffer;
+    std::ofstream journal;
+    size_t numStreams;
+    off_t checkpointSize;
+    off_t lastCheckpointPos;
+
+    void append(uint32_t type, size_t streamIdx, const Index::IndexInfo &info);
+
+public:
+    /**
+     * Removes the index file of an older log and starts the journal
+     *
+     * @param indexFileName the index file, i.e. the log file name with the
+     *        .log extension replaced by .id2
+     * @param checkpointSize number of log bytes between checkpoints
+     * */
+    IndexWriter(const std::string &indexFileName, off_t checkpointSize);
+
+    /** Adds a stream declared at \c descPos. Streams have to be added in
+     * the order of their indices */
+    void addStream(size_t streamIdx, const std::string &name, off_t descPos);
+
+    /** Adds a sample whose payload starts at \c samplePos */
+    void addSample(size_t streamIdx, off_t samplePos, const base::Time &time,
+                   const base::Time &logicalTime, uint32_t dataSize);
+
+    /** Returns true if a checkpoint should be written for a log of the
+     * given size */
+    bool needsCheckpoint(off_t logFileSize) const
+    {
+        return logFileSize - lastCheckpointPos >= checkpointSize;
+    }
+
+    /**
+     * Marks the log as complete up to \c logFileSize in the journal. All
+     * blocks before it have to be on disk.
+     * */
+    void checkpoint(off_t logFileSize);
+
+    /**
+     * Writes the index file from the journal, covering the log up to the
+     * last checkpoint. This reads the whole journal.
+     * */
+    void write();
+
+    /** Removes the journal, once the recording is done and the index file
+     * is written */
+    void removeJournal();
+};
+
+}
+
+#endif
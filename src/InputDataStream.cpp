@@ -1,6 +1,6 @@
 #include "InputDataStream.hpp"
+#include "RegistryCache.hpp"
 #include <base-logging/Logging.hpp>
-#include <typelib/pluginmanager.hh>
 #include <typelib/registry.hh>
 
 namespace pocolog_cpp
@@ -16,28 +16,23 @@ namespace pocolog_cpp
 // 
 // }
 
-InputDataStream::InputDataStream(const StreamDescription& desc, Index& index): Stream(desc, index)
+InputDataStream::InputDataStream(const StreamDescription& desc, Index& index, bool memoryMapped): Stream(desc, index, memoryMapped)
 {
     loadTypeLib();
 }
 
 InputDataStream::~InputDataStream()
 {
-    delete m_registry;
 }
 
 
 void InputDataStream::loadTypeLib()
 {
-    utilmm::config_set empty;
-    m_registry = new Typelib::Registry;
-    
-    std::istringstream stream(desc.getTypeDescription());
-
     // Load the data_types registry from pocosim
-    Typelib::PluginManager::load("tlb", stream, empty, *m_registry);
+    m_registry = RegistryCache::get(desc.getTypeDescription());
     
-    m_type = m_registry->build(desc.getTypeName());
+    m_type = RegistryCache::build(m_registry, desc.getTypeName());
+    m_plan = MarshallingPlan(*m_type);
 }
 
 std::string InputDataStream::getMetadataEntry(const std::string& entry) const
@@ -64,8 +59,8 @@ const Typelib::Type* InputDataStream::getType() const
 
 Typelib::Value InputDataStream::getTyplibValue(void *memoryOfType, size_t memorySize, size_t sampleNr)
 {
-    std::vector<uint8_t> buffer;
-    if(!getSampleData(buffer, sampleNr))
+    FileView buffer;
+    if(!getSampleView(buffer, sampleNr))
         throw std::runtime_error("Error, sample for stream " + desc.getName() + " could not be loaded");
 
     if(memorySize < m_type->getSize())
@@ -73,11 +68,10 @@ Typelib::Value InputDataStream::getTyplibValue(void *memoryOfType, size_t memory
         throw std::runtime_error("Error, given memory area is to small for type " + m_type->getName() + " at stream " + desc.getName());
     }
 
-    Typelib::Value v(memoryOfType, *m_type);
     //init memory area
-    Typelib::init(v);
-    Typelib::load(v, buffer);
-    return v;
+    m_plan.init(static_cast<uint8_t *>(memoryOfType));
+    m_plan.load(static_cast<uint8_t *>(memoryOfType), buffer.data, buffer.size);
+    return Typelib::Value(memoryOfType, *m_type);
 }
 
 const std::string InputDataStream::getCXXType() const
@@ -2,7 +2,12 @@
 #define INPUTDATASTREAM_H
 
 #include "Stream.hpp"
+#include "MarshallingPlan.hpp"
 #include <string>
+#include <memory>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
 #include <typelib/value_ops.hh>
 
 namespace Typelib
@@ -19,13 +24,14 @@ class InputDataStream : public Stream
     
 protected:
     const Typelib::Type*       m_type;
-    Typelib::Registry*   m_registry;
+    std::shared_ptr<const Typelib::Registry> m_registry;
+    MarshallingPlan m_plan;
 
     void loadTypeLib();
     std::string getMetadataEntry(const std::string& entry) const;
     
 public:
-    InputDataStream(const StreamDescription &desc, Index &index);
+    InputDataStream(const StreamDescription &desc, Index &index, bool memoryMapped = false);
     virtual ~InputDataStream();
 
     Typelib::Type const* getType() const;
@@ -33,30 +39,94 @@ public:
     const std::string getCXXType() const;
     const std::string getTaskModel() const;
      
+    /** Returns the decoder used for the samples of the stream */
+    const MarshallingPlan &getMarshallingPlan() const
+    {
+        return m_plan;
+    }
+
     size_t getTypeMemorySize() const
     {
         return m_type->getSize();
     }
     
-    Typelib::Registry &getStreamRegistry()
+    /**
+     * Returns the registry of the stream. It is shared with all streams
+     * with the same type description, see RegistryCache.
+     * */
+    const Typelib::Registry &getStreamRegistry() const
     {
         return *m_registry;
     }
+
+    std::shared_ptr<const Typelib::Registry> getSharedStreamRegistry() const
+    {
+        return m_registry;
+    }
     
     template<typename T>
     bool getSample(T& out, size_t sampleNr)
     {
-        std::vector<uint8_t> buffer;
-        if(!getSampleData(buffer, sampleNr))
+        //the view reuses the buffer of the stream if the file is not mapped
+        FileView view;
+        if(!Stream::getSampleView(view, sampleNr))
             return false;
         
-//         Typelib::Value v(&out, sizeof(T), *m_type);
-        Typelib::Value v(&out, *m_type);
-        Typelib::load(v, buffer);
+        m_plan.load(reinterpret_cast<uint8_t *>(&out), view.data, view.size);
         return true;
     }
     
     Typelib::Value getTyplibValue(void *memoryOfType, size_t memorySize, size_t sampleNr);
+
+    /**
+     * Returns true if the marshalled samples of the stream have the
+     * in-memory layout of the type, so that getSampleView can be used
+     * */
+    bool hasPlainLayout() const
+    {
+        return m_plan.isFlat();
+    }
+
+    /** The untyped access to the stored samples, see Stream */
+    using Stream::getSampleView;
+
+    /**
+     * Gives typed access to a sample without decoding or copying it.
+     *
+     * Only available for streams with hasPlainLayout(). As for
+     * OwnedValue::get, the size of T has to match the size of the type.
+     * The pointer is into the memory mapping of the log file and stays
+     * valid as long as the stream exists. If the file is not mapped, or
+     * the sample is not aligned for T, the sample is read into a buffer
+     * of the stream and the pointer is only valid until the next call.
+     *
+     * @return the sample, or nullptr if it could not be read
+     * */
+    template<typename T>
+    const T *getSampleView(size_t sampleNr)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "getSampleView needs a trivially copyable type");
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "getSampleView does not support over-aligned types");
+
+        if(!hasPlainLayout())
+            throw std::runtime_error("Error, stream " + desc.getName() + " has no plain layout, use getSample");
+        if(sizeof(T) != m_type->getSize())
+            throw std::logic_error("in-process and typelib sizes differ");
+
+        FileView view;
+        if(!Stream::getSampleView(view, sampleNr))
+            return nullptr;
+        if(view.size != sizeof(T))
+            throw std::runtime_error("Error, sample of stream " + desc.getName() + " does not match its type");
+
+        if(reinterpret_cast<uintptr_t>(view.data) % alignof(T))
+        {
+            viewBuffer.resize(sizeof(T));
+            memcpy(viewBuffer.data(), view.data, sizeof(T));
+            return reinterpret_cast<const T *>(viewBuffer.data());
+        }
+        return reinterpret_cast<const T *>(view.data);
+    }
 };
 
 }
@@ -4,6 +4,9 @@
 #include "IndexFile.hpp"
 #include <base-logging/Logging.hpp>
 #include <iostream>
+#include <cstring>
+#include <thread>
+#include <algorithm>
 
 using namespace std;
 
@@ -11,9 +14,11 @@ namespace pocolog_cpp
 {
 
 
-LogFile::LogFile(const std::string& fileName, bool verbose) : filename(fileName)
+LogFile::LogFile(const std::string& fileName, bool verbose, bool memoryMapped, size_t indexThreads)
+    : filename(fileName), memoryMapped(memoryMapped)
+    , indexThreads(indexThreads ? indexThreads : std::max(1u, std::thread::hardware_concurrency()))
 {
-    logFile.open(fileName.c_str(), std::ifstream::binary | std::ifstream::in);
+    logFile.open(fileName.c_str(), std::ifstream::binary | std::ifstream::in, memoryMapped);
     if (!logFile.good()){
         std::cerr << "\ncould not load " << fileName.c_str() << std::endl;
         perror("stat");
@@ -24,6 +29,7 @@ LogFile::LogFile(const std::string& fileName, bool verbose) : filename(fileName)
     rewind();
     IndexFile *indexFile = new IndexFile(*this);
     indexFiles.push_back(indexFile);
+    indexedPos = indexFile->getIndexedPos();
 
     // rewind again since IndexFile might have read data to build the index
     rewind();
@@ -51,7 +57,7 @@ std::vector<Stream*> LogFile::createStreamsFromDescriptions(
                     LOG_DEBUG_S << "Creating InputDataStream " << d.getName();
                     try
                     {
-                        streams.push_back(new InputDataStream(d, indexFile->getIndexForStream(d)));
+                        streams.push_back(new InputDataStream(d, indexFile->getIndexForStream(d), memoryMapped));
                     }
                     catch(...)
                     {
@@ -69,6 +75,8 @@ std::vector<Stream*> LogFile::createStreamsFromDescriptions(
 
 LogFile::~LogFile()
 {
+    prefetcher.reset();
+
     for (size_t i = 0; i < streams.size(); i++) {
         delete streams[i];
     }
@@ -96,6 +104,127 @@ void LogFile::rewind() {
     nextBlockHeaderPos = firstBlockHeaderPos;
     gotBlockHeader = false;
     gotSampleHeader = false;
+    superBlockSample = 0;
+    prefetcher.reset();
+}
+
+void LogFile::seekBlock(std::streampos blockHeaderPos)
+{
+    nextBlockHeaderPos = blockHeaderPos;
+    gotBlockHeader = false;
+    gotSampleHeader = false;
+    superBlockSample = 0;
+}
+
+void LogFile::setPrefetchDepth(size_t numBlocks)
+{
+    prefetchDepth = numBlocks;
+    prefetcher.reset();
+}
+
+void LogFile::setFollow(bool enable, const base::Time& timeout)
+{
+    following = enable;
+    followTimeout = timeout;
+    if(!following)
+        watcher.reset();
+    else if(!watcher)
+        watcher.reset(new FileWatcher(filename));
+}
+
+bool LogFile::isNextBlockComplete()
+{
+    off_t blockPos = nextBlockHeaderPos;
+    if(blockPos + static_cast<off_t>(sizeof(BlockHeader)) > logFile.size())
+        return false;
+
+    BlockHeader header;
+    logFile.seekg(nextBlockHeaderPos);
+    logFile.read(reinterpret_cast<char *>(&header), sizeof(BlockHeader));
+    return logFile.good() && blockPos + static_cast<off_t>(sizeof(BlockHeader) + header.data_size) <= logFile.size();
+}
+
+bool LogFile::waitForNextBlock()
+{
+    base::Time deadline = base::Time::now() + followTimeout;
+    while(!isNextBlockComplete())
+    {
+        if(logFile.refreshSize())
+            continue;
+
+        int timeoutMs = -1;
+        if(!followTimeout.isNull())
+        {
+            base::Time remaining = deadline - base::Time::now();
+            if(remaining <= base::Time())
+                return false;
+            timeoutMs = (remaining.toMicroseconds() + 999) / 1000;
+        }
+        watcher->wait(timeoutMs);
+    }
+    return true;
+}
+
+void LogFile::indexCurBlock()
+{
+    //the blocks before indexedPos are already in the indices
+    if(curBlockHeaderPos < indexedPos)
+        return;
+    indexedPos = nextBlockHeaderPos;
+
+    IndexFile &indexFile(*indexFiles.front());
+    switch(curBlockHeader.type)
+    {
+        case StreamBlockType:
+        {
+            std::streampos descPos(curBlockHeaderPos);
+            StreamDescription newStream;
+            if(!loadStreamDescription(newStream, descPos))
+                throw std::runtime_error("LogFile: Error loading stream description of followed log file");
+
+            indexFile.addStream(newStream, descPos);
+            descriptions.push_back(newStream);
+            for(Stream *stream : createStreamsFromDescriptions({newStream}, &indexFile))
+                streams.push_back(stream);
+            break;
+        }
+        case DataBlockType:
+        {
+            if(!readSampleHeader())
+                throw std::runtime_error("LogFile: Error reading sample header of followed log file");
+
+            Index &index(indexFile.getIndexForStream(descriptions.at(curBlockHeader.stream_idx)));
+            if(!addCurSamplesToIndex(index))
+                throw std::runtime_error("LogFile: Error reading super-block of followed log file");
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+bool LogFile::readNextPrefetchedBlock()
+{
+    //restart the prefetcher if the read position got changed
+    //by other means than readNextSample
+    if(!prefetcher || prefetcher->getNextBlockPos() != nextBlockHeaderPos)
+    {
+        prefetcher.reset();
+        prefetcher.reset(new BlockPrefetcher(filename, nextBlockHeaderPos, prefetchDepth));
+    }
+
+    if(!prefetcher->next(prefetchedBlock))
+        return false;
+
+    curBlockHeader = prefetchedBlock.header;
+    curBlockHeaderPos = prefetchedBlock.headerPos;
+    nextBlockHeaderPos = prefetcher->getNextBlockPos();
+    curSampleHeaderPos = curBlockHeaderPos;
+    curSampleHeaderPos += sizeof(BlockHeader);
+    gotBlockHeader = true;
+    gotSampleHeader = false;
+    superBlockSample = 0;
+    return true;
 }
 
 
@@ -159,6 +288,11 @@ std::string LogFile::getFileBaseName() const
     return baseName;
 }
 
+off_t LogFile::getFileSize() const
+{
+    return logFile.size();
+}
+
 bool LogFile::readNextBlockHeader(BlockHeader& curBlockHeade)
 {
     bool ret = readNextBlockHeader();
@@ -190,6 +324,7 @@ bool LogFile::readNextBlockHeader()
 
     gotBlockHeader = true;
     gotSampleHeader = false;
+    superBlockSample = 0;
 
     return true;
 }
@@ -199,6 +334,15 @@ const BlockHeader& LogFile::getCurBlockHeader() const
     return curBlockHeader;
 }
 
+const SampleHeaderData& LogFile::getCurSampleHeader() const
+{
+    if(!gotSampleHeader)
+    {
+        throw std::runtime_error("Internal Error: Called getCurSampleHeader without reading Sample header first");
+    }
+    return curSampleHeader;
+}
+
 bool LogFile::readCurBlock(std::vector< uint8_t >& blockData)
 {
     blockData.resize(curBlockHeader.data_size);
@@ -237,6 +381,27 @@ bool LogFile::checkSampleComplete()
     return (logFile.size() >= nextBlockHeaderPos);
 }
 
+bool LogFile::addCurSamplesToIndex(Index& index)
+{
+    switch(getCurSampleHeader().compressed)
+    {
+        case SuperBlockDictionary:
+            return true;
+        case SuperBlockSample:
+        {
+            SuperBlock::Header header;
+            if(!SuperBlock::readEntries(logFile, getSamplePos(), curSampleHeader.data_size, header, superBlockEntries))
+                return false;
+            for(const SuperBlock::Entry &entry : superBlockEntries)
+                index.addSample(getSamplePos(), entry.getRealtime(), entry.getTimestamp(), entry.data_size);
+            return true;
+        }
+        default:
+            index.addSample(getSamplePos(), getSampleTime(), getSampleLogicalTime(), curSampleHeader.data_size);
+            return true;
+    }
+}
+
 std::streampos LogFile::getSamplePos() const
 {
     if(!gotBlockHeader)
@@ -266,6 +431,11 @@ std::streampos LogFile::getBlockHeaderPos() const
     return curBlockHeaderPos;
 }
 
+std::streampos LogFile::getFirstBlockHeaderPos() const
+{
+    return firstBlockHeaderPos;
+}
+
 size_t LogFile::getSampleStreamIdx() const
 {
     if(!gotBlockHeader)
@@ -284,7 +454,16 @@ const base::Time LogFile::getSampleTime() const
     return base::Time::fromSeconds(curSampleHeader.realtime_tv_sec, curSampleHeader.realtime_tv_usec);
 }
 
-bool LogFile::getSampleData(std::vector<uint8_t>& buffer)
+const base::Time LogFile::getSampleLogicalTime() const
+{
+    if(!gotSampleHeader)
+    {
+        throw std::runtime_error("Internal Error: Called getSampleLogicalTime without reading Sample header first");
+    }
+    return base::Time::fromSeconds(curSampleHeader.timestamp_tv_sec, curSampleHeader.timestamp_tv_usec);
+}
+
+bool LogFile::readRawSampleData(std::vector<uint8_t>& buffer)
 {
     if(!gotSampleHeader)
     {
@@ -298,33 +477,223 @@ bool LogFile::getSampleData(std::vector<uint8_t>& buffer)
     return logFile.good();
 }
 
+void LogFile::decodeSamplePayload(FileView& payload)
+{
+    if (curSampleHeader.compressed != CompressedSample) {
+        return;
+    }
+
+    CompressionCodec codec = getStreamDescriptions()[getSampleStreamIdx()].getCompression();
+    Compression::decompress(codec, payload.data, payload.size, decodeBuffer);
+    payload = FileView(decodeBuffer.data(), decodeBuffer.size());
+}
+
+void LogFile::checkSingleSampleBlock() const
+{
+    // the block API reaches super-blocks as a whole, only
+    // readNextSamplePayload splits them into samples
+    if (!superBlockSample && curSampleHeader.compressed >= SuperBlockSample) {
+        throw std::logic_error("LogFile: the current block is a super-block or its dictionary, "
+                               "its samples have to be read with readNextSample");
+    }
+}
+
+bool LogFile::getSampleData(std::vector<uint8_t>& buffer)
+{
+    checkSingleSampleBlock();
+    if (superBlockSample) {
+        FileView payload = superBlock.getSample(superBlockSample - 1);
+        buffer.assign(payload.begin(), payload.end());
+        return true;
+    }
+
+    if (!readRawSampleData(buffer)) {
+        return false;
+    }
+    if (curSampleHeader.compressed == CompressedSample) {
+        FileView payload(buffer.data(), curSampleHeader.data_size);
+        decodeSamplePayload(payload);
+        buffer.swap(decodeBuffer);
+    }
+    return true;
+}
+
+bool LogFile::getSampleView(FileView& view)
+{
+    if(!gotSampleHeader)
+    {
+        throw std::runtime_error("Internal Error: Called getSampleView without reading Sample header first");
+    }
+
+    checkSingleSampleBlock();
+    if (superBlockSample) {
+        view = superBlock.getSample(superBlockSample - 1);
+        return true;
+    }
+
+    view = logFile.view(getSamplePos(), curSampleHeader.data_size);
+    if (!view.data) {
+        return false;
+    }
+    decodeSamplePayload(view);
+    return true;
+}
+
 OwnedValue LogFile::getSample() {
     std::vector<uint8_t> buffer;
     return getSample(buffer);
 }
 
 OwnedValue LogFile::getSample(std::vector<uint8_t>& buffer) {
-    if (!getSampleData(buffer)) {
-        throw std::logic_error("reading sample data failed");
+    MarshallingPlan const& plan = getStreamDescriptions()[getSampleStreamIdx()].getMarshallingPlan();
+    OwnedValue sample(plan);
+
+    FileView view;
+    if (getSampleView(view)) {
+        sample.load(view.data, view.size, plan);
+        return sample;
     }
 
-    Typelib::Type const& type = getStreamDescriptions()[getSampleStreamIdx()].getTypelibType();
-    OwnedValue sample(type);
-    sample.load(buffer);
+    if (!readRawSampleData(buffer)) {
+        throw std::logic_error("reading sample data failed");
+    }
+    view = FileView(buffer.data(), curSampleHeader.data_size);
+    decodeSamplePayload(view);
+    sample.load(view.data, view.size, plan);
     return sample;
 }
 
-optional<LogFile::Sample> LogFile::readNextSample() {
-    while (readNextBlockHeader()) {
+bool LogFile::decodeBlockPayload(FileView& payload) {
+    switch (curSampleHeader.compressed) {
+        case SuperBlockDictionary:
+            return false;
+        case SuperBlockSample:
+            superBlock.decode(logFile, getSamplePos(), payload.data, payload.size);
+            if (!superBlock.getNumSamples()) {
+                return false;
+            }
+            nextSuperBlockSample(payload);
+            return true;
+        default:
+            decodeSamplePayload(payload);
+            return true;
+    }
+}
+
+void LogFile::nextSuperBlockSample(FileView& payload) {
+    const SuperBlock::Entry& entry = superBlock.getEntry(superBlockSample);
+    curSampleHeader.realtime_tv_sec = entry.realtime_tv_sec;
+    curSampleHeader.realtime_tv_usec = entry.realtime_tv_usec;
+    curSampleHeader.timestamp_tv_sec = entry.timestamp_tv_sec;
+    curSampleHeader.timestamp_tv_usec = entry.timestamp_tv_usec;
+    curSampleHeader.data_size = entry.data_size;
+    curSampleHeader.compressed = RawSample;
+    payload = superBlock.getSample(superBlockSample);
+    superBlockSample++;
+}
+
+bool LogFile::readNextSamplePayload(FileView& payload) {
+    // the remaining samples of the current super-block come first
+    if (superBlockSample && superBlockSample < superBlock.getNumSamples()) {
+        nextSuperBlockSample(payload);
+        return true;
+    }
+
+    if (prefetchDepth && !following) {
+        while (readNextPrefetchedBlock()) {
+            if (curBlockHeader.type != DataBlockType) {
+                continue;
+            }
+            if (prefetchedBlock.data.size() < sizeof(SampleHeaderData)) {
+                throw std::logic_error("reading sample data failed");
+            }
+
+            memcpy(&curSampleHeader, prefetchedBlock.data.data(), sizeof(SampleHeaderData));
+            gotSampleHeader = true;
+            if (prefetchedBlock.data.size() < sizeof(SampleHeaderData) + curSampleHeader.data_size) {
+                throw std::logic_error("reading sample data failed");
+            }
+            // keep the file position consistent with the non-prefetched path
+            logFile.seekg(getSamplePos());
+
+            payload = FileView(prefetchedBlock.data.data() + sizeof(SampleHeaderData), curSampleHeader.data_size);
+            if (decodeBlockPayload(payload)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    while ((!following || waitForNextBlock()) && readNextBlockHeader()) {
+        if (following) {
+            indexCurBlock();
+        }
         if (curBlockHeader.type == DataBlockType) {
-            uint16_t stream_idx = curBlockHeader.stream_idx;
             readSampleHeader();
-            return optional<Sample>(
-                make_tuple(stream_idx, getSampleTime(), getSample())
-            );
+            payload = logFile.view(getSamplePos(), curSampleHeader.data_size);
+            if (!payload.data) {
+                if (!readRawSampleData(sampleBuffer)) {
+                    throw std::logic_error("reading sample data failed");
+                }
+                payload = FileView(sampleBuffer.data(), curSampleHeader.data_size);
+            }
+            if (decodeBlockPayload(payload)) {
+                return true;
+            }
         }
     }
-    return optional<Sample>();
+    return false;
+}
+
+optional<LogFile::Sample> LogFile::readNextSample() {
+    FileView payload;
+    if (!readNextSamplePayload(payload)) {
+        return optional<Sample>();
+    }
+
+    uint16_t stream_idx = curBlockHeader.stream_idx;
+    MarshallingPlan const& plan = getStreamDescriptions()[stream_idx].getMarshallingPlan();
+    OwnedValue sample(plan);
+    sample.load(payload.data, payload.size, plan);
+    return optional<Sample>(
+        make_tuple(stream_idx, getSampleTime(), std::move(sample))
+    );
+}
+
+bool LogFile::readNextSample(SampleRef& sample) {
+    FileView payload;
+    if (!readNextSamplePayload(payload)) {
+        return false;
+    }
+
+    uint16_t stream_idx = curBlockHeader.stream_idx;
+    MarshallingPlan const& plan = getStreamDescriptions()[stream_idx].getMarshallingPlan();
+    if (sampleSlots.size() <= stream_idx) {
+        sampleSlots.resize(stream_idx + 1);
+    }
+    if (!sampleSlots[stream_idx]) {
+        sampleSlots[stream_idx].reset(new OwnedValue(plan));
+    }
+    sampleSlots[stream_idx]->load(payload.data, payload.size, plan);
+
+    sample.streamIdx = stream_idx;
+    sample.time = getSampleTime();
+    sample.value = sampleSlots[stream_idx].get();
+    return true;
+}
+
+bool LogFile::readNextSample(ValueArena& arena, ArenaSample& sample) {
+    FileView payload;
+    if (!readNextSamplePayload(payload)) {
+        return false;
+    }
+
+    sample.streamIdx = curBlockHeader.stream_idx;
+    sample.time = getSampleTime();
+    sample.value = arena.load(
+        getStreamDescriptions()[sample.streamIdx].getMarshallingPlan(), payload.data, payload.size
+    );
+    return true;
 }
 
 bool LogFile::eof() const
@@ -332,6 +701,11 @@ bool LogFile::eof() const
     return logFile.eof();
 }
 
+void LogFile::setReadAheadSize(size_t size)
+{
+    logFile.setReadAheadSize(size);
+}
+
 
 
 }
@@ -3,10 +3,15 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <memory>
 #include "Stream.hpp"
 #include "Format.hpp"
 #include "FileStream.hpp"
 #include "OwnedValue.hpp"
+#include "SuperBlock.hpp"
+#include "ValueArena.hpp"
+#include "BlockPrefetcher.hpp"
+#include "FileWatcher.hpp"
 
 namespace pocolog_cpp
 {
@@ -16,6 +21,8 @@ class IndexFile;
 class LogFile
 {
     std::string filename;
+    bool memoryMapped;
+    size_t indexThreads;
     std::streampos firstBlockHeaderPos;
     std::streampos nextBlockHeaderPos;
     std::streampos curBlockHeaderPos;
@@ -30,6 +37,54 @@ class LogFile
     struct BlockHeader curBlockHeader;
     bool gotSampleHeader = false;
     struct SampleHeaderData curSampleHeader;
+
+    size_t prefetchDepth = 0;
+    std::unique_ptr<BlockPrefetcher> prefetcher;
+    BlockPrefetcher::Block prefetchedBlock;
+    bool readNextPrefetchedBlock();
+
+    /** Payload buffer and decoded values of readNextSample, reused across calls */
+    std::vector<uint8_t> sampleBuffer;
+    std::vector<std::unique_ptr<OwnedValue> > sampleSlots;
+    /** Advances to the next data block and returns the payload of its sample */
+    bool readNextSamplePayload(FileView &payload);
+
+    /** Payload of the current sample if it is compressed, see decodeSamplePayload */
+    std::vector<uint8_t> decodeBuffer;
+    /** Replaces the stored payload of the current sample by the
+     * decompressed one if the sample is compressed */
+    void decodeSamplePayload(FileView &payload);
+    /** Reads the stored payload of the current sample */
+    bool readRawSampleData(std::vector<uint8_t> &buffer);
+
+    /** The super-block of the current sample, see SuperBlock */
+    SuperBlockReader superBlock;
+    /** Number of samples of the current super-block that readNextSample
+     * returned, 0 if the current sample is not in a super-block */
+    size_t superBlockSample = 0;
+    std::vector<SuperBlock::Entry> superBlockEntries;
+    /**
+     * Turns the stored payload of the current data block into the payload
+     * of the next sample, by decompressing it or decoding the super-block.
+     *
+     * @return false for blocks without samples, i.e. dictionaries
+     * */
+    bool decodeBlockPayload(FileView &payload);
+    /** Makes the next sample of the current super-block the current sample */
+    void nextSuperBlockSample(FileView &payload);
+    /** Throws if the current block is a super-block or a dictionary that
+     * was not split into samples by readNextSamplePayload */
+    void checkSingleSampleBlock() const;
+
+    bool following = false;
+    base::Time followTimeout;
+    std::unique_ptr<FileWatcher> watcher;
+    /** Position of the first block that is not covered by the indices */
+    std::streampos indexedPos;
+    bool isNextBlockComplete();
+    bool waitForNextBlock();
+    void indexCurBlock();
+
     void readPrologue();
 
     std::vector<Stream*> createStreamsFromDescriptions(
@@ -37,47 +92,164 @@ class LogFile
     );
 
 public:
-    LogFile(const std::string &fileName, bool verbose = true);
+    /**
+     * @param memoryMapped if true, the log file is memory mapped, and
+     *        sample payloads are handed out without copying them
+     * @param indexThreads number of threads that scan the log file when its
+     *        index has to be built or updated, 0 for one per core
+     * */
+    LogFile(const std::string &fileName, bool verbose = true, bool memoryMapped = false, size_t indexThreads = 0);
     ~LogFile();
 
     /** Move the read pointer at the beginning of the file, ready to read blocks */
     void rewind();
 
+    /** Move the read pointer to the block header at the given position */
+    void seekBlock(std::streampos blockHeaderPos);
+
     /** Remove all built indexes from disk */
     void removeAllIndexes();
 
     std::string getFileName() const;
     std::string getFileBaseName() const;
 
+    /** Returns the size of the log file at the time it was opened */
+    off_t getFileSize() const;
+
+    /** Returns the number of threads that scan the log file for its index */
+    size_t getIndexThreads() const
+    {
+        return indexThreads;
+    }
+
     const std::vector<Stream *> &getStreams() const;
     const std::vector<StreamDescription> &getStreamDescriptions() const;
 
     bool loadStreamDescription(StreamDescription &result, std::streampos descPos);
 
     const BlockHeader &getCurBlockHeader() const;
+    const SampleHeaderData &getCurSampleHeader() const;
 
     bool readNextBlockHeader(struct BlockHeader &curBlockHeade);
     bool readNextBlockHeader();
     bool readSampleHeader();
     bool checkSampleComplete();
 
+    /**
+     * Adds the sample of the current data block to \c index, or all its
+     * samples if the block is a super-block, see SuperBlock. Dictionary
+     * blocks have no samples. The sample header has to be read already.
+     *
+     * @return false if the sample table of the super-block could not be read
+     * */
+    bool addCurSamplesToIndex(Index &index);
+
     bool readCurBlock(std::vector<uint8_t> &blockData);
 
     std::streampos getSamplePos() const;
     std::streampos getBlockDataPos() const;
     std::streampos getBlockHeaderPos() const;
+    std::streampos getFirstBlockHeaderPos() const;
     const base::Time getSampleTime() const;
+    const base::Time getSampleLogicalTime() const;
     size_t getSampleStreamIdx() const;
+    /**
+     * Reads the payload of the current sample into \c buffer, decompressed
+     * if needed. The buffer is only grown, the payload size is the data
+     * size of the sample header for uncompressed samples, and the size of
+     * the buffer for compressed ones and samples of super-blocks.
+     *
+     * A super-block or dictionary block reached with readNextBlockHeader
+     * is not a sample, this and the other sample accessors throw
+     * std::logic_error on it. Its samples are read with readNextSample.
+     * */
     bool getSampleData(std::vector<uint8_t>& buffer);
 
+    /**
+     * Returns a view on the payload of the current sample. This is only
+     * possible if the log file is memory mapped, in which case the view stays
+     * valid as long as the LogFile exists. The view on a compressed sample
+     * or on a sample of a super-block is only valid until the next sample
+     * is read.
+     *
+     * @return false if the file is not memory mapped or the sample is truncated
+     * */
+    bool getSampleView(FileView& view);
+
+    /** Decodes the current sample, throws on super-blocks like getSampleData */
     OwnedValue getSample();
     OwnedValue getSample(std::vector<uint8_t>& buffer);
 
     using Sample = std::tuple<uint16_t, base::Time, OwnedValue>;
     std::optional<Sample> readNextSample();
 
+    /** A sample returned by readNextSample(SampleRef&) */
+    struct SampleRef
+    {
+        uint16_t streamIdx;
+        base::Time time;
+        /** Owned by the LogFile, valid until the next sample of the same stream is read */
+        OwnedValue const *value;
+    };
+
+    /**
+     * Allocation free variant of readNextSample(). The sample is decoded
+     * into a value kept per stream by the LogFile, and the payload is read
+     * into a buffer kept across calls if the file is not memory mapped.
+     * Once each stream has been read once, sequential replay does not
+     * allocate anymore. Prefetching and follow mode allocate while their
+     * buffers and the index grow.
+     *
+     * @return false if there are no more samples
+     * */
+    bool readNextSample(SampleRef &sample);
+
+    /** A sample returned by readNextSample(ValueArena&, ArenaSample&) */
+    struct ArenaSample
+    {
+        uint16_t streamIdx;
+        base::Time time;
+        /** Allocated in the arena, valid until the arena is reset */
+        Typelib::Value value;
+    };
+
+    /**
+     * Variant of readNextSample() for batch processing, which decodes the
+     * sample into the given arena. The arena has to be reset before the
+     * LogFile is destroyed.
+     *
+     * @return false if there are no more samples
+     * */
+    bool readNextSample(ValueArena &arena, ArenaSample &sample);
+
+    /**
+     * Lets readNextSample() read blocks in a background thread, so that
+     * I/O overlaps with the decoding of the samples.
+     *
+     * @param numBlocks how many blocks may be read ahead of the consumer.
+     *        0 disables prefetching.
+     * */
+    void setPrefetchDepth(size_t numBlocks);
+
+    /**
+     * Lets readNextSample() wait for blocks that get appended to the log
+     * file while it is being written, like tail -f. The new samples and
+     * streams are added to the indices, so that they are available
+     * through getStreams() as well.
+     *
+     * Prefetching is not used while following.
+     *
+     * @param timeout how long readNextSample() waits for a new sample
+     *        before it returns an empty result. A null time waits forever.
+     * */
+    void setFollow(bool enable, const base::Time &timeout = base::Time());
+
     bool eof() const;
 
+    /** Sets the read ahead window used for sequential reads,
+     * see FileStream::setReadAheadSize */
+    void setReadAheadSize(size_t size);
+
     Stream &getStream(const std::string streamName) const;
 
 };
@@ -0,0 +1,76 @@
+#include "MarshallingPlan.hpp"
+#include <typelib/value_ops.hh>
+#include <base-logging/Logging.hpp>
+#include <cstring>
+#include <iterator>
+
+namespace pocolog_cpp
+{
+
+MarshallingPlan::MarshallingPlan() : type(nullptr), hasLayout(false), flat(false), size(0)
+{
+}
+
+MarshallingPlan::MarshallingPlan(const Typelib::Type& type)
+    : type(&type)
+    , hasLayout(false)
+    , flat(false)
+    , size(type.getSize())
+{
+    try
+    {
+        layout = Typelib::layout_of(type);
+        hasLayout = true;
+    }
+    catch(std::exception &e)
+    {
+        LOG_DEBUG_S << "No memory layout for type " << type.getName() << ": " << e.what();
+        return;
+    }
+
+    //a flat type is a single memcpy of the whole value
+    Typelib::MemoryLayout::const_iterator it = layout.begin();
+    flat = std::distance(it, layout.end()) == 2
+        && *it == Typelib::MemLayout::FLAG_MEMCPY
+        && *(it + 1) == size;
+}
+
+void MarshallingPlan::init(uint8_t* data) const
+{
+    //only containers need to be constructed
+    if(flat)
+        return;
+
+    if(hasLayout)
+        Typelib::init(data, layout);
+    else
+        Typelib::init(Typelib::Value(data, *type));
+}
+
+void MarshallingPlan::destroy(uint8_t* data) const
+{
+    if(flat)
+        return;
+
+    if(hasLayout)
+        Typelib::destroy(data, layout);
+    else
+        Typelib::destroy(Typelib::Value(data, *type));
+}
+
+void MarshallingPlan::load(uint8_t* data, const uint8_t* buffer, size_t bufferSize) const
+{
+    if(flat && bufferSize == size)
+    {
+        memcpy(data, buffer, size);
+        return;
+    }
+
+    //typelib reports the size mismatch of a flat type
+    if(hasLayout)
+        Typelib::load(data, *type, buffer, bufferSize, layout);
+    else
+        Typelib::load(Typelib::Value(data, *type), buffer, bufferSize);
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef POCOLOG_CPP_MARSHALLINGPLAN_HPP
+#define POCOLOG_CPP_MARSHALLINGPLAN_HPP
+
+#include <vector>
+#include <stdint.h>
+#include <typelib/memory_layout.hh>
+
+namespace Typelib
+{
+    class Type;
+}
+
+namespace pocolog_cpp
+{
+
+/**
+ * Decodes marshalled samples of one type.
+ *
+ * Typelib::init and Typelib::load compute the memory layout of the type
+ * on every call. The plan computes it once: types without containers are
+ * decoded with a single memcpy, all other types use the precomputed
+ * layout. Types for which typelib can not compute a layout, e.g. opaques,
+ * are passed to the generic Typelib functions, which report the error.
+ * */
+class MarshallingPlan
+{
+    const Typelib::Type *type;
+    Typelib::MemoryLayout layout;
+    bool hasLayout;
+    bool flat;
+    size_t size;
+
+public:
+    MarshallingPlan();
+    explicit MarshallingPlan(const Typelib::Type &type);
+
+    const Typelib::Type &getType() const
+    {
+        return *type;
+    }
+
+    /** Returns true if the marshalled and the in-memory representation are the same */
+    bool isFlat() const
+    {
+        return flat;
+    }
+
+    /** Initializes the memory of a value of the type, see Typelib::init */
+    void init(uint8_t *data) const;
+
+    /** Destroys a value initialized with init, see Typelib::destroy */
+    void destroy(uint8_t *data) const;
+
+    /**
+     * Unmarshals a sample into an initialized value of the type, see
+     * Typelib::load. Throws if the buffer does not match the type.
+     * */
+    void load(uint8_t *data, const uint8_t *buffer, size_t bufferSize) const;
+
+    void load(uint8_t *data, const std::vector<uint8_t> &buffer) const
+    {
+        load(data, buffer.data(), buffer.size());
+    }
+};
+
+}
+
+#endif
@@ -1,20 +1,34 @@
 #include "MultiFileIndex.hpp"
 #include "Index.hpp"
 #include "IndexFile.hpp"
+#include "StreamMerger.hpp"
 #include <base-logging/Logging.hpp>
 #include <map>
+#include <vector>
+#include <limits>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
 #include "InputDataStream.hpp"
 
 namespace pocolog_cpp
 {
     
-MultiFileIndex::MultiFileIndex(const std::vector< std::string >& fileNames, bool verbose)
+MultiFileIndex::MultiFileIndex(const std::vector< std::string >& fileNames, bool verbose, bool useCache) : useCache(useCache)
+    , loadThreads(std::thread::hardware_concurrency())
+    , combinedRegistry(new Typelib::Registry)
 {
     createIndex(fileNames);
 }
 
-MultiFileIndex::MultiFileIndex(bool verbose)
+MultiFileIndex::MultiFileIndex(bool verbose) : loadThreads(std::thread::hardware_concurrency())
+    , combinedRegistry(new Typelib::Registry)
 {
     
 }
@@ -28,10 +42,17 @@ MultiFileIndex::~MultiFileIndex()
 
 bool MultiFileIndex::createIndex(const std::vector< LogFile* >& logfiles)
 {
-    //order all streams by time
-    std::multimap<base::Time, IndexEntry> streamMap;
+    StreamMerger merger;
 
+    //replaces the index of a previous call
     globalSampleCount = 0;
+    entries = nullptr;
+    index.clear();
+    cacheFile.close();
+    streams.clear();
+    streamToGlobalIdx.clear();
+    mergedRegistries.clear();
+    combinedRegistry.reset(new Typelib::Registry);
     
     size_t globalStreamIdx = 0;
     
@@ -49,21 +70,23 @@ bool MultiFileIndex::createIndex(const std::vector< LogFile* >& logfiles)
                     continue;
             }
             
+            if(globalStreamIdx >= IndexEntry::MAX_STREAMS || stream->getSize() > IndexEntry::MAX_SAMPLES)
+                throw std::runtime_error("MultiFileIndex: Error, too many streams or samples to index, stream " + stream->getName());
+
             globalSampleCount += stream->getSize();
             
-            IndexEntry entry;
-            entry.stream = stream;
-            entry.globalStreamIdx = globalStreamIdx;
-            
             streamToGlobalIdx.insert(std::make_pair(stream, globalStreamIdx));
             
+            merger.addStream(stream, globalStreamIdx);
+
             globalStreamIdx++;
-            streamMap.insert(std::make_pair(stream->getFistSampleTime(), entry));
 
-            InputDataStream *dataStream = dynamic_cast<InputDataStream *>(entry.stream);
-            if(dataStream)
+            InputDataStream *dataStream = dynamic_cast<InputDataStream *>(stream);
+            //streams with the same type description share their registry,
+            //which only needs to be merged once
+            if(dataStream && mergedRegistries.insert(dataStream->getSharedStreamRegistry()).second)
             {
-                combinedRegistry.merge(dataStream->getStreamRegistry());
+                combinedRegistry->merge(dataStream->getStreamRegistry());
             }
             streams.push_back(stream);
         }
@@ -71,44 +94,42 @@ bool MultiFileIndex::createIndex(const std::vector< LogFile* >& logfiles)
         LOG_INFO_S << "Loading logfile Done " << curLogfile->getFileName();
     }
 
+    loadedFromCache = false;
+    std::string cacheKey;
+    if(useCache && !logfiles.empty())
+    {
+        cacheFileName = logfiles.front()->getFileBaseName() + ".mfi";
+        cacheKey = getCacheKey(logfiles);
+        if(loadCache(cacheKey))
+        {
+            LOG_INFO_S << "Using cached multi file index " << cacheFileName;
+            loadedFromCache = true;
+            return true;
+        }
+    }
+
     index.resize(globalSampleCount);
     
     int64_t globalSampleNr = 0;
     
     int lastPercentage = 0;
+    //sample number at which the next percentage is reached
+    int64_t nextProgressSampleNr = (globalSampleCount + 99) / 100;
     
     LOG_INFO_S << "Building multi file index ";
     
-    while(!streamMap.empty())
+    size_t streamIdx;
+    uint64_t sampleNr;
+    while(merger.next(streamIdx, sampleNr))
     {
-        //remove stream from map
-        IndexEntry curEntry = streamMap.begin()->second;
-        streamMap.erase(streamMap.begin());
-        
-        //ignore empty stream here, no data to play back
-        if(!curEntry.stream->getSize())
-            continue;
-
         //add index sample
-        index[globalSampleNr] = curEntry;
-
-        curEntry.sampleNrInStream++;
-
-        //check if we reached the end of the stream
-        if(curEntry.sampleNrInStream < curEntry.stream->getSize())
-        {
-            //get time of next sample
-            base::Time sampleTime = curEntry.stream->getFileIndex().getSampleTime(curEntry.sampleNrInStream);
-
-            //reenter stream
-            streamMap.insert(std::make_pair(sampleTime, curEntry));
-        }        
+        index[globalSampleNr] = IndexEntry(streamIdx, sampleNr);
 
         globalSampleNr++;
-        int curPercentag = (globalSampleNr * 100 / globalSampleCount);
-        if(lastPercentage != curPercentag)
+        if(globalSampleNr >= nextProgressSampleNr)
         {
-            lastPercentage = curPercentag;
+            lastPercentage = globalSampleNr * 100 / globalSampleCount;
+            nextProgressSampleNr = (globalSampleCount * (lastPercentage + 1) + 99) / 100;
             
 	    	LOG_INFO_S << "\r" << lastPercentage << "% Done" << std::flush;
         }
@@ -117,8 +138,160 @@ bool MultiFileIndex::createIndex(const std::vector< LogFile* >& logfiles)
     LOG_INFO_S << "\r 100% Done";
     LOG_INFO_S << "Processed " << globalSampleNr << " of " << globalSampleCount << " samples ";
     
+    entries = index.data();
+    if(useCache && !logfiles.empty())
+        writeCache(cacheKey);
+
+    return true;
+
+}
+
+namespace
+{
+    const std::string CACHE_MAGIC("MFIdxV2");
+
+    /** The cache file is the header, followed by the key and the entries */
+    struct CacheHeader
+    {
+        char magic[8];
+        uint64_t keySize;
+        uint64_t numEntries;
+    };
+
+    /** The entries start at the first 8 byte boundary after the key */
+    off_t getCacheDataPos(size_t keySize)
+    {
+        return (sizeof(CacheHeader) + keySize + 7) & ~off_t(7);
+    }
+}
+
+std::string MultiFileIndex::getCacheKey(const std::vector< LogFile* >& logfiles) const
+{
+    //the key is only compared byte wise, so it is written in binary
+    std::ostringstream key;
+    auto appendValue = [&key](uint64_t value) {
+        key.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    auto appendString = [&](const std::string &value) {
+        appendValue(value.size());
+        key << value;
+    };
+
+    appendValue(logfiles.size());
+    for(LogFile *logFile : logfiles)
+    {
+        appendString(std::filesystem::absolute(logFile->getFileName()).string());
+        appendValue(logFile->getFileSize());
+        appendValue(std::filesystem::last_write_time(logFile->getFileName()).time_since_epoch().count());
+    }
+
+    //the selected streams stand for the stream check
+    appendValue(streams.size());
+    for(Stream *stream : streams)
+    {
+        appendString(std::filesystem::absolute(stream->getDescription().getFileName()).string());
+        appendValue(stream->getIndex());
+        appendValue(stream->getSize());
+    }
+
+    return key.str();
+}
+
+bool MultiFileIndex::loadCache(const std::string& key)
+{
+    cacheFile.close();
+    std::error_code error;
+    if(!std::filesystem::is_regular_file(cacheFileName, error))
+        return false;
+    if(!cacheFile.open(cacheFileName.c_str(), std::fstream::in | std::fstream::binary, true))
+        return false;
+
+    CacheHeader header;
+    cacheFile.read((char *) &header, sizeof(CacheHeader));
+    if(!cacheFile.good() || std::string(header.magic, strnlen(header.magic, sizeof(header.magic))) != CACHE_MAGIC
+        || header.keySize != key.size() || header.numEntries != globalSampleCount)
+    {
+        LOG_INFO_S << "Multi file index cache " << cacheFileName << " is outdated";
+        cacheFile.close();
+        return false;
+    }
+
+    FileView keyView = cacheFile.view(sizeof(CacheHeader), key.size());
+    FileView entryView = cacheFile.view(getCacheDataPos(key.size()), header.numEntries * sizeof(IndexEntry));
+    if(!keyView.data || !entryView.data || memcmp(keyView.data, key.data(), key.size()) != 0)
+    {
+        LOG_INFO_S << "Multi file index cache " << cacheFileName << " is outdated";
+        cacheFile.close();
+        return false;
+    }
+
+    //a damaged cache must not index streams out of range. The ordering
+    //contains the samples of each stream in order, which is checked as well
+    const IndexEntry *cachedEntries = reinterpret_cast<const IndexEntry *>(entryView.data);
+    std::vector<uint64_t> nextSampleNr(streams.size(), 0);
+    for(uint64_t i = 0; i < header.numEntries; i++)
+    {
+        size_t streamIdx = cachedEntries[i].getGlobalStreamIdx();
+        if(streamIdx >= streams.size() || cachedEntries[i].getSampleNrInStream() != nextSampleNr[streamIdx]++)
+        {
+            LOG_WARN_S << "Multi file index cache " << cacheFileName << " is corrupted, rebuilding it";
+            cacheFile.close();
+            return false;
+        }
+    }
+
+    entries = cachedEntries;
     return true;
+}
+
+void MultiFileIndex::writeCache(const std::string& key)
+{
+    //written to a temporary file first, as the old cache might be mapped,
+    //and another process may write the same cache. The cache is optional,
+    //so failures, e.g. in read-only directories, are not errors
+    std::string tmpFileName(createTemporaryFile(cacheFileName));
+    if(tmpFileName.empty())
+    {
+        LOG_INFO_S << "MultiFileIndex: Could not create cache file " << cacheFileName;
+        return;
+    }
+    std::ofstream file(tmpFileName.c_str(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+    if(!file.is_open())
+    {
+        std::error_code error;
+        std::filesystem::remove(tmpFileName, error);
+        LOG_INFO_S << "MultiFileIndex: Could not create cache file " << cacheFileName;
+        return;
+    }
 
+    CacheHeader header;
+    memset(&header, 0, sizeof(CacheHeader));
+    memcpy(header.magic, CACHE_MAGIC.c_str(), CACHE_MAGIC.size());
+    header.keySize = key.size();
+    header.numEntries = globalSampleCount;
+
+    const char padding[8] = { 0 };
+    file.write((const char *) &header, sizeof(CacheHeader));
+    file.write(key.data(), key.size());
+    file.write(padding, getCacheDataPos(key.size()) - sizeof(CacheHeader) - key.size());
+    file.write((const char *) index.data(), index.size() * sizeof(IndexEntry));
+    file.close();
+
+    std::error_code error;
+    if(file.good())
+        std::filesystem::rename(tmpFileName, cacheFileName, error);
+    if(!file.good() || error)
+    {
+        LOG_INFO_S << "MultiFileIndex: Could not write cache file " << cacheFileName;
+        std::filesystem::remove(tmpFileName, error);
+    }
+}
+
+void MultiFileIndex::removeCache()
+{
+    std::error_code error;
+    if(!cacheFileName.empty())
+        std::filesystem::remove(cacheFileName, error);
 }
 
 size_t MultiFileIndex::getGlobalStreamIdx(Stream* stream) const
@@ -133,16 +306,53 @@ size_t MultiFileIndex::getGlobalStreamIdx(Stream* stream) const
 
 bool MultiFileIndex::createIndex(const std::vector< std::string >& fileNames)
 {
-    for(std::vector< std::string>::const_iterator it = fileNames.begin(); it != fileNames.end(); it++ )
+    //opening a log file might mean building its index, so the files are
+    //opened concurrently. The registries are merged afterwards in file order.
+    //The cores are shared among the index scans of the files, instead of
+    //each one starting a thread per core
+    std::vector<LogFile *> newLogFiles(fileNames.size(), nullptr);
+    std::vector<std::exception_ptr> errors(fileNames.size());
+    std::atomic<size_t> nextFile(0);
+    size_t numThreads = std::min(std::max<size_t>(loadThreads, 1), fileNames.size());
+    size_t indexThreads = std::max<size_t>(1, std::thread::hardware_concurrency() / std::max<size_t>(numThreads, 1));
+
+    auto loadFiles = [&]() {
+        for(size_t i = nextFile++; i < fileNames.size(); i = nextFile++)
+        {
+            try
+            {
+                LOG_INFO_S << "Loading logfile " << fileNames[i];
+                newLogFiles[i] = new LogFile(fileNames[i], true, false, indexThreads);
+                LOG_INFO_S << "Loading logfile Done " << fileNames[i];
+            }
+            catch(...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t i = 1; i < numThreads; i++)
+        workers.emplace_back(loadFiles);
+    loadFiles();
+    for(std::thread &worker : workers)
+        worker.join();
+
+    for(std::exception_ptr &error : errors)
     {
-        LOG_INFO_S << "Loading logfile " << *it;
-       
-        LogFile *curLogfile = new LogFile(*it);
-        logFiles.push_back(curLogfile);
-        
-        LOG_INFO_S << "Loading logfile Done " << *it;
+        if(error)
+        {
+            for(LogFile *logFile : newLogFiles)
+                delete logFile;
+            std::rethrow_exception(error);
+        }
     }
 
+    //replaces the log files of a previous call
+    for(LogFile *logFile : logFiles)
+        delete logFile;
+    logFiles = newLogFiles;
     return createIndex(logFiles);
 }
 
@@ -2,10 +2,13 @@
 #define MULTIFILEINDEX_H
 #include <vector>
 #include <string>
+#include <set>
+#include <memory>
 #include <stdint.h>
 #include <stdexcept>
 #include <typelib/registry.hh>
 #include <boost/function.hpp>
+#include "FileStream.hpp"
 
 namespace pocolog_cpp
 {
@@ -15,24 +18,56 @@ class InputDataStream;
 
 class MultiFileIndex
 {
+    /**
+     * One sample of the global ordering, 8 bytes. The upper 16 bits are
+     * the global stream index, the lower 48 bits the sample number
+     * within the stream.
+     * */
     struct IndexEntry
     {
-        IndexEntry(): sampleNrInStream(0), stream(NULL) {};
-        uint64_t sampleNrInStream;
-        Stream *stream;
-        size_t globalStreamIdx;
-    } __attribute__((packed));
+        static constexpr int SAMPLE_NR_BITS = 48;
+        static constexpr uint64_t MAX_STREAMS = uint64_t(1) << (64 - SAMPLE_NR_BITS);
+        static constexpr uint64_t MAX_SAMPLES = uint64_t(1) << SAMPLE_NR_BITS;
+
+        IndexEntry(): value(0) {};
+        IndexEntry(uint64_t globalStreamIdx, uint64_t sampleNrInStream)
+            : value((globalStreamIdx << SAMPLE_NR_BITS) | sampleNrInStream) {};
+
+        size_t getGlobalStreamIdx() const
+        {
+            return value >> SAMPLE_NR_BITS;
+        }
+
+        uint64_t getSampleNrInStream() const
+        {
+            return value & (MAX_SAMPLES - 1);
+        }
+
+        uint64_t value;
+    };
     
     std::vector<IndexEntry> index;
+    /** The ordering, either index.data() or the memory mapped cache file */
+    const IndexEntry *entries = nullptr;
+    FileStream cacheFile;
+    std::string cacheFileName;
+    bool useCache = false;
+    bool loadedFromCache = false;
+    size_t loadThreads;
+    /** The log files opened by createIndex(fileNames), which are owned */
     std::vector<LogFile *> logFiles;
     std::vector<Stream *> streams;
     std::map<Stream *, size_t> streamToGlobalIdx;
-    size_t globalSampleCount;
-    Typelib::Registry combinedRegistry;
+    size_t globalSampleCount = 0;
+    std::unique_ptr<Typelib::Registry> combinedRegistry;
+    std::set<std::shared_ptr<const Typelib::Registry> > mergedRegistries;
 //     base::Time firstSampleTime;
 //     base::Time lastSampleTime;
 public:
-    MultiFileIndex(const std::vector<std::string> &fileNames, bool verbose = true);
+    /**
+     * @param useCache see setUseCache
+     * */
+    MultiFileIndex(const std::vector<std::string> &fileNames, bool verbose = true, bool useCache = false);
     MultiFileIndex(bool verbose = true);
     ~MultiFileIndex();
     
@@ -51,7 +86,7 @@ public:
         if(globalSamplePos > globalSampleCount - 1)
             throw std::runtime_error("Error, Sample out of index requested");
         
-        return index[globalSamplePos].globalStreamIdx;
+        return entries[globalSamplePos].getGlobalStreamIdx();
     }
 
     size_t getGlobalStreamIdx(Stream *stream) const;
@@ -61,7 +96,7 @@ public:
         if(globalSamplePos > globalSampleCount - 1)
             throw std::runtime_error("Error, Sample out of index requested");
         
-        return index[globalSamplePos].stream;
+        return streams[entries[globalSamplePos].getGlobalStreamIdx()];
     }
     
     size_t getPosInStream(size_t globalSamplePos) const
@@ -69,7 +104,7 @@ public:
         if(globalSamplePos > globalSampleCount - 1)
             throw std::runtime_error("Error, Sample out of index requested");
         
-        return index[globalSamplePos].sampleNrInStream;
+        return entries[globalSamplePos].getSampleNrInStream();
     }
 
     /***
@@ -78,15 +113,76 @@ public:
      * */
     void registerStreamCheck(boost::function<bool (Stream *stream)> test);
     
+    /** The registry of all streams, valid until the next createIndex */
     Typelib::Registry &getCombinedRegistry()
     {
-        return combinedRegistry;
+        return *combinedRegistry;
     };
 
+    /**
+     * Creates the index over the given log files, replacing the index of
+     * a previous call
+     * */
     bool createIndex(const std::vector<LogFile *> &logfiles);
+    /**
+     * Opens the given log files on up to getLoadThreads() threads and
+     * creates the index over them. Only the file and index I/O of the log
+     * files overlaps, their registries are parsed one at a time by
+     * RegistryCache. The log files are owned by the MultiFileIndex, the
+     * ones of a previous call are closed.
+     * */
     bool createIndex(const std::vector<std::string> &fileNames);
+
+    /**
+     * Sets the number of threads used to open the log files in
+     * createIndex(fileNames). Defaults to the number of cores. The cores
+     * are divided among the threads for scanning the log files whose
+     * index has to be built, see LogFile::getIndexThreads.
+     * */
+    void setLoadThreads(size_t numThreads)
+    {
+        loadThreads = numThreads;
+    }
+
+    size_t getLoadThreads() const
+    {
+        return loadThreads;
+    }
+
+    /** Returns the log files opened by createIndex(fileNames) */
+    const std::vector<LogFile *> &getLogFiles() const
+    {
+        return logFiles;
+    }
+    
+    /**
+     * Enables or disables the cache of the global ordering (disabled by
+     * default). The ordering is stored next to the first log file, with
+     * the ending .mfi, and memory mapped by the next createIndex for the
+     * same log files and streams. The cache is rebuilt if the name, size
+     * or modification time of one of the log files, or the selection of
+     * streams changes. If the cache can not be written, e.g. because the
+     * log files are in a read-only directory, the index is still created.
+     * */
+    void setUseCache(bool enable)
+    {
+        useCache = enable;
+    }
+    
+    /** Returns true if the last createIndex used the cached ordering */
+    bool isLoadedFromCache() const
+    {
+        return loadedFromCache;
+    }
+    
+    /** Remove the cache file of the last createIndex from disk */
+    void removeCache();
     
 private:
+    std::string getCacheKey(const std::vector<LogFile *> &logfiles) const;
+    bool loadCache(const std::string &key);
+    void writeCache(const std::string &key);
+    
     boost::function<bool (Stream *stream)> streamCheck;
 };
 }
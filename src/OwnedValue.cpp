@@ -9,6 +9,12 @@ OwnedValue::OwnedValue(Typelib::Type const& type)
     Typelib::init(value);
 }
 
+OwnedValue::OwnedValue(MarshallingPlan const& plan)
+    : buffer(plan.getType().getSize())
+    , value(buffer.data(), plan.getType()) {
+    plan.init(buffer.data());
+}
+
 OwnedValue::OwnedValue(Typelib::Value const& from)
     : buffer(from.getType().getSize())
     , value(buffer.data(), from.getType()) {
@@ -29,6 +35,14 @@ void OwnedValue::load(std::vector<uint8_t> const& marshalled_buffer) {
     Typelib::load(value, marshalled_buffer);
 }
 
+void OwnedValue::load(uint8_t const* marshalled_data, size_t size) {
+    Typelib::load(value, marshalled_data, size);
+}
+
+void OwnedValue::load(uint8_t const* marshalled_data, size_t size, MarshallingPlan const& plan) {
+    plan.load(buffer.data(), marshalled_data, size);
+}
+
 Typelib::Type const& OwnedValue::getType() const {
     return value.getType();
 }
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <typelib/value.hh>
+#include "MarshallingPlan.hpp"
 
 namespace pocolog_cpp {
 
@@ -13,6 +14,8 @@ class OwnedValue {
 
 public:
     OwnedValue(Typelib::Type const& type);
+    /** Creates an initialized value of the type of the plan */
+    OwnedValue(MarshallingPlan const& plan);
     OwnedValue(Typelib::Value const& from);
     OwnedValue(OwnedValue const& from);
     OwnedValue(OwnedValue&& from);
@@ -20,6 +23,9 @@ public:
     Typelib::Type const& getType() const;
 
     void load(std::vector<uint8_t> const& marshalled_buffer);
+    void load(uint8_t const* marshalled_data, size_t size);
+    /** Loads a sample using the precomputed plan of the value's type */
+    void load(uint8_t const* marshalled_data, size_t size, MarshallingPlan const& plan);
     Typelib::Value operator*() const;
 
     template<typename T>
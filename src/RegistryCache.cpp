@@ -0,0 +1,121 @@
+#include "RegistryCache.hpp"
+#include <typelib/pluginmanager.hh>
+#include <typelib/registry.hh>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace pocolog_cpp
+{
+
+namespace
+{
+    struct CachedRegistry
+    {
+        std::string tlb;
+        /** The type that was built into the registry, empty for the
+         * registry returned by get */
+        std::string derivedType;
+        std::weak_ptr<Typelib::Registry> registry;
+    };
+
+    std::mutex cacheMutex;
+    /** The registries, by the hash of their TLB text */
+    std::unordered_multimap<size_t, CachedRegistry> cache;
+    /** Number of entries at which the unused ones are removed */
+    size_t sweepSize = 64;
+
+    void removeUnused()
+    {
+        for(auto it = cache.begin(); it != cache.end(); )
+        {
+            if(it->second.registry.expired())
+                it = cache.erase(it);
+            else
+                it++;
+        }
+        sweepSize = std::max<size_t>(64, cache.size() * 2);
+    }
+
+    /** Returns the registry of \c tlb and \c derivedType from the cache,
+     * parsing it with \c derivedType built into it if it is not there.
+     * Called with the lock held */
+    std::shared_ptr<Typelib::Registry> lookup(size_t hash, const std::string &tlb, const std::string &derivedType)
+    {
+        CachedRegistry *expired = nullptr;
+        auto range = cache.equal_range(hash);
+        for(auto it = range.first; it != range.second; it++)
+        {
+            if(it->second.tlb != tlb || it->second.derivedType != derivedType)
+                continue;
+            std::shared_ptr<Typelib::Registry> registry = it->second.registry.lock();
+            if(registry)
+                return registry;
+            expired = &it->second;
+        }
+
+        std::istringstream stream(tlb);
+        utilmm::config_set empty;
+        std::shared_ptr<Typelib::Registry> parsed(new Typelib::Registry);
+        Typelib::PluginManager::load("tlb", stream, empty, *parsed);
+        if(!derivedType.empty())
+            parsed->build(derivedType);
+
+        if(expired)
+        {
+            expired->registry = parsed;
+            return parsed;
+        }
+        if(cache.size() >= sweepSize)
+            removeUnused();
+        cache.insert(std::make_pair(hash, CachedRegistry{tlb, derivedType, parsed}));
+        return parsed;
+    }
+}
+
+std::shared_ptr<const Typelib::Registry> RegistryCache::get(const std::string& tlb)
+{
+    //neither the plugin manager nor the TLB importer are thread safe, so
+    //the registries are parsed under the lock as well. Log files that are
+    //opened concurrently only overlap their file and index I/O.
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return lookup(std::hash<std::string>()(tlb), tlb, std::string());
+}
+
+const Typelib::Type* RegistryCache::build(std::shared_ptr<const Typelib::Registry>& registry, const std::string& typeName)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    const Typelib::Type *type = registry->get(typeName);
+    if(type)
+        return type;
+
+    //the registries are shared and read without the lock, so they are
+    //never modified. The type is built into a registry of its own, that
+    //is shared by all streams of the same description and type.
+    for(auto &entry : cache)
+    {
+        if(entry.second.registry.lock() != registry)
+            continue;
+        CachedRegistry cached(entry.second);
+        registry = lookup(entry.first, cached.tlb, typeName);
+        return registry->get(typeName);
+    }
+    throw std::logic_error("RegistryCache: the registry of type " + typeName + " was not returned by RegistryCache::get");
+}
+
+size_t RegistryCache::size()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    size_t used = 0;
+    for(auto &entry : cache)
+    {
+        if(!entry.second.registry.expired())
+            used++;
+    }
+    return used;
+}
+
+}
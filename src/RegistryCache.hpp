@@ -0,0 +1,51 @@
+#ifndef POCOLOG_CPP_REGISTRYCACHE_HPP
+#define POCOLOG_CPP_REGISTRYCACHE_HPP
+
+#include <string>
+#include <memory>
+
+namespace Typelib
+{
+    class Registry;
+    class Type;
+}
+
+namespace pocolog_cpp
+{
+
+/**
+ * Process wide cache of the typelib registries of the streams.
+ *
+ * Most streams of a set of log files share byte identical type
+ * descriptions. The registries are looked up by a hash of the TLB text,
+ * so that each description is only parsed and stored once, as long as
+ * a stream still uses it. The registries are parsed one at a time, and
+ * are never modified once returned, so that they can be read from any
+ * thread without locking. All methods are thread safe.
+ * */
+class RegistryCache
+{
+public:
+    /**
+     * Returns the registry described by the given TLB text, parsing it
+     * only if there is no registry for the same text yet.
+     * */
+    static std::shared_ptr<const Typelib::Registry> get(const std::string &tlb);
+
+    /**
+     * Returns the type with the given name from a registry returned by
+     * get. Types that are not in the registry but can be derived from
+     * its types, e.g. arrays, are built into a copy of it, which replaces
+     * \c registry and is shared with the other streams of the same
+     * description and type. Throws like Typelib::Registry::build if the
+     * type is unknown.
+     * */
+    static const Typelib::Type *build(std::shared_ptr<const Typelib::Registry> &registry, const std::string &typeName);
+
+    /** Returns the number of registries in the cache that are still in use */
+    static size_t size();
+};
+
+}
+
+#endif
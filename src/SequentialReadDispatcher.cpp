@@ -22,12 +22,17 @@ void SequentialReadDispatcher::run()
     logfile.rewind();
 
     auto per_index_dispatch = buildPerIndexDispatch();
+    if (arenaWindowSize) {
+        runWithArena(per_index_dispatch);
+        return;
+    }
+
     while (auto maybe_sample = logfile.readNextSample()) {
         if (!maybe_sample.has_value()) {
             return;
         }
 
-        auto [index, time, value] = *maybe_sample;
+        auto& [index, time, value] = *maybe_sample;
 
         for (auto d : per_index_dispatch[index]) {
             d->dispatch(*value);
@@ -35,6 +40,38 @@ void SequentialReadDispatcher::run()
     }
 }
 
+void SequentialReadDispatcher::runWithArena(PerIndexDispatch const& per_index_dispatch)
+{
+    ValueArena arena;
+    vector<LogFile::ArenaSample> window(arenaWindowSize);
+    while (true) {
+        size_t count = 0;
+        while (count < window.size() && logfile.readNextSample(arena, window[count])) {
+            ++count;
+        }
+        if (count == 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            for (auto d : per_index_dispatch[window[i].streamIdx]) {
+                d->dispatch(window[i].value);
+            }
+        }
+        arena.reset();
+    }
+}
+
+void SequentialReadDispatcher::setArenaWindowSize(size_t numSamples)
+{
+    arenaWindowSize = numSamples;
+}
+
+void SequentialReadDispatcher::setPrefetchDepth(size_t numBlocks)
+{
+    logfile.setPrefetchDepth(numBlocks);
+}
+
 SequentialReadDispatcher::PerIndexDispatch SequentialReadDispatcher::
     buildPerIndexDispatch()
 {
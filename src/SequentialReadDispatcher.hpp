@@ -60,9 +60,11 @@ class SequentialReadDispatcher {
 
     LogFile& logfile;
     std::vector<DispatchBase*> dispatches;
+    size_t arenaWindowSize = 0;
 
     using PerIndexDispatch = std::vector<std::vector<DispatchBase*>>;
     PerIndexDispatch buildPerIndexDispatch();
+    void runWithArena(PerIndexDispatch const& per_index_dispatch);
 
 public:
     SequentialReadDispatcher(LogFile& logfile);
@@ -75,6 +77,17 @@ public:
      */
     void run();
 
+    /** Reads the log file in a background thread during run(),
+     * see LogFile::setPrefetchDepth */
+    void setPrefetchDepth(size_t numBlocks);
+
+    /** Decodes windows of the given number of samples into a ValueArena
+     * during run(), which is reset after the samples of each window were
+     * dispatched. This avoids allocating and freeing each sample
+     * separately. 0 (the default) decodes each sample on its own.
+     */
+    void setArenaWindowSize(size_t numSamples);
+
     template<typename T>
     void add(std::string const& streamName,
              Callback<T> callback) {
@@ -3,9 +3,21 @@
 #include <iostream>
 #include <stdexcept>
 
-pocolog_cpp::Stream::Stream(const pocolog_cpp::StreamDescription& desc, pocolog_cpp::Index& index) : desc(desc), index(index)
+pocolog_cpp::Stream::Stream(const pocolog_cpp::StreamDescription& desc, pocolog_cpp::Index& index, bool memoryMapped)
+    : desc(desc), index(index), compression(NoCompression)
+    , hasSuperBlocks(desc.getSuperBlockSamples() != 0), superBlockFirstSample(0)
 {
-    fileStream.open(desc.getFileName().c_str(), std::ifstream::binary | std::ifstream::in);
+    try
+    {
+        compression = desc.getCompression();
+    }
+    catch(const std::invalid_argument &e)
+    {
+        compressionError = "Stream: cannot decode the compressed samples of stream " + desc.getName() + ". " + e.what();
+        LOG_WARN_S << compressionError;
+    }
+
+    fileStream.open(desc.getFileName().c_str(), std::ifstream::binary | std::ifstream::in, memoryMapped);
     if(!fileStream.good())
         throw std::runtime_error("Error, could not open logfile for stream " + desc.getName());
 }
@@ -23,25 +35,188 @@ bool pocolog_cpp::Stream::loadSampleHeader(std::streampos pos, SampleHeaderData
 }
 
 
+void pocolog_cpp::Stream::decodeSample(const uint8_t* raw, size_t rawSize, std::vector< uint8_t >& result)
+{
+    if(raw[0] == CompressedSample)
+        decompress(raw + 1, rawSize - 1, result);
+    else
+        result.assign(raw + 1, raw + rawSize);
+}
+
+void pocolog_cpp::Stream::decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& result)
+{
+    if(!compressionError.empty())
+        throw std::runtime_error(compressionError);
+    Compression::decompress(compression, data, size, result);
+}
+
+bool pocolog_cpp::Stream::getSuperBlockSample(FileView& result, size_t sampleNr, bool& inSuperBlock)
+{
+    std::streampos samplePos = index.getSamplePos(sampleNr);
+    inSuperBlock = true;
+    if(superBlock.getPos() != samplePos)
+    {
+        SampleHeaderData header;
+        std::streampos headerPos = samplePos - std::streamoff(sizeof(SampleHeaderData));
+        checkFileSize(headerPos, sizeof(SampleHeaderData));
+        if(!loadSampleHeader(headerPos, header))
+        {
+            LOG_ERROR_S << "Could not load sample header of sample " << sampleNr;
+            return false;
+        }
+        if(header.compressed != SuperBlockSample)
+        {
+            inSuperBlock = false;
+            return true;
+        }
+
+        checkFileSize(samplePos, header.data_size);
+        FileView data = fileStream.view(samplePos, header.data_size);
+        if(!data.data)
+        {
+            compressedBuffer.resize(header.data_size);
+            fileStream.seekg(samplePos);
+            fileStream.read((char *) compressedBuffer.data(), compressedBuffer.size());
+            if(!fileStream.good())
+            {
+                LOG_ERROR_S << "Could not load the super-block of sample " << sampleNr;
+                return false;
+            }
+            data = FileView(compressedBuffer.data(), compressedBuffer.size());
+        }
+        superBlock.decode(fileStream, samplePos, data.data, data.size);
+        superBlockFirstSample = index.findFirstSampleAt(samplePos);
+    }
+
+    size_t sample = sampleNr - superBlockFirstSample;
+    if(sampleNr < superBlockFirstSample || sample >= superBlock.getNumSamples())
+        throw std::runtime_error("Stream: the index of stream " + getName() + " does not match its super-blocks");
+    result = superBlock.getSample(sample);
+    return true;
+}
+
 bool pocolog_cpp::Stream::getSampleData(std::vector< uint8_t >& result, size_t sampleNr)
 {
+    if(hasSuperBlocks)
+    {
+        FileView view;
+        bool inSuperBlock;
+        if(!getSuperBlockSample(view, sampleNr, inSuperBlock))
+            return false;
+        if(inSuperBlock)
+        {
+            result.assign(view.begin(), view.end());
+            return true;
+        }
+    }
+
     std::streampos samplePos = index.getSamplePos(sampleNr);
-    std::streampos sampleHeaderPos = samplePos;
-    sampleHeaderPos -= sizeof(SampleHeaderData);
-    
-    SampleHeaderData header;
-    if(!loadSampleHeader(sampleHeaderPos, header))
+    uint32_t dataSize = index.getSampleSize(sampleNr);
+
+    //the compressed flag is the last byte of the sample header. It is
+    //checked in all streams, as the Ruby pocolog tools compress samples
+    //without recording the codec in the stream metadata
+    uint8_t encoding = RawSample;
+    checkFileSize(samplePos - std::streamoff(1), dataSize + 1);
+    fileStream.seekg(samplePos - std::streamoff(1));
+    fileStream.read((char *) &encoding, 1);
+    std::vector<uint8_t> &buffer(encoding == CompressedSample ? compressedBuffer : result);
+    buffer.resize(dataSize);
+    fileStream.read((char *) buffer.data(), buffer.size());
+    if(!fileStream.good())
     {
-        LOG_ERROR_S << "Could not load sample header of sample " << sampleNr << " samplePos " << samplePos << " headerPos " << sampleHeaderPos;
+        LOG_ERROR_S << "Could not load sample data of sample " << sampleNr;
         return false;
     }
-    result.resize(header.data_size);
 
-    fileStream.seekg(samplePos);
-    fileStream.read((char *) result.data(), header.data_size);
-    if(!fileStream.good())
+    if(encoding == CompressedSample)
+        decompress(compressedBuffer.data(), compressedBuffer.size(), result);
+    return true;
+}
+
+bool pocolog_cpp::Stream::getSampleView(FileView& result, size_t sampleNr)
+{
+    if(hasSuperBlocks)
+    {
+        bool inSuperBlock;
+        if(!getSuperBlockSample(result, sampleNr, inSuperBlock))
+            return false;
+        if(inSuperBlock)
+            return true;
+    }
+
+    if(!fileStream.isMemoryMapped())
+    {
+        if(!getSampleData(viewBuffer, sampleNr))
+            return false;
+        result = FileView(viewBuffer.data(), viewBuffer.size());
+        return true;
+    }
+
+    //the view starts with the compressed flag, see getSampleData
+    std::streampos rawPos = index.getSamplePos(sampleNr) - std::streamoff(1);
+    checkFileSize(rawPos, index.getSampleSize(sampleNr) + 1);
+    FileView raw = fileStream.view(rawPos, index.getSampleSize(sampleNr) + 1);
+    if(!raw.data)
     {
         LOG_ERROR_S << "Could not load sample data of sample " << sampleNr;
+        return false;
     }
-    return fileStream.good();
+
+    if(raw.data[0] == CompressedSample)
+    {
+        decodeSample(raw.data, raw.size, viewBuffer);
+        result = FileView(viewBuffer.data(), viewBuffer.size());
+    }
+    else
+        result = FileView(raw.data + 1, raw.size - 1);
+    return true;
+}
+
+bool pocolog_cpp::Stream::getSampleDataBatch(std::vector< std::vector< uint8_t > >& results, const std::vector< size_t >& sampleNrs)
+{
+    //the samples of a super-block are read together anyway
+    if(hasSuperBlocks)
+    {
+        results.resize(sampleNrs.size());
+        for(size_t i = 0; i < sampleNrs.size(); i++)
+        {
+            if(!getSampleData(results[i], sampleNrs[i]))
+                return false;
+        }
+        return true;
+    }
+
+    //the compressed flag of each sample is read by a request of its own,
+    //which readBatch merges with the one of the payload, see getSampleData
+    std::vector<uint8_t> encodings(sampleNrs.size(), RawSample);
+    std::vector<FileStream::ReadRequest> requests(2 * sampleNrs.size());
+    results.resize(sampleNrs.size());
+    for(size_t i = 0; i < sampleNrs.size(); i++)
+    {
+        off_t samplePos = index.getSamplePos(sampleNrs[i]);
+        results[i].resize(index.getSampleSize(sampleNrs[i]));
+        requests[2 * i].pos = samplePos - 1;
+        requests[2 * i].size = 1;
+        requests[2 * i].buffer = reinterpret_cast<char *>(&encodings[i]);
+        requests[2 * i + 1].pos = samplePos;
+        requests[2 * i + 1].size = results[i].size();
+        requests[2 * i + 1].buffer = reinterpret_cast<char *>(results[i].data());
+        checkFileSize(samplePos - 1, results[i].size() + 1);
+    }
+
+    if(!fileStream.readBatch(requests))
+    {
+        LOG_ERROR_S << "Could not load sample data of batch in stream " << getName();
+        return false;
+    }
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        if(encodings[i] != CompressedSample)
+            continue;
+        compressedBuffer.swap(results[i]);
+        decompress(compressedBuffer.data(), compressedBuffer.size(), results[i]);
+    }
+    return true;
 }
@@ -2,6 +2,7 @@
 #define STREAM_H
 
 #include <fstream>
+#include <cstring>
 #include "Format.hpp"
 #include "StreamDescription.hpp"
 #include "Index.hpp"
@@ -14,14 +15,59 @@ class Stream
 {
 
 protected:
-    const StreamDescription &desc;
+    //a copy, as the descriptions of a followed LogFile may still grow
+    const StreamDescription desc;
     Index &index;
 
     FileStream fileStream;
-    Stream(const StreamDescription &desc, Index &index);
+    std::vector<uint8_t> viewBuffer;
+    /** Codec of the compressed samples, NoCompression if the stream has
+     * none, in which case compressed samples are zlib ones of the Ruby
+     * pocolog tools */
+    CompressionCodec compression;
+    /** Set if the codec of the stream is not known to pocolog_cpp. The
+     * error is thrown once a compressed sample of the stream is decoded,
+     * so that the rest of the stream and the log stay readable */
+    std::string compressionError;
+    /** The raw data of a compressed sample */
+    std::vector<uint8_t> compressedBuffer;
+    /** Set if the stream was declared with super-blocks, see SuperBlock */
+    bool hasSuperBlocks;
+    /** The last super-block that was read, and the number of its first sample */
+    SuperBlockReader superBlock;
+    size_t superBlockFirstSample;
+    Stream(const StreamDescription &desc, Index &index, bool memoryMapped = false);
 
     bool loadSampleHeader(std::streampos pos, pocolog_cpp::SampleHeaderData& header);
 
+    /**
+     * Decodes the raw data of a sample, which may be compressed.
+     * \c raw starts with the compressed flag, i.e. the last byte of the
+     * sample header, followed by the stored payload.
+     * */
+    void decodeSample(const uint8_t *raw, size_t rawSize, std::vector<uint8_t> &result);
+
+    /** Decompresses the stored payload of a compressed sample */
+    void decompress(const uint8_t *data, size_t size, std::vector<uint8_t> &result);
+
+    /**
+     * Gives access to a sample of a stream with super-blocks, reading and
+     * decoding its super-block unless it is the last one that was read.
+     *
+     * @param inSuperBlock set to false if the sample is stored in a block
+     *        of its own, which is left to the caller
+     * @return false if the sample could not be read
+     * */
+    bool getSuperBlockSample(FileView &result, size_t sampleNr, bool &inSuperBlock);
+
+    /** Makes sure that the file stream covers [pos, pos + size), for
+     * samples that were appended since the stream was opened */
+    void checkFileSize(off_t pos, size_t size)
+    {
+        if(pos + static_cast<off_t>(size) > fileStream.size())
+            fileStream.refreshSize();
+    }
+
 public:
     virtual ~Stream();
 
@@ -75,17 +121,83 @@ public:
         return index.getNumSamples();
     }
 
+    /** @see Index::findSampleAtOrAfter */
+    size_t findSampleAtOrAfter(const base::Time &time) const
+    {
+        return index.findSampleAtOrAfter(time);
+    }
+
+    /** @see Index::findSampleBefore */
+    size_t findSampleBefore(const base::Time &time) const
+    {
+        return index.findSampleBefore(time);
+    }
+
     const FileStream& getFileStream() const
     {
         return fileStream;
     }
 
+    /** @see FileStream::setReadAheadSize */
+    void setReadAheadSize(size_t size)
+    {
+        fileStream.setReadAheadSize(size);
+    }
+
+    /** Returns the codec of the compressed samples of the stream,
+     * NoCompression if its codec is not known to pocolog_cpp */
+    CompressionCodec getCompression() const
+    {
+        return compression;
+    }
+
+    /** Loads the payload of the given sample, decompressed if needed */
     bool getSampleData(std::vector<uint8_t> &result, size_t sampleNr);
 
+    /**
+     * Gives access to the payload of the given sample without copying it.
+     *
+     * If the log file is memory mapped, the view points directly into the
+     * mapping and stays valid as long as the stream exists. Otherwise, and
+     * for compressed samples and samples of super-blocks, the payload is
+     * read into an internal buffer, and the view is only valid until the
+     * next call to this method.
+     * */
+    bool getSampleView(FileView &result, size_t sampleNr);
+
+    /**
+     * Loads the payloads of several samples at once, using a single
+     * FileStream::readBatch. results[i] is the payload of sampleNrs[i],
+     * decompressed if needed.
+     * */
+    bool getSampleDataBatch(std::vector<std::vector<uint8_t> > &results, const std::vector<size_t> &sampleNrs);
+
+    /** @see FileStream::setBatchQueueDepth */
+    void setBatchQueueDepth(size_t depth)
+    {
+        fileStream.setBatchQueueDepth(depth);
+    }
+
     template<typename T>
     bool readSample(T &sample, size_t sampleNr)
     {
-        fileStream.seekg(index.getSamplePos(sampleNr));
+        //the compressed flag is the last byte of the sample header, see
+        //getSampleData
+        uint8_t encoding = RawSample;
+        if(!hasSuperBlocks)
+        {
+            checkFileSize(index.getSamplePos(sampleNr) - std::streamoff(1), sizeof(T) + 1);
+            fileStream.seekg(index.getSamplePos(sampleNr) - std::streamoff(1));
+            fileStream.read((char *) &encoding, 1);
+        }
+        if(hasSuperBlocks || encoding != RawSample)
+        {
+            if(!getSampleData(viewBuffer, sampleNr) || viewBuffer.size() < sizeof(T))
+                return false;
+            memcpy(&sample, viewBuffer.data(), sizeof(T));
+            return true;
+        }
+
         fileStream.read((char *) &sample, sizeof(T));
 
         return fileStream.good();
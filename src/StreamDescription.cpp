@@ -1,11 +1,11 @@
 #include "StreamDescription.hpp"
+#include "RegistryCache.hpp"
 
 #include <vector>
 #include <stdexcept>
 #include <sstream>
 
 #include <base-logging/Logging.hpp>
-#include <typelib/pluginmanager.hh>
 #include <typelib/registry.hh>
 #include <yaml-cpp/yaml.h>
 
@@ -107,14 +107,18 @@ map<string, string> StreamDescription::parseMetadata(string const& s) {
 
 Typelib::Type const& StreamDescription::getTypelibType() const {
     if (!m_typelibRegistry) {
-        std::stringstream stream(getTypeDescription());
-        utilmm::config_set config;
-        m_typelibRegistry.reset(
-            Typelib::PluginManager::load("tlb", stream, config)
-        );
+        m_typelibRegistry = RegistryCache::get(getTypeDescription());
     }
 
-    return *m_typelibRegistry->get(getTypeName());
+    return *RegistryCache::build(m_typelibRegistry, getTypeName());
+}
+
+MarshallingPlan const& StreamDescription::getMarshallingPlan() const {
+    if (!m_marshallingPlan) {
+        m_marshallingPlan = std::make_shared<MarshallingPlan>(getTypelibType());
+    }
+
+    return *m_marshallingPlan;
 }
 
 }
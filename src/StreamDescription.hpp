@@ -8,6 +8,9 @@
 
 #include "Format.hpp"
 #include "FileStream.hpp"
+#include "MarshallingPlan.hpp"
+#include "Compression.hpp"
+#include "SuperBlock.hpp"
 #include <typelib/typemodel.hh>
 
 namespace pocolog_cpp
@@ -24,7 +27,8 @@ class StreamDescription
     std::string m_metadata;
     std::map<std::string, std::string> m_metadataMap;
 
-    mutable std::shared_ptr<Typelib::Registry> m_typelibRegistry;
+    mutable std::shared_ptr<const Typelib::Registry> m_typelibRegistry;
+    mutable std::shared_ptr<const MarshallingPlan> m_marshallingPlan;
 
     std::string readString(const std::vector< uint8_t > data, size_t& pos);
     static std::map<std::string, std::string> parseMetadata(std::string const& s);
@@ -74,7 +78,23 @@ public:
         return m_metadataMap;
     }
 
+    /** Returns the codec of the compressed samples of the stream, see Compression */
+    CompressionCodec getCompression() const
+    {
+        return Compression::fromMetadata(m_metadataMap);
+    }
+
+    /** Returns the number of samples per super-block, 0 if the stream is
+     * not written in super-blocks, see SuperBlock */
+    size_t getSuperBlockSamples() const
+    {
+        return SuperBlock::fromMetadata(m_metadataMap);
+    }
+
     Typelib::Type const& getTypelibType() const;
+
+    /** Returns the decoder for the samples of the stream, computed on first use */
+    MarshallingPlan const& getMarshallingPlan() const;
 };
 }
 #endif // STREAMDESCRIPTION_H
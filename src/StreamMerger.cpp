@@ -0,0 +1,58 @@
+#include "StreamMerger.hpp"
+#include "Stream.hpp"
+#include <algorithm>
+
+namespace pocolog_cpp
+{
+
+void StreamMerger::addStream(Stream* stream, size_t globalStreamIdx)
+{
+    //ignore empty stream here, no data to play back
+    if(!stream->getSize())
+        return;
+
+    Cursor cursor;
+    cursor.index = &stream->getFileIndex();
+    cursor.samples = cursor.index->getIndexData();
+    cursor.indexedSamples = cursor.index->getNumSamples();
+    cursor.numSamples = stream->getSize();
+    cursor.nextSample = 0;
+    cursor.stream = stream;
+    cursor.globalStreamIdx = globalStreamIdx;
+    enter(cursor);
+    cursors.push_back(cursor);
+
+    remaining += cursor.numSamples;
+    treeValid = false;
+}
+
+void StreamMerger::buildTree()
+{
+    tree.assign(cursors.size(), cursors.size());
+    for(size_t i = cursors.size(); i-- > 0; )
+        update(i);
+    treeValid = true;
+}
+
+uint64_t StreamMerger::seek(const base::Time& time)
+{
+    uint64_t skipped = 0;
+    remaining = 0;
+    for(Cursor &cursor : cursors)
+    {
+        //the merge keeps the size the stream had when it was added
+        cursor.nextSample = std::min<uint64_t>(cursor.stream->findSampleAtOrAfter(time), cursor.numSamples);
+        enter(cursor);
+        skipped += cursor.nextSample;
+        remaining += cursor.numSamples - cursor.nextSample;
+    }
+    buildTree();
+    return skipped;
+}
+
+void StreamMerger::rewind()
+{
+    seek(base::Time::fromMicroseconds(std::numeric_limits<int64_t>::min()));
+}
+
+}
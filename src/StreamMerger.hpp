@@ -0,0 +1,161 @@
+#ifndef POCOLOG_CPP_STREAMMERGER_HPP
+#define POCOLOG_CPP_STREAMMERGER_HPP
+
+#include <vector>
+#include <limits>
+#include <stdint.h>
+#include <base/Time.hpp>
+#include "Index.hpp"
+
+namespace pocolog_cpp
+{
+class Stream;
+
+/**
+ * Merges the samples of a set of streams into one sequence ordered by
+ * sample time, one sample at a time. The memory used only depends on the
+ * number of streams, not on the number of samples.
+ *
+ * Samples with the same time are returned in the order in which their
+ * streams were (re)entered into the merge. Starting from the beginning,
+ * this is the order of addStream for the first samples of the streams.
+ *
+ * The merge covers the samples the streams had when they were added.
+ * Samples that a followed LogFile appends to the indices later are not
+ * returned, but the merge stays valid while they are appended.
+ * */
+class StreamMerger
+{
+    /** Read position of the merge in one stream */
+    struct Cursor
+    {
+        int64_t time;
+        uint64_t seq;
+        const Index *index;
+        /** The index data, fetched again whenever the index grew, as
+         * appending samples may move it */
+        const Index::IndexInfo *samples;
+        size_t indexedSamples;
+        uint64_t numSamples;
+        uint64_t nextSample;
+        Stream *stream;
+        size_t globalStreamIdx;
+
+        bool operator < (const Cursor &other) const
+        {
+            return time < other.time || (time == other.time && seq < other.seq);
+        }
+    };
+
+    std::vector<Cursor> cursors;
+    /**
+     * Tournament tree over the cursors. The leaves are the cursors, each
+     * inner node holds the loser of the match played there, and tree[0]
+     * the overall winner, i.e. the cursor with the earliest sample.
+     * Replaying the path of the winner costs one comparison per level.
+     * */
+    std::vector<size_t> tree;
+    bool treeValid = false;
+    uint64_t seq = 0;
+    uint64_t remaining = 0;
+
+    bool less(size_t a, size_t b) const
+    {
+        //the cursor past the end stands for -infinity during initialization
+        if(b == cursors.size())
+            return false;
+        if(a == cursors.size())
+            return true;
+        return cursors[a] < cursors[b];
+    }
+
+    /** Replays the matches of the given cursor after its key changed */
+    void update(size_t cursor)
+    {
+        size_t winner = cursor;
+        for(size_t node = (cursor + tree.size()) / 2; node > 0; node /= 2)
+        {
+            if(less(tree[node], winner))
+                std::swap(tree[node], winner);
+        }
+        tree[0] = winner;
+    }
+
+    /** Sets the key of the cursor from its next sample */
+    void enter(Cursor &cursor)
+    {
+        if(cursor.nextSample < cursor.numSamples)
+        {
+            if(cursor.index->getNumSamples() != cursor.indexedSamples)
+            {
+                cursor.samples = cursor.index->getIndexData();
+                cursor.indexedSamples = cursor.index->getNumSamples();
+            }
+            cursor.time = cursor.samples[cursor.nextSample].sampleTime;
+            cursor.seq = seq++;
+        }
+        else
+        {
+            //an exhausted stream loses every match
+            cursor.time = std::numeric_limits<int64_t>::max();
+            cursor.seq = std::numeric_limits<uint64_t>::max();
+        }
+    }
+
+    void buildTree();
+
+public:
+    /**
+     * Adds a stream to the merge. Empty streams are ignored.
+     *
+     * @param globalStreamIdx the index returned by next for the samples
+     *        of this stream
+     * */
+    void addStream(Stream *stream, size_t globalStreamIdx);
+
+    /** Returns the number of samples that next will still return */
+    uint64_t getRemaining() const
+    {
+        return remaining;
+    }
+
+    /**
+     * Returns the next sample in time order
+     *
+     * @return false if all samples were returned
+     * */
+    bool next(size_t &globalStreamIdx, uint64_t &sampleNrInStream)
+    {
+        if(!remaining)
+            return false;
+        if(!treeValid)
+            buildTree();
+
+        size_t curCursor = tree[0];
+        Cursor &cursor(cursors[curCursor]);
+        globalStreamIdx = cursor.globalStreamIdx;
+        sampleNrInStream = cursor.nextSample;
+
+        cursor.nextSample++;
+        enter(cursor);
+        update(curCursor);
+        remaining--;
+        return true;
+    }
+
+    /**
+     * Restarts the merge at the first sample with a time at or after
+     * the given one, using a binary search in every stream. Samples with
+     * the same time are then returned in the order of addStream.
+     *
+     * @return the number of samples before the new position
+     * */
+    uint64_t seek(const base::Time &time);
+
+    /** Restarts the merge at the first sample */
+    void rewind();
+};
+
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include "StreamingMultiFileIndex.hpp"
+#include "LogFile.hpp"
+#include "Stream.hpp"
+#include "InputDataStream.hpp"
+#include <base-logging/Logging.hpp>
+#include <algorithm>
+
+namespace pocolog_cpp
+{
+
+StreamingMultiFileIndex::StreamingMultiFileIndex(size_t windowSize)
+    : windowSize(std::max<size_t>(windowSize, 1))
+    , windowStart(0)
+    , nextInWindow(0)
+    , globalSampleCount(0)
+{
+    window.reserve(this->windowSize);
+}
+
+StreamingMultiFileIndex::~StreamingMultiFileIndex()
+{
+    for(LogFile *file : logFiles)
+        delete file;
+}
+
+bool StreamingMultiFileIndex::createIndex(const std::vector< LogFile* >& logfiles)
+{
+    size_t globalStreamIdx = streams.size();
+    for(LogFile *curLogfile : logfiles)
+    {
+        for(Stream *stream : curLogfile->getStreams())
+        {
+            if(streamCheck && !streamCheck(stream))
+                continue;
+
+            globalSampleCount += stream->getSize();
+            streamToGlobalIdx.insert(std::make_pair(stream, globalStreamIdx));
+            merger.addStream(stream, globalStreamIdx);
+            globalStreamIdx++;
+
+            InputDataStream *dataStream = dynamic_cast<InputDataStream *>(stream);
+            //streams with the same type description share their registry,
+            //which only needs to be merged once
+            if(dataStream && mergedRegistries.insert(dataStream->getSharedStreamRegistry()).second)
+            {
+                combinedRegistry.merge(dataStream->getStreamRegistry());
+            }
+            streams.push_back(stream);
+        }
+    }
+
+    rewind();
+    return true;
+}
+
+bool StreamingMultiFileIndex::createIndex(const std::vector< std::string >& fileNames)
+{
+    std::vector<LogFile *> newLogFiles;
+    for(const std::string &fileName : fileNames)
+    {
+        LOG_INFO_S << "Loading logfile " << fileName;
+        newLogFiles.push_back(new LogFile(fileName));
+        logFiles.push_back(newLogFiles.back());
+    }
+
+    return createIndex(newLogFiles);
+}
+
+bool StreamingMultiFileIndex::fillWindow()
+{
+    windowStart += window.size();
+    window.clear();
+    nextInWindow = 0;
+
+    WindowEntry entry;
+    while(window.size() < windowSize && merger.next(entry.globalStreamIdx, entry.sampleNrInStream))
+        window.push_back(entry);
+
+    return !window.empty();
+}
+
+void StreamingMultiFileIndex::seek(const base::Time& time)
+{
+    window.clear();
+    nextInWindow = 0;
+    windowStart = merger.seek(time);
+}
+
+void StreamingMultiFileIndex::rewind()
+{
+    window.clear();
+    nextInWindow = 0;
+    windowStart = 0;
+    merger.rewind();
+}
+
+size_t StreamingMultiFileIndex::getGlobalStreamIdx(Stream* stream) const
+{
+    std::map<Stream *, size_t>::const_iterator it = streamToGlobalIdx.find(stream);
+    if(it != streamToGlobalIdx.end())
+        return it->second;
+
+    throw std::runtime_error("Error, got unknown stream");
+}
+
+void StreamingMultiFileIndex::registerStreamCheck(boost::function<bool (Stream *stream)> test)
+{
+    streamCheck = test;
+}
+
+}
@@ -0,0 +1,151 @@
+#ifndef POCOLOG_CPP_STREAMINGMULTIFILEINDEX_HPP
+#define POCOLOG_CPP_STREAMINGMULTIFILEINDEX_HPP
+
+#include <vector>
+#include <map>
+#include <string>
+#include <set>
+#include <memory>
+#include <stdint.h>
+#include <stdexcept>
+#include <typelib/registry.hh>
+#include <boost/function.hpp>
+#include <base/Time.hpp>
+#include "StreamMerger.hpp"
+
+namespace pocolog_cpp
+{
+class LogFile;
+class Stream;
+
+/**
+ * Variant of MultiFileIndex for interactive replay of large sets of log
+ * files. Instead of materialising the global ordering up front, it keeps
+ * one cursor per stream and merges the next window of samples when the
+ * current one is used up. The memory used and the time to the first
+ * sample only depend on the number of streams and the window size, not on
+ * the number of samples in the logs.
+ *
+ * The samples are returned in the same order as by MultiFileIndex, with
+ * the exception of samples with the same time after a seek, which are then
+ * returned in the order of their streams.
+ * */
+class StreamingMultiFileIndex
+{
+    struct WindowEntry
+    {
+        size_t globalStreamIdx;
+        uint64_t sampleNrInStream;
+    };
+
+    StreamMerger merger;
+    size_t windowSize;
+    std::vector<WindowEntry> window;
+    /** Global sample number of the first entry in the window */
+    uint64_t windowStart;
+    /** Position of the entry in the window that next returns */
+    size_t nextInWindow;
+
+    std::vector<LogFile *> logFiles;
+    std::vector<Stream *> streams;
+    std::map<Stream *, size_t> streamToGlobalIdx;
+    size_t globalSampleCount;
+    Typelib::Registry combinedRegistry;
+    std::set<std::shared_ptr<const Typelib::Registry> > mergedRegistries;
+    boost::function<bool (Stream *stream)> streamCheck;
+
+    bool fillWindow();
+
+    const WindowEntry &getCurrent() const
+    {
+        if(!nextInWindow)
+            throw std::runtime_error("StreamingMultiFileIndex: Error, no current sample, call next first");
+        return window[nextInWindow - 1];
+    }
+
+public:
+    /**
+     * @param windowSize number of samples that are merged at once
+     * */
+    StreamingMultiFileIndex(size_t windowSize = 4096);
+    ~StreamingMultiFileIndex();
+
+    const std::vector<Stream *> getAllStreams() const
+    {
+        return streams;
+    };
+
+    /** Returns the number of samples in all streams */
+    size_t getSize() const
+    {
+        return globalSampleCount;
+    }
+
+    size_t getGlobalStreamIdx(Stream *stream) const;
+
+    /**
+     * Registers a callback, that evaluates every given stream if it
+     * should be included in the index
+     * */
+    void registerStreamCheck(boost::function<bool (Stream *stream)> test);
+
+    Typelib::Registry &getCombinedRegistry()
+    {
+        return combinedRegistry;
+    };
+
+    /**
+     * Sets up the cursors of the streams in the given log files. The
+     * first call to next returns the first sample.
+     * */
+    bool createIndex(const std::vector<LogFile *> &logfiles);
+    bool createIndex(const std::vector<std::string> &fileNames);
+
+    /**
+     * Advances to the next sample in time order
+     *
+     * @return false if there are no more samples
+     * */
+    bool next()
+    {
+        if(nextInWindow == window.size() && !fillWindow())
+            return false;
+        nextInWindow++;
+        return true;
+    }
+
+    /**
+     * Repositions the index, so that the next call to next returns the
+     * first sample with a time at or after the given one
+     * */
+    void seek(const base::Time &time);
+
+    /** Repositions the index to the first sample */
+    void rewind();
+
+    /** Returns the global sample number of the current sample */
+    size_t getGlobalPos() const
+    {
+        getCurrent();
+        return windowStart + nextInWindow - 1;
+    }
+
+    size_t getGlobalStreamIdx() const
+    {
+        return getCurrent().globalStreamIdx;
+    }
+
+    Stream *getSampleStream() const
+    {
+        return streams[getCurrent().globalStreamIdx];
+    }
+
+    size_t getPosInStream() const
+    {
+        return getCurrent().sampleNrInStream;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include "SuperBlock.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <typelib/endian_swap.hh>
+
+namespace endian = Typelib::Endian;
+
+namespace pocolog_cpp
+{
+
+const std::string SuperBlock::METADATA_KEY("pocolog_cpp_super_block_samples");
+
+/** Upper bound of the dictionary size, the dictionary is read once per
+ * stream and kept in memory by the readers */
+static const size_t MAX_DICTIONARY_SIZE = 16 * 1024;
+
+size_t SuperBlock::parseNumSamples(const std::string& value)
+{
+    try {
+        return boost::lexical_cast<size_t>(value);
+    }
+    catch(boost::bad_lexical_cast const&) {
+        throw std::invalid_argument("SuperBlock: invalid number of samples per super-block " + value);
+    }
+}
+
+size_t SuperBlock::fromMetadata(const std::map<std::string, std::string>& metadata)
+{
+    std::map<std::string, std::string>::const_iterator it = metadata.find(METADATA_KEY);
+    if(it == metadata.end())
+        return 0;
+    return parseNumSamples(it->second);
+}
+
+/** The header and the sample table are stored little endian, see
+ * Format.hpp, and converted when they are read or written */
+static void headerFromLittle(SuperBlock::Header& header)
+{
+    header.numSamples = endian::from_little(header.numSamples);
+    header.tableSize = endian::from_little(header.tableSize);
+    header.dictionaryOffset = endian::from_little(header.dictionaryOffset);
+    header.dictionarySize = endian::from_little(header.dictionarySize);
+}
+
+static SuperBlock::Entry entryToLittle(const SuperBlock::Entry& entry)
+{
+    SuperBlock::Entry result;
+    result.realtime_tv_sec   = endian::to_little(entry.realtime_tv_sec);
+    result.realtime_tv_usec  = endian::to_little(entry.realtime_tv_usec);
+    result.timestamp_tv_sec  = endian::to_little(entry.timestamp_tv_sec);
+    result.timestamp_tv_usec = endian::to_little(entry.timestamp_tv_usec);
+    result.data_size         = endian::to_little(entry.data_size);
+    return result;
+}
+
+static SuperBlock::Entry entryFromLittle(const SuperBlock::Entry& entry)
+{
+    SuperBlock::Entry result;
+    result.realtime_tv_sec   = endian::from_little(entry.realtime_tv_sec);
+    result.realtime_tv_usec  = endian::from_little(entry.realtime_tv_usec);
+    result.timestamp_tv_sec  = endian::from_little(entry.timestamp_tv_sec);
+    result.timestamp_tv_usec = endian::from_little(entry.timestamp_tv_usec);
+    result.data_size         = endian::from_little(entry.data_size);
+    return result;
+}
+
+/** Throws if the table of \c header does not fit in a super-block of \c size bytes */
+static void validateTable(const SuperBlock::Header& header, size_t size)
+{
+    if(size < sizeof(SuperBlock::Header) || size - sizeof(SuperBlock::Header) < header.tableSize)
+        throw std::runtime_error("SuperBlock: the sample table does not fit in the super-block, the log file is corrupted");
+}
+
+void SuperBlock::decodeEntries(const Header& header, const uint8_t* data, size_t size, std::vector<Entry>& entries)
+{
+    std::vector<uint8_t> decompressed;
+    if(header.flags & TABLE_COMPRESSED)
+    {
+        Compression::decompress(static_cast<CompressionCodec>(header.codec), data, size, decompressed);
+        data = decompressed.data();
+        size = decompressed.size();
+    }
+
+    if(size != static_cast<size_t>(header.numSamples) * sizeof(Entry))
+        throw std::runtime_error("SuperBlock: the sample table does not match the number of samples, the log file is corrupted");
+    entries.resize(header.numSamples);
+    memcpy(entries.data(), data, size);
+    for(Entry &entry : entries)
+        entry = entryFromLittle(entry);
+}
+
+bool SuperBlock::readEntries(FileStream& file, off_t pos, size_t size, Header& header, std::vector<Entry>& entries)
+{
+    if(size < sizeof(Header))
+        throw std::runtime_error("SuperBlock: truncated super-block, the log file is corrupted");
+
+    file.seekg(pos);
+    file.read(reinterpret_cast<char *>(&header), sizeof(Header));
+    if(!file.good())
+        return false;
+    headerFromLittle(header);
+    validateTable(header, size);
+
+    std::vector<uint8_t> table(header.tableSize);
+    file.read(reinterpret_cast<char *>(table.data()), table.size());
+    if(!file.good())
+        return false;
+    decodeEntries(header, table.data(), table.size(), entries);
+    return true;
+}
+
+SuperBlockWriter::SuperBlockWriter(CompressionCodec codec, size_t maxSamples)
+    : codec(codec)
+    , maxSamples(maxSamples)
+    , dictionaryDone(false)
+    , dictionaryPos(-1)
+{
+    entries.reserve(maxSamples);
+}
+
+void SuperBlockWriter::add(const base::Time& realtime, const base::Time& logical, const void* data, uint32_t size)
+{
+    timeval realtime_tv = realtime.toTimeval();
+    timeval logical_tv = logical.toTimeval();
+
+    SuperBlock::Entry entry;
+    entry.realtime_tv_sec   = realtime_tv.tv_sec;
+    entry.realtime_tv_usec  = realtime_tv.tv_usec;
+    entry.timestamp_tv_sec  = logical_tv.tv_sec;
+    entry.timestamp_tv_usec = logical_tv.tv_usec;
+    entry.data_size         = size;
+    entries.push_back(entry);
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    body.insert(body.end(), bytes, bytes + size);
+}
+
+const std::vector<uint8_t>& SuperBlockWriter::buildDictionary()
+{
+    std::vector<size_t> sampleSizes;
+    sampleSizes.reserve(entries.size());
+    for(const SuperBlock::Entry &entry : entries)
+        sampleSizes.push_back(entry.data_size);
+
+    Compression::trainDictionary(codec, body.data(), sampleSizes, std::min(MAX_DICTIONARY_SIZE, body.size() / 4), dictionary);
+    dictionaryDone = true;
+    return dictionary;
+}
+
+void SuperBlockWriter::encode(off_t pos, std::vector<uint8_t>& result)
+{
+    SuperBlock::Header header;
+    header.numSamples = endian::to_little<uint32_t>(entries.size());
+    header.codec = codec;
+    header.flags = 0;
+    header.dictionaryOffset = 0;
+    header.dictionarySize = 0;
+
+    //the table is compressed on its own, so that indexing does not need
+    //the dictionary nor the samples
+    littleEndianTable.resize(entries.size());
+    std::transform(entries.begin(), entries.end(), littleEndianTable.begin(), entryToLittle);
+    const uint8_t *table = reinterpret_cast<const uint8_t *>(littleEndianTable.data());
+    size_t tableSize = littleEndianTable.size() * sizeof(SuperBlock::Entry);
+    if(Compression::compress(codec, table, tableSize, compressedTable))
+    {
+        header.flags |= SuperBlock::TABLE_COMPRESSED;
+        table = compressedTable.data();
+        tableSize = compressedTable.size();
+    }
+    header.tableSize = endian::to_little<uint32_t>(tableSize);
+
+    const uint8_t *encodedBody = body.data();
+    size_t encodedSize = body.size();
+    bool useDictionary = !dictionary.empty() && dictionaryPos >= 0;
+    if(Compression::compress(codec, body.data(), body.size(), compressedBody,
+                             useDictionary ? dictionary.data() : nullptr, useDictionary ? dictionary.size() : 0))
+    {
+        header.flags |= SuperBlock::BODY_COMPRESSED;
+        if(useDictionary)
+        {
+            header.dictionaryOffset = endian::to_little<uint64_t>(pos - dictionaryPos);
+            header.dictionarySize = endian::to_little<uint32_t>(dictionary.size());
+        }
+        encodedBody = compressedBody.data();
+        encodedSize = compressedBody.size();
+    }
+
+    result.resize(sizeof(header) + tableSize + encodedSize);
+    memcpy(result.data(), &header, sizeof(header));
+    memcpy(result.data() + sizeof(header), table, tableSize);
+    memcpy(result.data() + sizeof(header) + tableSize, encodedBody, encodedSize);
+
+    entries.clear();
+    body.clear();
+}
+
+SuperBlockReader::SuperBlockReader()
+    : pos(-1)
+{
+}
+
+const std::vector<uint8_t>& SuperBlockReader::loadDictionary(FileStream& file, off_t dictionaryPos, size_t size)
+{
+    std::map<off_t, std::vector<uint8_t> >::iterator it = dictionaries.find(dictionaryPos);
+    if(it != dictionaries.end())
+        return it->second;
+
+    std::vector<uint8_t> dictionary(size);
+    file.seekg(dictionaryPos);
+    file.read(reinterpret_cast<char *>(dictionary.data()), size);
+    if(!file.good())
+        throw std::runtime_error("SuperBlock: could not read the dictionary of a super-block");
+    return dictionaries[dictionaryPos] = std::move(dictionary);
+}
+
+void SuperBlockReader::decode(FileStream& file, off_t pos, const uint8_t* data, size_t size)
+{
+    clear();
+
+    SuperBlock::Header header;
+    if(size < sizeof(header))
+        throw std::runtime_error("SuperBlock: truncated super-block, the log file is corrupted");
+    memcpy(&header, data, sizeof(header));
+    headerFromLittle(header);
+    validateTable(header, size);
+    SuperBlock::decodeEntries(header, data + sizeof(header), header.tableSize, entries);
+
+    offsets.resize(entries.size());
+    size_t bodySize = 0;
+    for(size_t i = 0; i < entries.size(); i++)
+    {
+        offsets[i] = bodySize;
+        bodySize += entries[i].data_size;
+    }
+
+    const uint8_t *encoded = data + sizeof(header) + header.tableSize;
+    size_t encodedSize = data + size - encoded;
+    CompressionCodec codec = static_cast<CompressionCodec>(header.codec);
+    if(header.flags & SuperBlock::BODY_COMPRESSED)
+    {
+        if(header.dictionaryOffset)
+        {
+            const std::vector<uint8_t> &dictionary(loadDictionary(file, pos - header.dictionaryOffset, header.dictionarySize));
+            Compression::decompress(codec, encoded, encodedSize, body, dictionary.data(), dictionary.size());
+        }
+        else
+            Compression::decompress(codec, encoded, encodedSize, body);
+    }
+    else
+        body.assign(encoded, encoded + encodedSize);
+
+    if(body.size() != bodySize)
+    {
+        entries.clear();
+        throw std::runtime_error("SuperBlock: the samples do not match the sample table, the log file is corrupted");
+    }
+    this->pos = pos;
+}
+
+}
@@ -0,0 +1,215 @@
+#ifndef POCOLOG_CPP_SUPERBLOCK_HPP
+#define POCOLOG_CPP_SUPERBLOCK_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+#include <base/Time.hpp>
+#include "Format.hpp"
+#include "Compression.hpp"
+#include "FileStream.hpp"
+
+namespace pocolog_cpp
+{
+
+/**
+ * Super-blocks hold several consecutive samples of a stream in one data
+ * block, for streams of small samples at a high rate. Compared to a block
+ * per sample, this saves the block and sample headers, and the samples
+ * get compressed together, using a dictionary built from the first full
+ * super-block of the stream.
+ *
+ * A stream is written in super-blocks if it is declared with METADATA_KEY
+ * set to the number of samples per super-block, and they are compressed
+ * with the codec set in Compression::METADATA_KEY, if any. The sample
+ * table and the samples are compressed separately, so that indexing only
+ * decompresses the table. The codec is stored in the super-block, which
+ * can be decoded without the stream metadata. See Format.hpp for the
+ * layout.
+ *
+ * The index has an entry per sample, whose position is the one of the
+ * data of its super-block. The place of a sample in its super-block is
+ * its distance to the first sample of the stream with the same position,
+ * see Index::findFirstSampleAt.
+ * */
+class SuperBlock
+{
+public:
+    /** Metadata key of the number of samples per super-block */
+    static const std::string METADATA_KEY;
+
+    /** Flags of the parts of a super-block that are compressed */
+    enum Flags
+    {
+        TABLE_COMPRESSED = 1,
+        BODY_COMPRESSED = 2
+    };
+
+    /** The header of a super-block. It is little endian in the file,
+     * readEntries and SuperBlockReader convert it */
+    struct Header
+    {
+        uint32_t numSamples;
+        uint8_t codec;
+        uint8_t flags;
+        uint32_t tableSize;
+        uint64_t dictionaryOffset;
+        uint32_t dictionarySize;
+    } __attribute__ ((packed));
+
+    /** The table entry of a sample. The entries are little endian in the
+     * file, decodeEntries converts them */
+    struct Entry
+    {
+        uint32_t realtime_tv_sec;
+        uint32_t realtime_tv_usec;
+        uint32_t timestamp_tv_sec;
+        uint32_t timestamp_tv_usec;
+        uint32_t data_size;
+
+        base::Time getRealtime() const
+        {
+            return base::Time::fromSeconds(realtime_tv_sec, realtime_tv_usec);
+        }
+
+        base::Time getTimestamp() const
+        {
+            return base::Time::fromSeconds(timestamp_tv_sec, timestamp_tv_usec);
+        }
+    } __attribute__ ((packed));
+
+    /** Parses the value of METADATA_KEY, throws if it is not a number */
+    static size_t parseNumSamples(const std::string &value);
+
+    /** Returns the number of samples per super-block set in the given
+     * stream metadata, 0 if the stream is not written in super-blocks */
+    static size_t fromMetadata(const std::map<std::string, std::string> &metadata);
+
+    /**
+     * Reads the header and the sample table of the super-block whose data
+     * of \c size bytes starts at \c pos, but not the samples themselves.
+     * This is all that is needed to index it.
+     *
+     * @return false if the table could not be read, throws if the
+     *         super-block is corrupted
+     * */
+    static bool readEntries(FileStream &file, off_t pos, size_t size, Header &header, std::vector<Entry> &entries);
+
+    /** Decodes the table that follows \c header in \c data, where
+     * \c size is the size of the table, throws if it is corrupted */
+    static void decodeEntries(const Header &header, const uint8_t *data, size_t size, std::vector<Entry> &entries);
+};
+
+/** Collects the samples of a stream into super-blocks, see Output */
+class SuperBlockWriter
+{
+    CompressionCodec codec;
+    size_t maxSamples;
+    std::vector<SuperBlock::Entry> entries;
+    std::vector<uint8_t> body;
+    bool dictionaryDone;
+    std::vector<uint8_t> dictionary;
+    off_t dictionaryPos;
+    std::vector<SuperBlock::Entry> littleEndianTable;
+    std::vector<uint8_t> compressedTable;
+    std::vector<uint8_t> compressedBody;
+
+public:
+    SuperBlockWriter(CompressionCodec codec, size_t maxSamples);
+
+    void add(const base::Time &realtime, const base::Time &logical, const void *data, uint32_t size);
+
+    bool empty() const
+    {
+        return entries.empty();
+    }
+
+    bool isFull() const
+    {
+        return entries.size() >= maxSamples;
+    }
+
+    /** The samples collected since the last call to encode */
+    const std::vector<SuperBlock::Entry> &getEntries() const
+    {
+        return entries;
+    }
+
+    /** Returns true if the dictionary should be built from the collected
+     * samples and written before the next super-block, which is done once
+     * the first super-block is full */
+    bool needsDictionary() const
+    {
+        return !dictionaryDone && codec != NoCompression && isFull();
+    }
+
+    /** Builds the dictionary, which may be empty. It has to be written
+     * into a block of its own, see setDictionaryPos */
+    const std::vector<uint8_t> &buildDictionary();
+
+    /** Sets the position of the data of the block holding the dictionary */
+    void setDictionaryPos(off_t pos)
+    {
+        dictionaryPos = pos;
+    }
+
+    /** Encodes the collected samples into the data of a super-block that
+     * starts at \c pos, and removes them */
+    void encode(off_t pos, std::vector<uint8_t> &result);
+};
+
+/** Decodes super-blocks, keeping the last one and the dictionaries */
+class SuperBlockReader
+{
+    off_t pos;
+    std::vector<SuperBlock::Entry> entries;
+    std::vector<size_t> offsets;
+    std::vector<uint8_t> body;
+    /** The dictionaries, by position */
+    std::map<off_t, std::vector<uint8_t> > dictionaries;
+
+    const std::vector<uint8_t> &loadDictionary(FileStream &file, off_t dictionaryPos, size_t size);
+
+public:
+    SuperBlockReader();
+
+    /**
+     * Decodes the super-block whose data starts at \c pos, with \c data
+     * holding its \c size bytes. The dictionary, if it has one, is read
+     * from \c file. Throws if the super-block is corrupted.
+     * */
+    void decode(FileStream &file, off_t pos, const uint8_t *data, size_t size);
+
+    /** Position of the decoded super-block, -1 if there is none */
+    off_t getPos() const
+    {
+        return pos;
+    }
+
+    void clear()
+    {
+        pos = -1;
+        entries.clear();
+    }
+
+    size_t getNumSamples() const
+    {
+        return entries.size();
+    }
+
+    const SuperBlock::Entry &getEntry(size_t sample) const
+    {
+        return entries.at(sample);
+    }
+
+    /** The data of the given sample, valid until the next decode */
+    FileView getSample(size_t sample) const
+    {
+        return FileView(body.data() + offsets.at(sample), entries[sample].data_size);
+    }
+};
+
+}
+
+#endif
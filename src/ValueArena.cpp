@@ -0,0 +1,94 @@
+#include "ValueArena.hpp"
+#include "MarshallingPlan.hpp"
+#include <typelib/typemodel.hh>
+#include <cstddef>
+#include <algorithm>
+
+namespace pocolog_cpp
+{
+
+/** Alignment of all values in the arena */
+static const size_t VALUE_ALIGNMENT = alignof(std::max_align_t);
+
+ValueArena::ValueArena(size_t chunkSize)
+    : chunkSize(std::max<size_t>(chunkSize, VALUE_ALIGNMENT))
+    , curChunk(0)
+    , curPos(0)
+{
+}
+
+ValueArena::~ValueArena()
+{
+    reset();
+}
+
+uint8_t* ValueArena::allocate(size_t size)
+{
+    size = std::max<size_t>((size + VALUE_ALIGNMENT - 1) & ~(VALUE_ALIGNMENT - 1), VALUE_ALIGNMENT);
+
+    //go on with the next chunk that is big enough, or get a new one
+    while(curChunk < chunks.size() && curPos + size > chunks[curChunk].size)
+    {
+        curChunk++;
+        curPos = 0;
+    }
+    if(curChunk == chunks.size())
+    {
+        Chunk chunk;
+        chunk.size = std::max(chunkSize, size);
+        chunk.data.reset(new uint8_t[chunk.size]);
+        chunks.push_back(std::move(chunk));
+    }
+
+    uint8_t *data = chunks[curChunk].data.get() + curPos;
+    curPos += size;
+    return data;
+}
+
+Typelib::Value ValueArena::load(const MarshallingPlan& plan, const uint8_t* data, size_t size)
+{
+    uint8_t *value = allocate(plan.getType().getSize());
+    plan.init(value);
+    if(!plan.isFlat())
+        toDestroy.push_back(Allocated{value, &plan});
+
+    plan.load(value, data, size);
+    return Typelib::Value(value, plan.getType());
+}
+
+void ValueArena::reset()
+{
+    for(auto it = toDestroy.rbegin(); it != toDestroy.rend(); it++)
+        it->plan->destroy(it->data);
+    toDestroy.clear();
+
+    //a single block is enough for the next window of the same size
+    if(chunks.size() > 1)
+    {
+        Chunk merged;
+        merged.size = getCapacity();
+        chunks.clear();
+        merged.data.reset(new uint8_t[merged.size]);
+        chunks.push_back(std::move(merged));
+    }
+    curChunk = 0;
+    curPos = 0;
+}
+
+size_t ValueArena::getUsedSize() const
+{
+    size_t used = curPos;
+    for(size_t i = 0; i < curChunk && i < chunks.size(); i++)
+        used += chunks[i].size;
+    return used;
+}
+
+size_t ValueArena::getCapacity() const
+{
+    size_t capacity = 0;
+    for(const Chunk &chunk : chunks)
+        capacity += chunk.size;
+    return capacity;
+}
+
+}
@@ -0,0 +1,80 @@
+#ifndef POCOLOG_CPP_VALUEARENA_HPP
+#define POCOLOG_CPP_VALUEARENA_HPP
+
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <typelib/value.hh>
+
+namespace pocolog_cpp
+{
+class MarshallingPlan;
+
+/**
+ * Bump allocator for decoded samples, for batch processing of windows of
+ * samples. The values of a window share the memory of the arena and are
+ * released together by reset(), which keeps the memory for the next
+ * window. After the first windows, the arena does not allocate anymore.
+ *
+ * Only the memory of the values themselves comes from the arena. The
+ * payloads of containers inside the values are allocated by their
+ * C++ types, and freed by reset().
+ * */
+class ValueArena
+{
+    struct Chunk
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    /** A value that has to be destroyed before its memory is reused */
+    struct Allocated
+    {
+        uint8_t *data;
+        const MarshallingPlan *plan;
+    };
+
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    /** The chunk allocations are currently taken from, and the position in it */
+    size_t curChunk;
+    size_t curPos;
+    std::vector<Allocated> toDestroy;
+
+    uint8_t *allocate(size_t size);
+
+public:
+    /**
+     * @param chunkSize size of the blocks of memory the arena gets from
+     *        the system. Values bigger than that get a block of their own.
+     * */
+    ValueArena(size_t chunkSize = 64 * 1024);
+    ~ValueArena();
+
+    ValueArena(const ValueArena &) = delete;
+    ValueArena &operator = (const ValueArena &) = delete;
+
+    /**
+     * Decodes a sample into a value allocated in the arena, using the
+     * given plan. The value and the plan have to stay valid until the
+     * next reset.
+     * */
+    Typelib::Value load(const MarshallingPlan &plan, const uint8_t *data, size_t size);
+
+    /**
+     * Destroys all values of the arena. The memory is kept, and merged
+     * into a single block if the last window needed more than one.
+     * */
+    void reset();
+
+    /** Returns the number of bytes used by the values since the last reset */
+    size_t getUsedSize() const;
+
+    /** Returns the number of bytes the arena got from the system */
+    size_t getCapacity() const;
+};
+
+}
+
+#endif
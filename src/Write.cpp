@@ -31,8 +31,12 @@
 
 
 #include "pocolog_cpp/Write.hpp"
+#include "pocolog_cpp/IndexWriter.hpp"
+#include "pocolog_cpp/SuperBlock.hpp"
 #include <sstream>
+#include <stdexcept>
 #include <string.h>
+#include <base-logging/Logging.hpp>
 
 #include <typelib/registry.hh>
 #include <typelib/pluginmanager.hh>
@@ -41,27 +45,175 @@ using namespace std;
 using boost::mutex;
 namespace endian = Typelib::Endian;
 
-void pocolog_cpp::writePrologue(std::ostream& stream)
+static pocolog_cpp::Prologue makePrologue()
 {
-    Prologue prologue;
+    pocolog_cpp::Prologue prologue;
     prologue.version    = endian::to_little<uint32_t>(pocolog_cpp::FORMAT_VERSION);
 #if defined(WORDS_BIGENDIAN)
     prologue.flags = 1;
 #else
     prologue.flags = 0;
 #endif
+    return prologue;
+}
 
+void pocolog_cpp::writePrologue(std::ostream& stream)
+{
+    Prologue prologue = makePrologue();
     stream.write(reinterpret_cast<char*>(&prologue), sizeof(prologue));
 }
 
 
 namespace pocolog_cpp
 {
-    Output::Output(std::ostream& stream)
+    namespace
+    {
+        /** The block and sample header of a data block, as stored in the file */
+        struct DataBlockHeaders
+        {
+            BlockHeader block;
+            SampleHeaderData sample;
+        } __attribute__ ((packed));
+
+        static_assert(sizeof(DataBlockHeaders) == Output::DATA_BLOCK_HEADERS_SIZE,
+                "DataBlockHeaders does not match the file format");
+    }
+
+    Output::Output(std::ostream& stream, size_t buffer_size)
         : m_stream(stream)
         , m_stream_idx(0)
+        , m_buffer(buffer_size)
+        , m_buffer_used(0)
+        , m_pos(0)
+        , m_pos_unknown(true)
+    {
+        Prologue prologue = makePrologue();
+        writeRaw(reinterpret_cast<char*>(&prologue), sizeof(prologue));
+    }
+
+    Output::~Output()
+    {
+        try { writeSuperBlocks(); }
+        catch (std::exception const& e)
+        { LOG_ERROR_S << "Output: could not write the pending super-blocks: " << e.what(); }
+        flushBuffer();
+        if (m_index)
+        {
+            // the journal is only needed until the index file is complete
+            try { writeIndex(); m_index->removeJournal(); }
+            catch (std::exception const& e)
+            { LOG_ERROR_S << "Output: could not write the index of the log: " << e.what(); }
+        }
+    }
+
+    void Output::writeThrough(const char* data, size_t size)
+    {
+        if (m_buffer.empty())
+        {
+            m_stream.write(data, size);
+            return;
+        }
+
+        // fill up the buffer first, so that the stream only gets full chunks
+        size_t head = m_buffer.size() - m_buffer_used;
+        memcpy(&m_buffer[m_buffer_used], data, head);
+        m_buffer_used = m_buffer.size();
+        flushBuffer();
+        data += head;
+        size -= head;
+
+        // big payloads skip the copy
+        size_t direct = size - size % m_buffer.size();
+        m_stream.write(data, direct);
+        memcpy(m_buffer.data(), data + direct, size - direct);
+        m_buffer_used = size - direct;
+    }
+
+    void Output::flushBuffer()
+    {
+        if (m_buffer_used)
+            m_stream.write(m_buffer.data(), m_buffer_used);
+        m_buffer_used = 0;
+    }
+
+    void Output::flush()
+    {
+        writeSuperBlocks();
+        flushBuffer();
+        m_stream.flush();
+    }
+
+    off_t Output::getPosition()
+    {
+        // the stream does not necessarily start at zero, and may have
+        // been written through getStream()
+        if (m_pos_unknown)
+        {
+            std::streampos pos = m_stream.tellp();
+            if (pos == std::streampos(-1))
+                throw std::runtime_error("Output: cannot determine the position in the stream, which is needed for the index and the super-blocks");
+            m_pos = static_cast<off_t>(pos) + m_buffer_used;
+            m_pos_unknown = false;
+        }
+        return m_pos;
+    }
+
+    void Output::setIndexFile(std::string const& index_file_name, off_t checkpoint_size)
+    {
+        if (m_stream_idx != 0)
+            throw std::logic_error("Output: the index file has to be set before the first stream is declared");
+
+        m_index.reset(new IndexWriter(index_file_name, checkpoint_size));
+    }
+
+    void Output::writeIndexCheckpoint()
+    {
+        // the index must not cover data that is not in the file yet. The
+        // pending super-blocks are left alone, as this may be called
+        // while writing one
+        off_t pos = getPosition();
+        flushBuffer();
+        m_stream.flush();
+        m_index->checkpoint(pos);
+    }
+
+    void Output::writeIndex()
     {
-        writePrologue(stream);
+        if (!m_index)
+            return;
+
+        writeIndexCheckpoint();
+        m_index->write();
+    }
+
+    off_t Output::beginIndexedBlock()
+    {
+        off_t pos = getPosition();
+        if (m_index->needsCheckpoint(pos))
+            writeIndexCheckpoint();
+        return pos;
+    }
+
+    void Output::indexEncoded(const char* data, size_t size)
+    {
+        off_t pos = beginIndexedBlock();
+        size_t offset = 0;
+        while (offset < size)
+        {
+            DataBlockHeaders headers;
+            if (size - offset < sizeof(headers))
+                throw std::runtime_error("Output: encoded data does not consist of whole data blocks");
+            memcpy(&headers, data + offset, sizeof(headers));
+            if (headers.block.type != DataBlockType)
+                throw std::runtime_error("Output: only data blocks can be written encoded to an indexed output");
+
+            uint32_t payload_size = endian::from_little(headers.sample.data_size);
+            m_index->addSample(endian::from_little(headers.block.stream_idx), pos + offset + DATA_BLOCK_HEADERS_SIZE,
+                    base::Time::fromSeconds(endian::from_little(headers.sample.realtime_tv_sec), endian::from_little(headers.sample.realtime_tv_usec)),
+                    base::Time::fromSeconds(endian::from_little(headers.sample.timestamp_tv_sec), endian::from_little(headers.sample.timestamp_tv_usec)),
+                    payload_size);
+            offset += DATA_BLOCK_HEADERS_SIZE + payload_size;
+        }
     }
 
     uint16_t Output::newStreamIndex()
@@ -74,17 +226,40 @@ namespace pocolog_cpp
     {
         // Do the marshalling of the metadata into a YAML-like document
         std::string metadata_yaml;
+        CompressionCodec codec = NoCompression;
+        size_t super_block_samples = 0;
         {
             std::ostringstream yaml_io;
             for (unsigned int i = 0; i < metadata.size(); ++i)
+            {
                 yaml_io << metadata[i].key << ": " << metadata[i].value << "\n";
+                if (metadata[i].key == Compression::METADATA_KEY)
+                    codec = Compression::fromName(metadata[i].value);
+                else if (metadata[i].key == SuperBlock::METADATA_KEY)
+                    super_block_samples = SuperBlock::parseNumSamples(metadata[i].value);
+            }
             metadata_yaml = yaml_io.str();
         }
 
+        if (!Compression::isAvailable(codec))
+            throw std::runtime_error("Output: stream " + name + " uses " + Compression::getName(codec) + " compression, but pocolog_cpp was built without it");
+        if (m_compression.size() <= stream_index)
+            m_compression.resize(stream_index + 1, NoCompression);
+        m_compression[stream_index] = codec;
+        if (m_super_blocks.size() <= stream_index)
+            m_super_blocks.resize(stream_index + 1);
+        if (super_block_samples)
+            m_super_blocks[stream_index].reset(new SuperBlockWriter(codec, super_block_samples));
+        else
+            m_super_blocks[stream_index].reset();
+
         uint32_t payload_size = 1 + 4 + name.size() + 4 + type_name.size()
             + 4 + type_def.size()
             + 4 + metadata_yaml.size();
 
+        if (m_index)
+            m_index->addStream(stream_index, name, beginIndexedBlock());
+
         BlockHeader block_header = { StreamBlockType, 0xFF, stream_index, payload_size };
         *this 
             << block_header
@@ -98,22 +273,119 @@ namespace pocolog_cpp
         }
     }
 
+
     void Output::writeSampleHeader(uint16_t stream_index, base::Time const& realtime, base::Time const& logical, uint32_t payload_size)
+    { writeDataBlockHeader(stream_index, realtime, logical, payload_size, RawSample); }
+
+    void Output::writeDataBlockHeader(uint16_t stream_index, base::Time const& realtime, base::Time const& logical, uint32_t payload_size, SampleEncoding encoding)
+    {
+        // super-blocks and dictionaries are indexed by writeSuperBlock
+        if (m_index && encoding <= CompressedSample)
+            m_index->addSample(stream_index, beginIndexedBlock() + DATA_BLOCK_HEADERS_SIZE, realtime, logical, payload_size);
+
+        // encoded in place and written with a single store, instead of
+        // one write per field
+        char headers[DATA_BLOCK_HEADERS_SIZE];
+        encodeSampleHeader(headers, stream_index, realtime, logical, payload_size, encoding);
+        writeRaw(headers, DATA_BLOCK_HEADERS_SIZE);
+    }
+
+    void Output::encodeSampleHeader(char* buffer, uint16_t stream_index, base::Time const& realtime, base::Time const& logical, uint32_t payload_size, SampleEncoding encoding)
     {
-        BlockHeader block_header = { DataBlockType, 0xFF, stream_index, SAMPLE_HEADER_SIZE + payload_size };
-        *this << block_header;
+        timeval realtime_tv = realtime.toTimeval();
+        timeval logical_tv = logical.toTimeval();
 
-        SampleHeader sample_header = { realtime, logical, payload_size, 0 };
-        *this << sample_header;
+        DataBlockHeaders headers;
+        headers.block.type       = DataBlockType;
+        headers.block.padding    = 0xFF;
+        headers.block.stream_idx = endian::to_little<uint16_t>(stream_index);
+        headers.block.data_size  = endian::to_little<uint32_t>(SAMPLE_HEADER_SIZE + payload_size);
+        headers.sample.realtime_tv_sec   = endian::to_little<uint32_t>(realtime_tv.tv_sec);
+        headers.sample.realtime_tv_usec  = endian::to_little<uint32_t>(realtime_tv.tv_usec);
+        headers.sample.timestamp_tv_sec  = endian::to_little<uint32_t>(logical_tv.tv_sec);
+        headers.sample.timestamp_tv_usec = endian::to_little<uint32_t>(logical_tv.tv_usec);
+        headers.sample.data_size         = endian::to_little<uint32_t>(payload_size);
+        headers.sample.compressed        = encoding;
+        memcpy(buffer, &headers, sizeof(headers));
     }
 
     void Output::writeSample(uint16_t stream_index, base::Time const& realtime, base::Time const& logical, void* payload_data, uint32_t payload_size)
     {
+        if (stream_index < m_super_blocks.size() && m_super_blocks[stream_index])
+        {
+            SuperBlockWriter& super_block = *m_super_blocks[stream_index];
+            super_block.add(realtime, logical, payload_data, payload_size);
+            if (super_block.isFull())
+                writeSuperBlock(stream_index);
+            return;
+        }
+
+        CompressionCodec codec = stream_index < m_compression.size() ? m_compression[stream_index] : NoCompression;
+        if (codec != NoCompression &&
+                Compression::compress(codec, reinterpret_cast<const uint8_t*>(payload_data), payload_size, m_compress_buffer))
+        {
+            writeDataBlockHeader(stream_index, realtime, logical, m_compress_buffer.size(), CompressedSample);
+            writeRaw(reinterpret_cast<const char*>(m_compress_buffer.data()), m_compress_buffer.size());
+            return;
+        }
+
         writeSampleHeader(stream_index, realtime, logical, payload_size);
-        m_stream.write(reinterpret_cast<const char*>(payload_data), payload_size);
+        writeRaw(reinterpret_cast<const char*>(payload_data), payload_size);
     }
 
-    std::ostream& Output::getStream() { return m_stream; }
+    void Output::writeSuperBlock(uint16_t stream_index)
+    {
+        SuperBlockWriter& super_block = *m_super_blocks[stream_index];
+        if (super_block.empty())
+            return;
+
+        // the blocks get the times of the first sample
+        SuperBlock::Entry const& first = super_block.getEntries().front();
+        base::Time realtime = first.getRealtime();
+        base::Time logical = first.getTimestamp();
+
+        if (super_block.needsDictionary())
+        {
+            std::vector<uint8_t> const& dictionary = super_block.buildDictionary();
+            if (!dictionary.empty())
+            {
+                super_block.setDictionaryPos(getPosition() + DATA_BLOCK_HEADERS_SIZE);
+                writeDataBlockHeader(stream_index, realtime, logical, dictionary.size(), SuperBlockDictionary);
+                writeRaw(reinterpret_cast<const char*>(dictionary.data()), dictionary.size());
+            }
+        }
+
+        off_t pos = (m_index ? beginIndexedBlock() : getPosition()) + DATA_BLOCK_HEADERS_SIZE;
+        if (m_index)
+        {
+            for (SuperBlock::Entry const& entry : super_block.getEntries())
+            {
+                m_index->addSample(stream_index, pos, entry.getRealtime(), entry.getTimestamp(), entry.data_size);
+            }
+        }
+
+        super_block.encode(pos, m_compress_buffer);
+        writeDataBlockHeader(stream_index, realtime, logical, m_compress_buffer.size(), SuperBlockSample);
+        writeRaw(reinterpret_cast<const char*>(m_compress_buffer.data()), m_compress_buffer.size());
+    }
+
+    void Output::writeSuperBlocks()
+    {
+        for (size_t i = 0; i < m_super_blocks.size(); ++i)
+        {
+            if (m_super_blocks[i])
+                writeSuperBlock(i);
+        }
+    }
+
+    std::ostream& Output::getStream()
+    {
+        flushBuffer();
+        // the caller may write to the stream directly, e.g. the payloads
+        // of StreamWriter
+        m_pos_unknown = true;
+        return m_stream;
+    }
 
 
 
@@ -34,8 +34,12 @@
 #define POCOLOG_CPP_WRITE_H
 
 #include <pocolog_cpp/Format.hpp>
+#include <pocolog_cpp/Compression.hpp>
 
 #include <vector>
+#include <memory>
+#include <cstring>
+#include <sys/types.h>
 //#include <map>
 #include <iosfwd>
 #include <boost/thread/mutex.hpp>
@@ -46,34 +50,155 @@ namespace Typelib {
 }
 namespace pocolog_cpp
 {
+    class IndexWriter;
+    class SuperBlockWriter;
+
     class Output
     {
         template<class T> friend Output& operator << (Output& output, const T& value);
 
         std::ostream& m_stream;
         uint16_t m_stream_idx;
+        /** The user space write buffer, empty if the output is unbuffered */
+        std::vector<char> m_buffer;
+        size_t m_buffer_used;
+        /** Builds the index while writing, see setIndexFile */
+        std::unique_ptr<IndexWriter> m_index;
+        /** Position of the next byte written in the log file */
+        off_t m_pos;
+        /** Set when the stream may have been written directly, m_pos has
+         * to be read back from the stream before it is used */
+        bool m_pos_unknown;
+        /** Codec of each stream, from the metadata of its declaration */
+        std::vector<CompressionCodec> m_compression;
+        std::vector<uint8_t> m_compress_buffer;
+        /** The pending samples of the streams that are written in
+         * super-blocks, null for the other streams */
+        std::vector<std::unique_ptr<SuperBlockWriter>> m_super_blocks;
 
     private:
         template<class T>
         void write(const T& data) 
         { 
 	    T little_endian = Typelib::Endian::to_little(data);
-	    m_stream.write( reinterpret_cast<const char*>(&little_endian), sizeof(T) ); 
+	    writeRaw( reinterpret_cast<const char*>(&little_endian), sizeof(T) ); 
 	}
-       
+
+        void writeRaw(const char* data, size_t size)
+        {
+            m_pos += size;
+            if (m_buffer.empty() || m_buffer_used + size > m_buffer.size())
+                writeThrough(data, size);
+            else
+            {
+                memcpy(m_buffer.data() + m_buffer_used, data, size);
+                m_buffer_used += size;
+            }
+        }
+        void writeThrough(const char* data, size_t size);
+        void flushBuffer();
+        off_t getPosition();
+        /** Flushes the log and marks it as indexed up to there */
+        void writeIndexCheckpoint();
+        /** Returns the position of the block that is about to be written,
+         * after writing an index checkpoint if one is due */
+        off_t beginIndexedBlock();
+        void indexEncoded(const char* data, size_t size);
+        void writeDataBlockHeader(uint16_t stream_index, base::Time const& realtime, base::Time const& logical, uint32_t payload_size, SampleEncoding encoding);
+        void writeSuperBlock(uint16_t stream_index);
+        void writeSuperBlocks();
 
     public:
-        Output(std::ostream& stream);
+        /** Creates an output on \c stream and writes the file prologue
+         *
+         * @arg buffer_size if nonzero, the output collects everything that
+         *   is written in a buffer of that size, which is written to \c
+         *   stream in chunks of exactly that size. Call flush() or
+         *   getStream() before accessing the stream directly.
+         */
+        Output(std::ostream& stream, size_t buffer_size = 0);
+        ~Output();
+
+        /** An output can not be copied, as its buffer can not be shared */
+        Output(Output const&) = delete;
+        Output& operator = (Output const&) = delete;
 
+        /** Returns the underlying stream, after writing the buffered data to it */
         std::ostream& getStream();
 
+        /** Writes the buffered data, including the samples that are
+         * waiting for their super-block to be complete, and flushes the
+         * underlying stream */
+        void flush();
+
+        /** Builds the index of the log while writing it
+         *
+         * The index entries are appended to a journal next to \c
+         * index_file_name, see IndexWriter, which costs 36 bytes of disk
+         * per sample but no memory. Every \c checkpoint_size bytes, the log
+         * and the journal are flushed. On destruction, the index file is
+         * written from the journal, which reads it once more, and the
+         * journal is removed. Opening the log afterwards needs no scan,
+         * and only a partial one if it is opened during the recording or
+         * the recording crashed.
+         *
+         * \c index_file_name must be the name IndexFile expects, i.e. the
+         * log file name with .log replaced by .id2. Must be called before
+         * the first stream is declared.
+         *
+         * @arg checkpoint_size number of bytes of the log between
+         *   checkpoints
+         */
+        void setIndexFile(std::string const& index_file_name, off_t checkpoint_size = 16 * 1024 * 1024);
+
+        /** Writes the index file for all blocks written so far, see
+         * setIndexFile. This reads the whole journal, so it should not be
+         * called while recording. Does nothing if the output builds no
+         * index. */
+        void writeIndex();
+
         uint16_t newStreamIndex();
 
+        /** Declares a stream
+         *
+         * Samples of the stream written with writeSample are compressed if
+         * \c metadata sets Compression::METADATA_KEY to the name of a
+         * codec, see Compression. Throws if the codec is not available.
+         *
+         * If \c metadata sets SuperBlock::METADATA_KEY, writeSample collects
+         * that many samples of the stream and writes them as one super-block,
+         * see SuperBlock. The samples of an incomplete super-block are
+         * written by flush() and on destruction.
+         */
         void writeStreamDeclaration(uint16_t stream_index, StreamType type,
                 std::string const& name, std::string const& type_name,
                 std::string const& type_def,
                 std::vector<StreamMetadata> const& metadata);
         void writeSampleHeader(uint16_t stream_index, base::Time const& realtime, base::Time const& logical, uint32_t payload_size);
+
+        /** Size of the block and sample headers of a data block */
+        static const size_t DATA_BLOCK_HEADERS_SIZE = BLOCK_HEADER_SIZE + SAMPLE_HEADER_SIZE;
+
+        /** Encodes the headers written by writeSampleHeader into \c buffer,
+         * which must hold DATA_BLOCK_HEADERS_SIZE bytes
+         */
+        static void encodeSampleHeader(char* buffer, uint16_t stream_index, base::Time const& realtime, base::Time const& logical, uint32_t payload_size, SampleEncoding encoding = RawSample);
+
+        /** Writes data that is already encoded in the log format, e.g. by
+         * encodeSampleHeader. If the output builds an index, \c data has
+         * to consist of whole data blocks.
+         */
+        void writeEncoded(const char* data, size_t size)
+        {
+            if (m_index)
+                indexEncoded(data, size);
+            writeRaw(data, size);
+        }
+
+        /** Writes a sample, compressed if its stream was declared with a
+         * compression codec and compression makes it smaller, or adds it
+         * to the super-block of its stream
+         */
         void writeSample(uint16_t stream_index, base::Time const& realtime, base::Time const& logical, void* payload_data, uint32_t payload_size);
     };
 
@@ -109,7 +234,7 @@ namespace pocolog_cpp
     {
         uint32_t length(value.length());
         output.write(length);
-        output.m_stream.write(reinterpret_cast<const char*>(value.c_str()), length);
+        output.writeRaw(value.c_str(), length);
         return output;
     }
 
@@ -171,7 +296,7 @@ namespace pocolog_cpp
         base::Time m_sampling;
         base::Time m_last;
 
-        Output m_file;
+        Output& m_file;
 
     public:
         /** Create a new logger, with no type definition
@@ -0,0 +1,164 @@
+#include "MultiFileIndex.hpp"
+#include "StreamingMultiFileIndex.hpp"
+#include "LogFile.hpp"
+#include "Stream.hpp"
+#include "Format.hpp"
+#include "Write.hpp"
+#include <boost/lexical_cast.hpp>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+
+using namespace pocolog_cpp;
+
+/**
+ * Writes numFiles log files, each containing numStreams streams with
+ * numSamples samples each. The sample times of all streams interleave,
+ * so that the merge has to switch streams on every sample.
+ * */
+std::vector<std::string> generateLogs(const std::string &prefix, size_t numFiles, size_t numStreams, size_t numSamples)
+{
+    std::vector<std::string> fileNames;
+    std::vector<char> writeBuffer(8096 * 1024);
+    int32_t payload = 0;
+
+    for(size_t f = 0; f < numFiles; f++)
+    {
+        std::string fileName = prefix + boost::lexical_cast<std::string>(f) + ".0.log";
+        std::ofstream file;
+        file.rdbuf()->pubsetbuf(writeBuffer.data(), writeBuffer.size());
+        file.open(fileName.c_str(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+
+        Output output(file);
+        std::vector<uint16_t> streamIdx;
+        for(size_t s = 0; s < numStreams; s++)
+        {
+            streamIdx.push_back(output.newStreamIndex());
+            output.writeStreamDeclaration(streamIdx.back(), DataStreamType, "/stream" + boost::lexical_cast<std::string>(s),
+                                          "/int32_t", "<typelib />", std::vector<StreamMetadata>());
+        }
+
+        for(size_t i = 0; i < numSamples; i++)
+        {
+            for(size_t s = 0; s < numStreams; s++)
+            {
+                int64_t offset = (s * numFiles + f) * 10;
+                base::Time time = base::Time::fromMicroseconds(1000 * 1000000LL + i * 100000LL + offset);
+                output.writeSample(streamIdx[s], time, time, reinterpret_cast<uint8_t *>(&payload), sizeof(payload));
+            }
+        }
+
+        file.close();
+        fileNames.push_back(fileName);
+    }
+
+    return fileNames;
+}
+
+void printRate(const std::string &name, size_t numSamples, const base::Time &duration)
+{
+    double seconds = duration.toSeconds();
+    std::cout << name << ": " << numSamples << " samples in " << seconds << " s, "
+              << numSamples / seconds << " samples/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cout << "Usage multiIndexBenchmark <log file> [log file ...]" << std::endl;
+        std::cout << "      multiIndexBenchmark --generate <prefix> [num files] [streams per file] [samples per stream]" << std::endl;
+        return 0;
+    }
+
+    std::vector<std::string> filenames;
+    if(std::strcmp(argv[1], "--generate") == 0)
+    {
+        if(argc < 3)
+        {
+            std::cout << "Error, --generate needs a file name prefix" << std::endl;
+            return 1;
+        }
+        size_t numFiles = argc > 3 ? atol(argv[3]) : 4;
+        size_t numStreams = argc > 4 ? atol(argv[4]) : 50;
+        size_t numSamples = argc > 5 ? atol(argv[5]) : 20000;
+
+        std::cout << "Generating " << numFiles << " log files with " << numStreams << " streams of "
+                  << numSamples << " samples each" << std::endl;
+        filenames = generateLogs(argv[2], numFiles, numStreams, numSamples);
+    }
+    else
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            filenames.push_back(argv[i]);
+        }
+    }
+
+    std::vector<LogFile *> logFiles;
+    base::Time start(base::Time::now());
+    for(const std::string &fileName : filenames)
+        logFiles.push_back(new LogFile(fileName, false));
+    base::Time loaded(base::Time::now());
+
+    MultiFileIndex multiIndex(false);
+    multiIndex.setUseCache(false);
+    multiIndex.createIndex(logFiles);
+    base::Time merged(base::Time::now());
+
+    size_t allSamples = multiIndex.getSize();
+    std::cout << "Loading the log files took " << (loaded - start).toSeconds() << " s" << std::endl;
+    printRate("merge", allSamples, merged - loaded);
+
+    {
+        MultiFileIndex writer(false);
+        writer.setUseCache(true);
+        writer.createIndex(logFiles);
+
+        base::Time cacheStart(base::Time::now());
+        MultiFileIndex cached(false);
+        cached.setUseCache(true);
+        cached.createIndex(logFiles);
+        base::Time cacheEnd(base::Time::now());
+        std::cout << "Reopening with the cached ordering took " << (cacheEnd - cacheStart).toSeconds() << " s"
+                  << (cached.isLoadedFromCache() ? "" : " (cache not used)") << std::endl;
+        cached.removeCache();
+    }
+
+    {
+        base::Time streamingStart(base::Time::now());
+        StreamingMultiFileIndex streaming;
+        streaming.createIndex(logFiles);
+        streaming.next();
+        base::Time firstSample(base::Time::now());
+        std::cout << "Time to the first sample of the streaming index " << (firstSample - streamingStart).toSeconds() << " s" << std::endl;
+
+        size_t streamedSamples = 1;
+        while(streaming.next())
+            streamedSamples++;
+        printRate("streaming merge", streamedSamples, base::Time::now() - firstSample);
+    }
+    merged = base::Time::now();
+
+    std::vector<uint8_t> data;
+    for(size_t i = 0; i < allSamples; i++)
+    {
+        pocolog_cpp::Stream *stream = multiIndex.getSampleStream(i);
+        stream->getSampleData(data, multiIndex.getPosInStream(i));
+    }
+    base::Time replayed(base::Time::now());
+    printRate("replay", allSamples, replayed - merged);
+
+    if(allSamples)
+    {
+        base::Time firstSampleTime = multiIndex.getSampleStream(0)->getFistSampleTime();
+        base::Time lastSampleTime = multiIndex.getSampleStream(allSamples - 1)->getLastSampleTime();
+        std::cout << "Log realtime " << (lastSampleTime - firstSampleTime).toSeconds() << " s" << std::endl;
+    }
+
+    for(LogFile *logFile : logFiles)
+        delete logFile;
+
+    return 0;
+}
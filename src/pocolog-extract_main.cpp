@@ -47,28 +47,6 @@ struct Args{
 };
 
 
-/*!
- * \brief fast_forward_to
- * \param dataStream
- * \param time
- * \return return numSamples if given time if no sample older than time is in stream
- */
-size_t fast_forward_to(InputDataStream *dataStream, const base::Time& time)
-{
-    size_t idx = 0;
-    while(true)
-    {
-        if(idx >= dataStream->getFileIndex().getNumSamples()){
-            return dataStream->getFileIndex().getNumSamples();
-        }
-
-        if(dataStream->getFileIndex().getSampleTime(idx) > time){
-            return idx;
-        }
-        idx++;
-    }
-}
-
 bool guess_field_with_timestamps(InputDataStream *stream, std::string& field_name)
 {
     // Initialize buffer
@@ -238,13 +216,15 @@ void extract(InputDataStream *stream,
     size_t idx = 0;
     size_t stop_idx = 0;
     if( !args.start_time.isNull() ){
-        idx = fast_forward_to(stream, args.start_time);
+        idx = stream->findSampleAtOrAfter(args.start_time);
     }else{
         idx = args.start_idx;
     }
 
     if( !args.stop_time.isNull() ){
-        stop_idx = fast_forward_to(stream, args.stop_time);
+        // stop_idx is exclusive, i.e. one past the last sample before stop_time
+        size_t last_idx = stream->findSampleBefore(args.stop_time);
+        stop_idx = (last_idx == stream->getSize()) ? 0 : last_idx + 1;
     }
     else if( args.stop_idx == 0 ){
         stop_idx = stream->getSize();
@@ -1,70 +1,240 @@
+#include "FileStream.hpp"
+#include "Format.hpp"
+#include "Write.hpp"
 #include <fstream>
 #include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <base/Time.hpp>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
-#include <iostream>
 #include <unistd.h>
 
-int main(int argc, char **argv)
+using namespace pocolog_cpp;
+
+/**
+ * Copy of the buffered read path of FileStream before the read-ahead
+ * window was added. It loads at most up to the end of the current file
+ * system block per syscall and copies the data byte by byte. It is only
+ * kept to measure the current read path against it.
+ * */
+class LegacyFileStream
 {
     std::vector<char> readBuffer;
-    const size_t bufferSize = 8096 * 1024;
-    readBuffer.resize(bufferSize);
-    
-    if(argc > 1)
+    int fd = -1;
+    off_t readBufferPosition = -1;
+    off_t readBufferEndPosition = -1;
+    off_t readPos = 0;
+    off_t fileSize = 0;
+    off_t blockSize = 0;
+    bool goodFlag = false;
+
+    bool posInBuffer(off_t pos) const
     {
-        std::fstream file1;
-        
-        file1.rdbuf()->pubsetbuf(readBuffer.data(), readBuffer.size());
-        file1.open("test.dat", std::ifstream::binary | std::ifstream::out);
-
-        
-        
-        for(size_t i = 0 ; i < bufferSize; i++)
-        {
-            char t = 'a';
-            file1.write(&t, sizeof(char));
-        }
-        
-        file1.close();
+        return pos >= readBufferPosition && pos < readBufferEndPosition;
     }
-    else
+
+    bool reloadBuffer(off_t position)
     {
-        int fd = ::open("test2.dat", O_WRONLY | O_CREAT, S_IWUSR | S_IRUSR);
-        if(fd < 0)
+        if(::lseek(fd, position, SEEK_SET) == -1)
         {
-            perror("f");
-            std::cout << "Error opening File " << std::endl;
-            return 0;
+            goodFlag = false;
+            return false;
         }
-        
-        for(size_t i = 0 ; i < bufferSize; i++)
+
+        off_t bytesToBlockEnd = (position / blockSize + 1) * blockSize - position;
+        readBufferPosition = position;
+        readBufferEndPosition = position + bytesToBlockEnd;
+
+        size_t toRead = bytesToBlockEnd;
+        if(readBufferEndPosition > fileSize)
+            toRead = fileSize - readBufferPosition;
+
+        size_t readSize = 0;
+        while(readSize < toRead)
         {
-            char t = 'a';
-            readBuffer[i] = t;
+            ssize_t ret = ::read(fd, readBuffer.data() + readSize, toRead - readSize);
+            if(ret <= 0)
+            {
+                goodFlag = false;
+                return false;
+            }
+            readSize += ret;
         }
-        
-        size_t written = 0;
-        
-        std::cout << "Fd is " << fd <<std::endl;
-        
-        while(written < bufferSize)
+        return true;
+    }
+
+public:
+    ~LegacyFileStream()
+    {
+        if(fd >= 0)
+            ::close(fd);
+    }
+
+    bool open(const char *fileName)
+    {
+        fd = ::open(fileName, O_NONBLOCK);
+        struct stat stats;
+        if(fd < 0 || ::fstat(fd, &stats) < 0)
+            return false;
+
+        fileSize = stats.st_size;
+        blockSize = stats.st_blksize;
+        readBuffer.resize(blockSize);
+        goodFlag = true;
+        return true;
+    }
+
+    void seekg(off_t pos)
+    {
+        readPos = pos;
+        goodFlag = true;
+    }
+
+    void read(char *buffer, size_t size)
+    {
+        size_t posInBuf = readPos - readBufferPosition;
+        for(size_t i = 0; i < size; i++)
         {
-            int ret = ::write(fd, readBuffer.data() + written, bufferSize - written);
-            if(ret < 0)
+            if(readPos >= fileSize)
+            {
+                goodFlag = false;
+                return;
+            }
+
+            if(!posInBuffer(readPos))
             {
-                perror("foo");
-                std::cout << "Error writing data" << std::endl;
-                close(fd);
-                return 0;
+                if(!reloadBuffer(readPos))
+                    return;
+                posInBuf = 0;
             }
-            written += ret;
+
+            buffer[i] = readBuffer[posInBuf];
+            posInBuf++;
+            readPos++;
         }
-        
-        close(fd);
-        
     }
-    
+
+    bool good() const
+    {
+        return goodFlag;
+    }
+
+    off_t size() const
+    {
+        return fileSize;
+    }
+};
+
+/**
+ * Writes a log file with a single stream containing numSamples samples
+ * of payloadSize bytes each
+ * */
+void generateLog(const std::string &fileName, size_t numSamples, size_t payloadSize)
+{
+    std::vector<char> writeBuffer;
+    writeBuffer.resize(8096 * 1024);
+    std::ofstream file;
+    file.rdbuf()->pubsetbuf(writeBuffer.data(), writeBuffer.size());
+    file.open(fileName.c_str(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+
+    Output output(file);
+    uint16_t streamIdx = output.newStreamIndex();
+    output.writeStreamDeclaration(streamIdx, DataStreamType, "/speed_test", "/uint8_t", "<typelib />", std::vector<StreamMetadata>());
+
+    std::vector<uint8_t> payload(payloadSize, 'a');
+    base::Time time = base::Time::fromMicroseconds(1000 * 1000000LL);
+    for(size_t i = 0; i < numSamples; i++)
+    {
+        output.writeSample(streamIdx, time, time, payload.data(), payload.size());
+        time = time + base::Time::fromMicroseconds(1000);
+    }
+
+    file.close();
+}
+
+/**
+ * Reads all blocks of the log file in the same way LogFile does,
+ * by reading the block header and then its payload.
+ * */
+template<typename Stream>
+void scanBlocks(const std::string &name, Stream &stream)
+{
+    std::vector<char> payload;
+    size_t numBlocks = 0;
+    off_t pos = sizeof(Prologue);
+
+    base::Time start(base::Time::now());
+    while(pos < stream.size())
+    {
+        BlockHeader header;
+        stream.seekg(pos);
+        stream.read(reinterpret_cast<char *>(&header), sizeof(BlockHeader));
+        if(!stream.good())
+            break;
+
+        payload.resize(header.data_size);
+        stream.read(payload.data(), header.data_size);
+        if(!stream.good())
+            break;
+
+        pos += sizeof(BlockHeader) + header.data_size;
+        numBlocks++;
+    }
+    base::Time end(base::Time::now());
+
+    double seconds = (end - start).toSeconds();
+    std::cout << name << ": " << numBlocks << " blocks in " << seconds << " s, "
+              << stream.size() / seconds / (1024 * 1024) << " MB/s, "
+              << numBlocks / seconds << " blocks/s" << std::endl;
+}
+
+void scanLog(const std::string &name, const std::string &fileName, size_t readAheadSize, bool memoryMapped)
+{
+    FileStream stream;
+    stream.setReadAheadSize(readAheadSize);
+    if(!stream.open(fileName.c_str(), std::ifstream::binary | std::ifstream::in, memoryMapped))
+    {
+        std::cout << "Error opening " << fileName << std::endl;
+        return;
+    }
+    scanBlocks(name, stream);
+}
+
+void scanLegacyLog(const std::string &name, const std::string &fileName)
+{
+    LegacyFileStream stream;
+    if(!stream.open(fileName.c_str()))
+    {
+        std::cout << "Error opening " << fileName << std::endl;
+        return;
+    }
+    scanBlocks(name, stream);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        std::cout << "Usage speedTest <generated log file> [num samples] [payload size]" << std::endl;
+        return 0;
+    }
+
+    std::string fileName(argv[1]);
+    size_t numSamples = argc > 2 ? atol(argv[2]) : 100000;
+    size_t payloadSize = argc > 3 ? atol(argv[3]) : 1024;
+
+    std::cout << "Generating " << fileName << " with " << numSamples << " samples of " << payloadSize << " bytes" << std::endl;
+    generateLog(fileName, numSamples, payloadSize);
+
+    //warm up the page cache, so that all runs read from memory
+    scanLog("warm up", fileName, 0, false);
+
+    scanLegacyLog("per byte copy (previous behaviour)", fileName);
+    scanLog("block sized window", fileName, 0, false);
+    scanLog("4MB read ahead window", fileName, 4 * 1024 * 1024, false);
+    scanLog("memory mapped", fileName, 0, true);
+
     return 0;
 }
@@ -0,0 +1,141 @@
+#include "Format.hpp"
+#include "Write.hpp"
+#include "ConcurrentOutput.hpp"
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <base/Time.hpp>
+
+using namespace pocolog_cpp;
+
+/** Writes the headers field by field through operator <<, as Output did before */
+void writeSamplePerField(Output &output, uint16_t streamIdx, const base::Time &time, const std::vector<uint8_t> &payload)
+{
+    BlockHeader blockHeader = { DataBlockType, 0xFF, streamIdx, static_cast<uint32_t>(SAMPLE_HEADER_SIZE + payload.size()) };
+    SampleHeader sampleHeader = { time, time, static_cast<uint32_t>(payload.size()), 0 };
+    output << blockHeader << sampleHeader;
+    output.getStream().write(reinterpret_cast<const char *>(payload.data()), payload.size());
+}
+
+/**
+ * Writes numSamples samples of payloadSize bytes into fileName and
+ * prints the achieved rate
+ * */
+void benchmark(const std::string &name, const std::string &fileName, size_t numSamples, size_t payloadSize, size_t bufferSize, bool perField)
+{
+    std::ofstream file(fileName.c_str(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+    std::vector<uint8_t> payload(payloadSize, 'a');
+
+    base::Time start(base::Time::now());
+    {
+        Output output(file, bufferSize);
+        uint16_t streamIdx = output.newStreamIndex();
+        output.writeStreamDeclaration(streamIdx, DataStreamType, "/write_benchmark", "/uint8_t", "<typelib />", std::vector<StreamMetadata>());
+
+        base::Time time = base::Time::fromMicroseconds(1000 * 1000000LL);
+        for(size_t i = 0; i < numSamples; i++)
+        {
+            if(perField)
+                writeSamplePerField(output, streamIdx, time, payload);
+            else
+                output.writeSample(streamIdx, time, time, payload.data(), payload.size());
+            time = time + base::Time::fromMicroseconds(1000);
+        }
+        output.flush();
+    }
+    base::Time end(base::Time::now());
+    file.close();
+
+    double seconds = (end - start).toSeconds();
+    std::cout << name << ", " << payloadSize << " byte payloads: " << numSamples / seconds << " samples/s, "
+              << numSamples * (payloadSize + BLOCK_HEADER_SIZE + SAMPLE_HEADER_SIZE) / seconds / (1024 * 1024) << " MB/s" << std::endl;
+}
+
+/**
+ * Writes numSamples samples from each of numThreads threads, either
+ * through a global lock around the output or through a ConcurrentOutput,
+ * and prints the throughput and the worst time a producer spent in a
+ * single write
+ * */
+void benchmarkConcurrent(const std::string &name, const std::string &fileName, size_t numThreads, size_t numSamples, bool lockFree)
+{
+    std::ofstream file(fileName.c_str(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+    std::vector<uint8_t> payload(16, 'a');
+    std::vector<int64_t> worstLatency(numThreads, 0);
+
+    base::Time start(base::Time::now());
+    {
+        Output output(file, 1024 * 1024);
+        ConcurrentOutput concurrent(output, 4096, 1024, ConcurrentOutput::BLOCK_PRODUCERS);
+        std::mutex lock;
+
+        std::vector<std::thread> producers;
+        for(size_t t = 0; t < numThreads; t++)
+        {
+            producers.emplace_back([&, t] {
+                uint16_t streamIdx;
+                if(lockFree)
+                    streamIdx = concurrent.registerStream("/write_benchmark", "/uint8_t", "<typelib />", std::vector<StreamMetadata>());
+                else
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    streamIdx = output.newStreamIndex();
+                    output.writeStreamDeclaration(streamIdx, DataStreamType, "/write_benchmark", "/uint8_t", "<typelib />", std::vector<StreamMetadata>());
+                }
+
+                base::Time time = base::Time::fromMicroseconds(1000 * 1000000LL);
+                for(size_t i = 0; i < numSamples; i++)
+                {
+                    base::Time before(base::Time::now());
+                    if(lockFree)
+                        concurrent.writeSample(streamIdx, time, time, payload.data(), payload.size());
+                    else
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        output.writeSample(streamIdx, time, time, payload.data(), payload.size());
+                    }
+                    worstLatency[t] = std::max(worstLatency[t], (base::Time::now() - before).toMicroseconds());
+                    time = time + base::Time::fromMicroseconds(1000);
+                }
+            });
+        }
+        for(std::thread &producer : producers)
+            producer.join();
+        concurrent.flush();
+    }
+    base::Time end(base::Time::now());
+
+    double seconds = (end - start).toSeconds();
+    std::cout << name << ", " << numThreads << " threads: " << numThreads * numSamples / seconds << " samples/s, worst write "
+              << *std::max_element(worstLatency.begin(), worstLatency.end()) << " us" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        std::cout << "Usage writeBenchmark <output file> [num small samples] [num large samples]" << std::endl;
+        return 0;
+    }
+
+    std::string fileName(argv[1]);
+    size_t numSmall = argc > 2 ? atol(argv[2]) : 2000000;
+    size_t numLarge = argc > 3 ? atol(argv[3]) : 20000;
+
+    for(size_t payloadSize : { size_t(16), size_t(64 * 1024) })
+    {
+        size_t numSamples = payloadSize < 1024 ? numSmall : numLarge;
+        benchmark("per field writes (previous behaviour)", fileName, numSamples, payloadSize, 0, true);
+        benchmark("unbuffered output", fileName, numSamples, payloadSize, 0, false);
+        benchmark("1MB buffered output", fileName, numSamples, payloadSize, 1024 * 1024, false);
+    }
+
+    benchmarkConcurrent("global lock", fileName, 4, numSmall / 4, false);
+    benchmarkConcurrent("ConcurrentOutput", fileName, 4, numSmall / 4, true);
+
+    return 0;
+}
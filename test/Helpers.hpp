@@ -3,8 +3,11 @@
 
 #include <gtest/gtest.h>
 #include <filesystem>
+#include <fstream>
+#include <unistd.h>
 
 #include <pocolog_cpp/LogFile.hpp>
+#include <pocolog_cpp/Compression.hpp>
 
 namespace pocolog_cpp {
     namespace helpers {
@@ -14,26 +17,73 @@ namespace pocolog_cpp {
             return std::filesystem::path(__FILE__).parent_path() / "fixtures" / fixture_name;
         }
 
+        /** Returns the content of a file */
+        inline std::string readFile(std::filesystem::path const& path) {
+            std::ifstream file(path, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+
         class Test : public ::testing::Test {
             std::vector<LogFile*> logfiles;
+            std::vector<std::string> tempPrefixes;
         public:
             ~Test() {
                 for (auto l : logfiles) {
                     l->removeAllIndexes();
                     delete l;
                 }
+
+                std::error_code error;
+                for (auto const& entry : std::filesystem::directory_iterator(std::filesystem::temp_directory_path(), error)) {
+                    std::string name = entry.path().filename().string();
+                    for (auto const& prefix : tempPrefixes) {
+                        if (name.compare(0, prefix.size(), prefix) == 0) {
+                            std::filesystem::remove(entry.path(), error);
+                        }
+                    }
+                }
             }
 
             /** Open a logfile in test/fixtures/ and delete the built index on teardown */
-            LogFile& openFixtureLogfile(std::string const& fixtureName) {
+            LogFile& openFixtureLogfile(std::string const& fixtureName, bool memoryMapped = false) {
                 auto path = fixturePath(fixtureName);
-                LogFile* logfile = new LogFile(path.string());
+                LogFile* logfile = new LogFile(path.string(), true, memoryMapped);
                 logfiles.push_back(logfile);
                 return *logfile;
             }
 
+            /** The type definition of the int32_t streams of plain.0.log */
+            std::string plainTypeDef() {
+                return openFixtureLogfile("plain.0.log").getStreamDescriptions()[0].getTypeDescription();
+            }
+
+            /**
+             * Returns the name of a log file in the temporary directory,
+             * unique to this test and process. The log and all files next
+             * to it, e.g. its index, are deleted on teardown.
+             */
+            std::filesystem::path tempLogPath(std::string const& name) {
+                std::string prefix = "pocolog_cpp_" + name + "." + std::to_string(getpid()) + "."
+                                     + std::to_string(tempPrefixes.size()) + ".";
+                tempPrefixes.push_back(prefix);
+                return std::filesystem::temp_directory_path() / (prefix + "0.log");
+            }
+
+            /** The compression codecs that the library was built with */
+            std::vector<CompressionCodec> availableCodecs(bool withNoCompression = false) {
+                std::vector<CompressionCodec> codecs;
+                if (withNoCompression) {
+                    codecs.push_back(NoCompression);
+                }
+                for (auto codec : { Lz4Compression, ZstdCompression, ZlibCompression }) {
+                    if (Compression::isAvailable(codec)) {
+                        codecs.push_back(codec);
+                    }
+                }
+                return codecs;
+            }
         };
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,88 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/LogFile.hpp>
+#include <pocolog_cpp/InputDataStream.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+/** Number of calls to the global operator new, replaced below for the whole test binary */
+static atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size) {
+    allocationCount++;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+struct AllocationsTest : public helpers::Test {
+    size_t countReplayAllocations(LogFile& logfile, size_t& samples) {
+        LogFile::SampleRef sample;
+        // the first pass creates the per-stream values and buffers
+        while (logfile.readNextSample(sample)) {
+        }
+        logfile.rewind();
+
+        samples = 0;
+        size_t before = allocationCount;
+        while (logfile.readNextSample(sample)) {
+            ++samples;
+        }
+        return allocationCount - before;
+    }
+};
+
+TEST_F(AllocationsTest, it_replays_a_mapped_log_file_without_allocating) {
+    auto& logfile = openFixtureLogfile("plain.0.log", true);
+    size_t samples;
+    ASSERT_EQ(0, countReplayAllocations(logfile, samples));
+    ASSERT_EQ(6, samples);
+}
+
+TEST_F(AllocationsTest, it_replays_an_unmapped_log_file_without_allocating) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    size_t samples;
+    ASSERT_EQ(0, countReplayAllocations(logfile, samples));
+    ASSERT_EQ(6, samples);
+}
+
+TEST_F(AllocationsTest, it_decodes_the_samples_in_the_slots_of_their_streams) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+
+    LogFile::SampleRef sample;
+    ASSERT_TRUE(logfile.readNextSample(sample));
+    OwnedValue const* slot = sample.value;
+    ASSERT_EQ(0, sample.streamIdx);
+    ASSERT_EQ(10, slot->get<int32_t>());
+
+    ASSERT_TRUE(logfile.readNextSample(sample));
+    ASSERT_EQ(slot, sample.value);
+    ASSERT_EQ(20, slot->get<int32_t>());
+}
+
+TEST_F(AllocationsTest, it_reads_typed_stream_samples_without_allocating) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = dynamic_cast<InputDataStream&>(logfile.getStream("a"));
+
+    int32_t value;
+    ASSERT_TRUE(stream.getSample(value, 0));
+    size_t before = allocationCount;
+    bool success = stream.getSample(value, 1) && stream.getSample(value, 2);
+    size_t allocations = allocationCount - before;
+    ASSERT_TRUE(success);
+    ASSERT_EQ(0, allocations);
+    ASSERT_EQ(30, value);
+}
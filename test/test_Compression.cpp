@@ -0,0 +1,259 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/Compression.hpp>
+#include <pocolog_cpp/Write.hpp>
+#include <pocolog_cpp/LogFile.hpp>
+#include <pocolog_cpp/InputDataStream.hpp>
+#include <fstream>
+#include <array>
+#include <cstring>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct CompressionTest : public helpers::Test {
+    string typeDef = plainTypeDef();
+    std::filesystem::path path = tempLogPath("compression");
+
+    /** Sample i of the test stream: mostly zeros, so that it compresses */
+    vector<int32_t> makeSample(int32_t i) {
+        vector<int32_t> sample(256, 0);
+        sample[0] = i;
+        sample[255] = -i;
+        return sample;
+    }
+
+    /** Writes numSamples samples of /int32_t[256] into a stream 'a'
+     * compressed with \c codec, and one incompressible sample into 'b' */
+    void writeLog(CompressionCodec codec, int32_t numSamples) {
+        ofstream file(path, ios::binary);
+        Output output(file);
+        vector<StreamMetadata> metadata = { { Compression::METADATA_KEY, Compression::getName(codec) } };
+        uint16_t a = output.newStreamIndex();
+        output.writeStreamDeclaration(a, DataStreamType, "a", "/int32_t[256]", typeDef, metadata);
+        uint16_t b = output.newStreamIndex();
+        output.writeStreamDeclaration(b, DataStreamType, "b", "/int32_t", typeDef, metadata);
+        for (int32_t i = 0; i < numSamples; ++i) {
+            base::Time time = base::Time::fromMicroseconds(1000 + i);
+            auto sample = makeSample(i);
+            output.writeSample(a, time, time, sample.data(), sample.size() * sizeof(int32_t));
+        }
+        int32_t small = 42;
+        output.writeSample(b, base::Time(), base::Time(), &small, sizeof(small));
+    }
+};
+
+TEST_F(CompressionTest, it_round_trips_payloads) {
+    if (availableCodecs().empty()) {
+        GTEST_SKIP() << "pocolog_cpp was built without compression support";
+    }
+    vector<uint8_t> payload(4096, 0);
+    payload[100] = 1;
+    for (auto codec : availableCodecs()) {
+        vector<uint8_t> compressed, decompressed;
+        ASSERT_TRUE(Compression::compress(codec, payload.data(), payload.size(), compressed));
+        ASSERT_LT(compressed.size(), payload.size());
+        Compression::decompress(codec, compressed.data(), compressed.size(), decompressed);
+        ASSERT_EQ(payload, decompressed);
+
+        uint8_t tiny[3] = { 1, 2, 3 };
+        ASSERT_FALSE(Compression::compress(codec, tiny, sizeof(tiny), compressed));
+    }
+}
+
+TEST_F(CompressionTest, it_round_trips_payloads_at_the_best_ratios) {
+    vector<uint8_t> payload(16 * 1024 * 1024, 0);
+    for (auto codec : availableCodecs()) {
+        vector<uint8_t> compressed, decompressed;
+        ASSERT_TRUE(Compression::compress(codec, payload.data(), payload.size(), compressed));
+        Compression::decompress(codec, compressed.data(), compressed.size(), decompressed);
+        ASSERT_EQ(payload, decompressed) << Compression::getName(codec);
+    }
+}
+
+TEST_F(CompressionTest, it_rejects_payloads_whose_size_does_not_match_the_compressed_data) {
+    vector<uint8_t> payload(4096, 0);
+    payload[100] = 1;
+    for (auto codec : availableCodecs()) {
+        vector<uint8_t> compressed, decompressed;
+        ASSERT_TRUE(Compression::compress(codec, payload.data(), payload.size(), compressed));
+        if (codec == ZlibCompression) {
+            // a zlib stream that does not end within the best ratio of deflate
+            compressed.resize(8);
+        }
+        else {
+            uint32_t corrupted = 0xfffffff0;
+            memcpy(compressed.data(), &corrupted, sizeof(corrupted));
+        }
+        ASSERT_THROW(Compression::decompress(codec, compressed.data(), compressed.size(), decompressed),
+                     std::runtime_error) << Compression::getName(codec);
+        ASSERT_LT(decompressed.capacity(), 1024 * 1024) << Compression::getName(codec);
+    }
+}
+
+TEST_F(CompressionTest, it_records_the_codec_in_the_stream_metadata) {
+    if (availableCodecs().empty()) {
+        GTEST_SKIP() << "pocolog_cpp was built without compression support";
+    }
+    for (auto codec : availableCodecs()) {
+        writeLog(codec, 1);
+        LogFile logfile(path.string());
+        ASSERT_EQ(codec, logfile.getStreamDescriptions()[0].getCompression());
+        ASSERT_EQ(Compression::getName(codec), logfile.getStreamDescriptions()[0].getMetadataMap().at(Compression::METADATA_KEY));
+        logfile.removeAllIndexes();
+    }
+}
+
+TEST_F(CompressionTest, it_decompresses_transparently_on_all_read_paths) {
+    if (availableCodecs().empty()) {
+        GTEST_SKIP() << "pocolog_cpp was built without compression support";
+    }
+    const int32_t numSamples = 10;
+    for (auto codec : availableCodecs()) {
+        writeLog(codec, numSamples);
+        ASSERT_LT(std::filesystem::file_size(path), numSamples * 1024);
+
+        for (bool mapped : { false, true }) {
+            LogFile logfile(path.string(), true, mapped);
+            for (int32_t i = 0; i < numSamples; ++i) {
+                auto [index, time, value] = logfile.readNextSample().value();
+                ASSERT_EQ(0, index);
+                auto const& sample = value.get<array<int32_t, 256>>();
+                ASSERT_EQ(makeSample(i), vector<int32_t>(sample.begin(), sample.end()));
+            }
+            auto [index, time, value] = logfile.readNextSample().value();
+            ASSERT_EQ(1, index);
+            ASSERT_EQ(42, value.get<int32_t>());
+
+            auto& stream = logfile.getStream("a");
+            ASSERT_EQ(codec, stream.getCompression());
+            vector<uint8_t> data;
+            ASSERT_TRUE(stream.getSampleData(data, 3));
+            ASSERT_EQ(1024, data.size());
+            ASSERT_EQ(3, reinterpret_cast<int32_t const*>(data.data())[0]);
+
+            FileView view;
+            ASSERT_TRUE(stream.getSampleView(view, 4));
+            ASSERT_EQ(1024, view.size);
+            ASSERT_EQ(-4, reinterpret_cast<int32_t const*>(view.data)[255]);
+
+            vector<vector<uint8_t>> results;
+            ASSERT_TRUE(stream.getSampleDataBatch(results, { 5, 0 }));
+            ASSERT_EQ(5, reinterpret_cast<int32_t const*>(results[0].data())[0]);
+            ASSERT_EQ(0, reinterpret_cast<int32_t const*>(results[1].data())[255]);
+
+            int32_t small = 0;
+            ASSERT_TRUE(logfile.getStream("b").readSample(small, 0));
+            ASSERT_EQ(42, small);
+            logfile.removeAllIndexes();
+        }
+    }
+}
+
+TEST_F(CompressionTest, it_reads_the_zlib_samples_of_the_ruby_tools) {
+    if (!Compression::isAvailable(ZlibCompression)) {
+        GTEST_SKIP() << "pocolog_cpp was built without zlib support";
+    }
+
+    // Zlib::Deflate.deflate of makeSample(7), written with the compressed
+    // flag set in a stream without codec
+    vector<uint8_t> deflated = { 0x78, 0x9c, 0x63, 0x67, 0x18, 0x05, 0xa3, 0x60, 0x14, 0x8c, 0x44,
+                                 0xf0, 0xf3, 0xff, 0xff, 0xff, 0x00, 0x29, 0xde, 0x03, 0xfe };
+    {
+        ofstream file(path, ios::binary);
+        Output output(file);
+        uint16_t a = output.newStreamIndex();
+        output.writeStreamDeclaration(a, DataStreamType, "a", "/int32_t[256]", typeDef, vector<StreamMetadata>());
+        vector<char> block(Output::DATA_BLOCK_HEADERS_SIZE + deflated.size());
+        Output::encodeSampleHeader(block.data(), a, base::Time(), base::Time(), deflated.size(), CompressedSample);
+        memcpy(block.data() + Output::DATA_BLOCK_HEADERS_SIZE, deflated.data(), deflated.size());
+        for (int i = 0; i < 3; ++i) {
+            output.writeEncoded(block.data(), block.size());
+        }
+    }
+
+    for (bool mapped : { false, true }) {
+        LogFile logfile(path.string(), true, mapped);
+        auto [index, time, value] = logfile.readNextSample().value();
+        auto const& sample = value.get<array<int32_t, 256>>();
+        ASSERT_EQ(makeSample(7), vector<int32_t>(sample.begin(), sample.end()));
+
+        auto& stream = logfile.getStream("a");
+        ASSERT_EQ(NoCompression, stream.getCompression());
+        vector<uint8_t> data;
+        ASSERT_TRUE(stream.getSampleData(data, 1));
+        ASSERT_EQ(1024, data.size());
+        ASSERT_EQ(-7, reinterpret_cast<int32_t const*>(data.data())[255]);
+
+        FileView view;
+        ASSERT_TRUE(stream.getSampleView(view, 2));
+        ASSERT_EQ(7, reinterpret_cast<int32_t const*>(view.data)[0]);
+
+        vector<vector<uint8_t>> results;
+        ASSERT_TRUE(stream.getSampleDataBatch(results, { 2, 0 }));
+        ASSERT_EQ(data, results[0]);
+        ASSERT_EQ(data, results[1]);
+
+        int32_t first = 0;
+        ASSERT_TRUE(stream.readSample(first, 0));
+        ASSERT_EQ(7, first);
+        logfile.removeAllIndexes();
+    }
+}
+
+TEST_F(CompressionTest, it_writes_zlib_samples_that_the_ruby_tools_can_read) {
+    if (!Compression::isAvailable(ZlibCompression)) {
+        GTEST_SKIP() << "pocolog_cpp was built without zlib support";
+    }
+
+    auto sample = makeSample(7);
+    vector<uint8_t> compressed, decompressed;
+    ASSERT_TRUE(Compression::compress(ZlibCompression, reinterpret_cast<uint8_t const*>(sample.data()),
+                                      sample.size() * sizeof(int32_t), compressed));
+    // a plain zlib stream, i.e. deflate with a valid zlib header and no
+    // size prefix
+    ASSERT_EQ(8, compressed[0] & 0x0f);
+    ASSERT_EQ(0, (compressed[0] * 256 + compressed[1]) % 31);
+    Compression::decompress(NoCompression, compressed.data(), compressed.size(), decompressed);
+    ASSERT_EQ(sample.size() * sizeof(int32_t), decompressed.size());
+    ASSERT_EQ(0, memcmp(sample.data(), decompressed.data(), decompressed.size()));
+}
+
+TEST_F(CompressionTest, it_opens_a_log_whose_codec_is_unknown_and_fails_on_its_compressed_samples) {
+    {
+        ofstream file(path, ios::binary);
+        Output output(file);
+        vector<StreamMetadata> metadata = { { Compression::METADATA_KEY, "none" } };
+        uint16_t a = output.newStreamIndex();
+        output.writeStreamDeclaration(a, DataStreamType, "a", "/int32_t", typeDef, metadata);
+        int32_t value = 42;
+        output.writeSample(a, base::Time(), base::Time(), &value, sizeof(value));
+        vector<char> block(Output::DATA_BLOCK_HEADERS_SIZE + sizeof(value));
+        Output::encodeSampleHeader(block.data(), a, base::Time(), base::Time(), sizeof(value), CompressedSample);
+        memcpy(block.data() + Output::DATA_BLOCK_HEADERS_SIZE, &value, sizeof(value));
+        output.writeEncoded(block.data(), block.size());
+    }
+
+    // a codec of a newer pocolog_cpp, that has the length of 'none'
+    string data = helpers::readFile(path);
+    string declared = Compression::METADATA_KEY + ": none";
+    size_t pos = data.find(declared);
+    ASSERT_NE(string::npos, pos);
+    data.replace(pos, declared.size(), Compression::METADATA_KEY + ": brtl");
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write(data.data(), data.size());
+    }
+
+    for (bool mapped : { false, true }) {
+        LogFile logfile(path.string(), true, mapped);
+        auto& stream = logfile.getStream("a");
+        ASSERT_EQ(NoCompression, stream.getCompression());
+        vector<uint8_t> sample;
+        ASSERT_TRUE(stream.getSampleData(sample, 0));
+        ASSERT_EQ(42, *reinterpret_cast<int32_t const*>(sample.data()));
+        ASSERT_THROW(stream.getSampleData(sample, 1), std::runtime_error);
+        FileView view;
+        ASSERT_THROW(stream.getSampleView(view, 1), std::runtime_error);
+        logfile.removeAllIndexes();
+    }
+}
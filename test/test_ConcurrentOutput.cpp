@@ -0,0 +1,104 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/ConcurrentOutput.hpp>
+#include <pocolog_cpp/Write.hpp>
+#include <pocolog_cpp/LogFile.hpp>
+#include <fstream>
+#include <thread>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct ConcurrentOutputTest : public helpers::Test {
+    string typeDef = plainTypeDef();
+    std::filesystem::path path = tempLogPath("concurrent_output");
+};
+
+TEST_F(ConcurrentOutputTest, it_writes_the_samples_of_all_producers) {
+    const int32_t numThreads = 4;
+    const int32_t numSamples = 5000;
+
+    {
+        ofstream file(path, ios::binary);
+        Output output(file, 4096);
+        output.setIndexFile(std::filesystem::path(path).replace_extension(".id2").string(), 1024);
+        ConcurrentOutput concurrent(output, 8, 64, ConcurrentOutput::BLOCK_PRODUCERS);
+
+        vector<thread> producers;
+        for (int32_t t = 0; t < numThreads; ++t) {
+            producers.emplace_back([&, t] {
+                uint16_t idx = concurrent.registerStream("s" + to_string(t), "/int32_t", typeDef, vector<StreamMetadata>());
+                for (int32_t i = 0; i < numSamples; ++i) {
+                    base::Time time = base::Time::fromMicroseconds(1000 + i);
+                    ASSERT_TRUE(concurrent.writeSample(idx, time, time, &i, sizeof(i)));
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        concurrent.flush();
+        ASSERT_EQ(0, concurrent.getDroppedSamples());
+        ASSERT_EQ(numThreads * numSamples, concurrent.getWrittenSamples());
+    }
+
+    LogFile logfile(path.string(), false);
+    ASSERT_EQ(numThreads, logfile.getStreamDescriptions().size());
+    for (int32_t t = 0; t < numThreads; ++t) {
+        ASSERT_EQ(numSamples, logfile.getStream("s" + to_string(t)).getSize());
+    }
+    vector<int32_t> next(numThreads, 0);
+    while (auto sample = logfile.readNextSample()) {
+        auto [index, time, value] = *sample;
+        ASSERT_EQ(next[index], value.get<int32_t>());
+        ASSERT_EQ(1000 + next[index], time.toMicroseconds());
+        next[index]++;
+    }
+    ASSERT_EQ(vector<int32_t>(numThreads, numSamples), next);
+}
+
+TEST_F(ConcurrentOutputTest, it_drops_and_counts_samples_bigger_than_the_maximum_size) {
+    ofstream file(path, ios::binary);
+    Output output(file);
+    ConcurrentOutput concurrent(output, 8, 4);
+    uint16_t idx = concurrent.registerStream("a", "/int32_t", typeDef, vector<StreamMetadata>());
+
+    int64_t big = 0;
+    int32_t small = 0;
+    ASSERT_FALSE(concurrent.writeSample(idx, base::Time(), base::Time(), &big, sizeof(big)));
+    ASSERT_TRUE(concurrent.writeSample(idx, base::Time(), base::Time(), &small, sizeof(small)));
+    concurrent.flush();
+    ASSERT_EQ(1, concurrent.getDroppedSamples());
+    ASSERT_EQ(1, concurrent.getWrittenSamples());
+}
+
+/** Stream buffer that fails all writes once broken */
+struct BreakableBuf : public std::streambuf {
+    bool broken = false;
+
+    int overflow(int c) override {
+        return broken ? traits_type::eof() : traits_type::not_eof(c);
+    }
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return broken ? 0 : count;
+    }
+};
+
+TEST_F(ConcurrentOutputTest, it_reports_the_errors_of_the_output) {
+    BreakableBuf buffer;
+    ostream stream(&buffer);
+    stream.exceptions(ios::badbit);
+    Output output(stream);
+    {
+        ConcurrentOutput concurrent(output, 8, 64);
+        buffer.broken = true;
+        uint16_t idx = concurrent.registerStream("a", "/int32_t", typeDef, vector<StreamMetadata>());
+        ASSERT_THROW(concurrent.flush(), ios::failure);
+
+        int32_t value = 0;
+        ASSERT_FALSE(concurrent.writeSample(idx, base::Time(), base::Time(), &value, sizeof(value)));
+        ASSERT_EQ(0, concurrent.getWrittenSamples());
+        ASSERT_EQ(1, concurrent.getDroppedSamples());
+        ASSERT_THROW(concurrent.flush(), ios::failure);
+    }
+    stream.exceptions(ios::goodbit);
+}
@@ -0,0 +1,96 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/FileStream.hpp>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct FileStreamTest : public ::testing::Test {
+    vector<char> readAll(FileStream& stream, size_t chunkSize) {
+        vector<char> result(stream.size());
+        for (size_t pos = 0; pos < result.size(); pos += chunkSize) {
+            size_t size = min(chunkSize, result.size() - pos);
+            stream.read(result.data() + pos, size);
+            if (!stream.good()) {
+                throw runtime_error("read failed");
+            }
+        }
+        return result;
+    }
+
+    vector<char> readReference(string const& path) {
+        ifstream file(path, ios::binary);
+        return vector<char>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+};
+
+TEST_F(FileStreamTest, it_returns_the_same_data_regardless_of_the_read_ahead_window) {
+    auto path = helpers::fixturePath("vector.0.log").string();
+    auto expected = readReference(path);
+
+    for (size_t readAhead : { size_t(0), size_t(1), size_t(1024 * 1024) }) {
+        for (size_t chunk : { size_t(1), size_t(7), size_t(4096), expected.size() }) {
+            FileStream stream;
+            stream.setReadAheadSize(readAhead);
+            ASSERT_TRUE(stream.open(path.c_str(), ios::in | ios::binary));
+            ASSERT_EQ(expected, readAll(stream, chunk));
+        }
+    }
+}
+
+TEST_F(FileStreamTest, it_reads_from_a_memory_mapped_file) {
+    auto path = helpers::fixturePath("vector.0.log").string();
+    auto expected = readReference(path);
+
+    FileStream stream;
+    ASSERT_TRUE(stream.open(path.c_str(), ios::in | ios::binary, true));
+    ASSERT_TRUE(stream.isMemoryMapped());
+    ASSERT_EQ(expected, readAll(stream, 13));
+
+    FileView view = stream.view(4, 10);
+    ASSERT_EQ(vector<char>(expected.begin() + 4, expected.begin() + 14),
+              vector<char>(view.begin(), view.end()));
+}
+
+TEST_F(FileStreamTest, it_flags_reads_past_the_end_of_file) {
+    auto path = helpers::fixturePath("plain.0.log").string();
+
+    FileStream stream(path.c_str(), ios::in | ios::binary);
+    vector<char> buffer(stream.size() + 1);
+    stream.read(buffer.data(), buffer.size());
+    ASSERT_FALSE(stream.good());
+}
+
+TEST_F(FileStreamTest, it_performs_batched_reads_in_any_order) {
+    auto path = helpers::fixturePath("vector.0.log").string();
+    auto expected = readReference(path);
+
+    for (bool mapped : { false, true }) {
+        FileStream stream;
+        ASSERT_TRUE(stream.open(path.c_str(), ios::in | ios::binary, mapped));
+
+        vector<pair<off_t, size_t>> ranges = { { 100, 10 }, { 3, 5 }, { 8, 2 }, { 0, 20 }, { 50, 0 } };
+        vector<vector<char>> buffers;
+        vector<FileStream::ReadRequest> requests;
+        for (auto r : ranges) {
+            buffers.emplace_back(r.second);
+        }
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            requests.push_back({ ranges[i].first, ranges[i].second, buffers[i].data() });
+        }
+        ASSERT_TRUE(stream.readBatch(requests));
+
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            auto begin = expected.begin() + ranges[i].first;
+            ASSERT_EQ(vector<char>(begin, begin + ranges[i].second), buffers[i]);
+        }
+    }
+}
+
+TEST_F(FileStreamTest, it_rejects_batched_reads_past_the_end_of_file) {
+    auto path = helpers::fixturePath("plain.0.log").string();
+
+    FileStream stream(path.c_str(), ios::in | ios::binary);
+    vector<char> buffer(10);
+    vector<FileStream::ReadRequest> requests = { { stream.size() - 5, 10, buffer.data() } };
+    ASSERT_FALSE(stream.readBatch(requests));
+}
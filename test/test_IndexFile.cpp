@@ -0,0 +1,171 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/IndexFile.hpp>
+#include <pocolog_cpp/Index.hpp>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct IndexFileTest : public helpers::Test {
+    vector<filesystem::path> createdFiles;
+    /** The ranges scanned in parallel by the last createIndex */
+    size_t scannedRanges = 0;
+
+    ~IndexFileTest() {
+        for (auto const& p : createdFiles) {
+            filesystem::remove(p);
+        }
+    }
+
+    vector<char> createIndex(LogFile& logfile, string const& suffix,
+                             size_t numThreads, off_t minRangeSize) {
+        filesystem::path path = logfile.getFileBaseName() + suffix;
+        createdFiles.push_back(path);
+
+        logfile.rewind();
+        IndexFile index(logfile);
+        index.createIndexFile(path.string(), logfile, numThreads, minRangeSize);
+        scannedRanges = index.getScannedRanges();
+        logfile.rewind();
+
+        ifstream file(path, ios::binary);
+        return vector<char>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+};
+
+TEST_F(IndexFileTest, the_parallel_indexer_creates_the_same_index_than_the_sequential_one) {
+    for (auto fixture : { "plain.0.log", "vector.0.log", "opaques.0.log", "metadata.0.log" }) {
+        auto& logfile = openFixtureLogfile(fixture);
+        auto expected = createIndex(logfile, ".seq.id2", 1, 1);
+        ASSERT_FALSE(expected.empty());
+        ASSERT_EQ(1, scannedRanges);
+
+        for (size_t numThreads : { 2, 3, 8 }) {
+            auto actual = createIndex(logfile, ".par.id2", numThreads, 1);
+            ASSERT_EQ(numThreads, scannedRanges) << fixture << " fell back to the sequential scan";
+            ASSERT_EQ(expected, actual) << fixture << " with " << numThreads << " threads";
+        }
+    }
+}
+
+TEST_F(IndexFileTest, it_only_indexes_the_new_blocks_of_a_growing_log_file) {
+    auto fixture = helpers::fixturePath("plain.0.log");
+    auto path = tempLogPath("growing");
+    auto indexPath = filesystem::path(path).replace_extension(".id2");
+
+    ifstream fixtureFile(fixture, ios::binary);
+    vector<char> data((istreambuf_iterator<char>(fixtureFile)), istreambuf_iterator<char>());
+    //cut the file in the middle of a block
+    size_t cut = data.size() - 10;
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write(data.data(), cut);
+    }
+    {
+        LogFile logfile(path.string());
+        ASSERT_EQ(2, logfile.getStream("b").getFileIndex().getNumSamples());
+    }
+
+    {
+        ofstream file(path, ios::binary | ios::app);
+        file.write(data.data() + cut, data.size() - cut);
+    }
+    vector<char> updated;
+    {
+        LogFile logfile(path.string());
+        auto& index = logfile.getStream("b").getFileIndex();
+        ASSERT_EQ(3, index.getNumSamples());
+        ASSERT_EQ(index.getSampleTime(2), index.getLastSampleTime());
+
+        ifstream file(indexPath, ios::binary);
+        updated.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+
+    LogFile logfile(path.string());
+    auto expected = createIndex(logfile, ".full.id2", 1, 1);
+    ASSERT_EQ(expected, updated);
+}
+
+TEST_F(IndexFileTest, it_copies_a_mapped_index_when_a_sample_is_added) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = logfile.getStream("b");
+    auto& fileIndex = stream.getFileIndex();
+    vector<Index::IndexInfo> expected(fileIndex.getIndexData(), fileIndex.getIndexData() + fileIndex.getNumSamples());
+    ASSERT_FALSE(expected.empty());
+
+    FileStream indexFile;
+    ASSERT_TRUE(indexFile.open((logfile.getFileBaseName() + ".id2").c_str(), ios::in | ios::binary, true));
+    ASSERT_TRUE(indexFile.isMemoryMapped());
+    Index index(indexFile, stream.getIndex());
+    auto mapped = reinterpret_cast<const uint8_t*>(index.getIndexData());
+    ASSERT_TRUE(mapped >= indexFile.view(0, indexFile.size()).begin());
+    ASSERT_TRUE(mapped < indexFile.view(0, indexFile.size()).end());
+    base::Time firstTime = index.getFirstSampleTime();
+
+    base::Time time = index.getLastSampleTime() + base::Time::fromMicroseconds(10);
+    base::Time logicalTime = time + base::Time::fromMicroseconds(5);
+    index.addSample(4242, time, logicalTime, 12);
+
+    ASSERT_NE(mapped, reinterpret_cast<const uint8_t*>(index.getIndexData()));
+    ASSERT_EQ(expected.size() + 1, index.getNumSamples());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(expected[i].samplePosInLogFile, index.getSamplePos(i));
+        ASSERT_EQ(expected[i].sampleTime, index.getSampleTime(i).toMicroseconds());
+        ASSERT_EQ(expected[i].sampleLogicalTime, index.getSampleLogicalTime(i).toMicroseconds());
+        ASSERT_EQ(expected[i].sampleDataSize, index.getSampleSize(i));
+    }
+    size_t last = expected.size();
+    ASSERT_EQ(4242, index.getSamplePos(last));
+    ASSERT_EQ(time, index.getSampleTime(last));
+    ASSERT_EQ(logicalTime, index.getSampleLogicalTime(last));
+    ASSERT_EQ(12, index.getSampleSize(last));
+    ASSERT_EQ(firstTime, index.getFirstSampleTime());
+    ASSERT_EQ(time, index.getLastSampleTime());
+
+    // the mapped file is left untouched
+    ASSERT_EQ(expected.size(), fileIndex.getNumSamples());
+}
+
+TEST_F(IndexFileTest, concurrent_writers_of_an_index_leave_a_complete_one) {
+    auto dir = filesystem::temp_directory_path() / ("pocolog_cpp_concurrent_index." + to_string(getpid()));
+    filesystem::create_directories(dir);
+    auto path = dir / "log.0.id2";
+
+    atomic<bool> failed(false);
+    vector<thread> writers;
+    for (size_t t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t] {
+            vector<Index> indices;
+            indices.emplace_back(0, "a", 0);
+            for (size_t i = 0; i <= t * 150000; ++i) {
+                base::Time time = base::Time::fromMicroseconds(i);
+                indices[0].addSample(i, time, time, 4);
+            }
+            try {
+                for (int i = 0; i < 5; ++i) {
+                    IndexFile::writeIndexFile(path.string(), indices, 100, 100);
+                }
+            }
+            catch (std::exception const&) {
+                failed = true;
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    ASSERT_FALSE(failed);
+
+    // no temporary file is left behind
+    ASSERT_EQ(1, distance(filesystem::directory_iterator(dir), filesystem::directory_iterator()));
+    FileStream indexFile;
+    ASSERT_TRUE(indexFile.open(path.string().c_str(), ios::in | ios::binary));
+    Index index(indexFile, 0);
+    ASSERT_EQ(0, (index.getNumSamples() - 1) % 150000);
+    ASSERT_EQ(sizeof(IndexFile::IndexFileHeader) + Index::getPrologueSize() + index.getNumSamples() * sizeof(Index::IndexInfo),
+              filesystem::file_size(path));
+    indexFile.close();
+    filesystem::remove_all(dir);
+}
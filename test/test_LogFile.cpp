@@ -1,5 +1,9 @@
 #include "Helpers.hpp"
 #include <pocolog_cpp/LogFile.hpp>
+#include <pocolog_cpp/Index.hpp>
+#include <pocolog_cpp/InputDataStream.hpp>
+#include <fstream>
+#include <thread>
 
 using namespace pocolog_cpp;
 using namespace std;
@@ -18,6 +22,12 @@ TEST_F(LogFileTest, it_returns_the_description_of_the_streams) {
     ASSERT_EQ("/float", descriptions[1].getTypeName());
 }
 
+TEST_F(LogFileTest, it_scans_for_the_index_with_one_thread_per_core_unless_told_otherwise) {
+    ASSERT_EQ(std::max(1u, std::thread::hardware_concurrency()), openFixtureLogfile("plain.0.log").getIndexThreads());
+    LogFile logfile(helpers::fixturePath("plain.0.log").string(), false, false, 3);
+    ASSERT_EQ(3, logfile.getIndexThreads());
+}
+
 TEST_F(LogFileTest, it_reads_samples_sequentially) {
     auto& logfile = openFixtureLogfile("plain.0.log");
 
@@ -80,4 +90,221 @@ TEST_F(LogFileTest, it_rewinds) {
         ASSERT_EQ(0, index);
         ASSERT_EQ(10, value.get<int32_t>());
     }
-}
\ No newline at end of file
+}
+
+TEST_F(LogFileTest, it_reads_samples_from_a_memory_mapped_file) {
+    auto& logfile = openFixtureLogfile("plain.0.log", true);
+
+    {
+        auto [index, time, value] = logfile.readNextSample().value();
+        ASSERT_EQ(0, index);
+        ASSERT_EQ(10, value.get<int32_t>());
+    }
+
+    FileView view;
+    ASSERT_TRUE(logfile.getSampleView(view));
+    ASSERT_EQ(sizeof(int32_t), view.size);
+    ASSERT_EQ(10, *reinterpret_cast<int32_t const*>(view.data));
+}
+
+TEST_F(LogFileTest, it_gives_access_to_stream_samples_without_copy) {
+    auto& logfile = openFixtureLogfile("plain.0.log", true);
+    auto& stream = logfile.getStream("b");
+
+    FileView view;
+    ASSERT_TRUE(stream.getSampleView(view, 1));
+    ASSERT_EQ(sizeof(float), view.size);
+    ASSERT_FLOAT_EQ(0.2, *reinterpret_cast<float const*>(view.data));
+}
+
+TEST_F(LogFileTest, it_falls_back_to_a_copy_for_stream_sample_views) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = logfile.getStream("b");
+
+    FileView view;
+    ASSERT_TRUE(stream.getSampleView(view, 2));
+    ASSERT_EQ(sizeof(float), view.size);
+    ASSERT_FLOAT_EQ(0.3, *reinterpret_cast<float const*>(view.data));
+}
+
+TEST_F(LogFileTest, it_gives_typed_views_on_samples_with_a_plain_layout) {
+    auto& logfile = openFixtureLogfile("plain.0.log", true);
+    auto& stream = dynamic_cast<InputDataStream&>(logfile.getStream("b"));
+    ASSERT_TRUE(stream.hasPlainLayout());
+
+    for (size_t i = 0; i < 3; ++i) {
+        float const* sample = stream.getSampleView<float>(i);
+        ASSERT_NE(nullptr, sample);
+        ASSERT_FLOAT_EQ(0.1 * (i + 1), *sample);
+    }
+    ASSERT_THROW(stream.getSampleView<double>(0), std::logic_error);
+}
+
+TEST_F(LogFileTest, it_gives_typed_views_on_samples_of_unmapped_files) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = dynamic_cast<InputDataStream&>(logfile.getStream("a"));
+
+    int32_t const* sample = stream.getSampleView<int32_t>(2);
+    ASSERT_NE(nullptr, sample);
+    ASSERT_EQ(30, *sample);
+}
+
+TEST_F(LogFileTest, it_reads_samples_sequentially_with_prefetching) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    logfile.setPrefetchDepth(2);
+
+    std::vector<int32_t> a_values;
+    std::vector<float> b_values;
+    while (auto sample = logfile.readNextSample()) {
+        auto& [index, time, value] = *sample;
+        if (index == 0) {
+            a_values.push_back(value.get<int32_t>());
+        }
+        else {
+            b_values.push_back(value.get<float>());
+        }
+    }
+
+    ASSERT_EQ(std::vector<int32_t>({ 10, 20, 30 }), a_values);
+    ASSERT_EQ(3, b_values.size());
+    ASSERT_FLOAT_EQ(0.3, b_values[2]);
+    ASSERT_FALSE(logfile.readNextSample().has_value());
+}
+
+TEST_F(LogFileTest, it_rewinds_while_prefetching) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    logfile.setPrefetchDepth(1);
+
+    {
+        auto [index, time, value] = logfile.readNextSample().value();
+        ASSERT_EQ(10, value.get<int32_t>());
+    }
+
+    logfile.rewind();
+
+    {
+        auto [index, time, value] = logfile.readNextSample().value();
+        ASSERT_EQ(10, value.get<int32_t>());
+    }
+}
+
+TEST_F(LogFileTest, it_loads_a_batch_of_samples_in_the_requested_order) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = logfile.getStream("a");
+
+    std::vector<std::vector<uint8_t>> results;
+    ASSERT_TRUE(stream.getSampleDataBatch(results, { 2, 0, 1, 2 }));
+    ASSERT_EQ(4, results.size());
+
+    std::vector<int32_t> values;
+    for (auto const& r : results) {
+        ASSERT_EQ(sizeof(int32_t), r.size());
+        values.push_back(*reinterpret_cast<int32_t const*>(r.data()));
+    }
+    ASSERT_EQ(std::vector<int32_t>({ 30, 10, 20, 30 }), values);
+}
+
+TEST_F(LogFileTest, it_stores_the_sample_sizes_in_the_index) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& index = logfile.getStream("a").getFileIndex();
+
+    ASSERT_EQ(3, index.getNumSamples());
+    for (size_t i = 0; i < index.getNumSamples(); ++i) {
+        ASSERT_EQ(sizeof(int32_t), index.getSampleSize(i));
+    }
+}
+
+TEST_F(LogFileTest, it_rebuilds_an_outdated_index) {
+    auto path = helpers::fixturePath("plain.0.log");
+    auto indexPath = path;
+    indexPath.replace_extension(".id2");
+    {
+        std::ofstream outdated(indexPath, std::ios::binary);
+        char header[12] = "IndexV2";
+        outdated.write(header, sizeof(header));
+    }
+
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    ASSERT_EQ(2, logfile.getStreams().size());
+
+    std::vector<uint8_t> data;
+    ASSERT_TRUE(logfile.getStream("a").getSampleData(data, 1));
+    ASSERT_EQ(20, *reinterpret_cast<int32_t const*>(data.data()));
+
+    std::ifstream rebuilt(indexPath, std::ios::binary);
+    char magic[8];
+    rebuilt.read(magic, sizeof(magic));
+    ASSERT_EQ(std::string("IndexV4"), std::string(magic));
+}
+
+TEST_F(LogFileTest, it_finds_samples_by_time) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = logfile.getStream("a");
+    auto& index = stream.getFileIndex();
+    auto us = base::Time::fromMicroseconds(1);
+
+    base::Time t0 = index.getSampleTime(0);
+    base::Time t1 = index.getSampleTime(1);
+    base::Time t2 = index.getSampleTime(2);
+
+    ASSERT_EQ(0, stream.findSampleAtOrAfter(t0 - us));
+    ASSERT_EQ(1, stream.findSampleAtOrAfter(t1));
+    ASSERT_EQ(2, stream.findSampleAtOrAfter(t1 + us));
+    ASSERT_EQ(3, stream.findSampleAtOrAfter(t2 + us));
+
+    ASSERT_EQ(3, stream.findSampleBefore(t0 - us));
+    ASSERT_EQ(0, stream.findSampleBefore(t1 - us));
+    ASSERT_EQ(1, stream.findSampleBefore(t1));
+    ASSERT_EQ(2, stream.findSampleBefore(t2 + us));
+}
+
+TEST_F(LogFileTest, it_follows_a_log_file_that_is_being_written) {
+    ifstream fixture(helpers::fixturePath("plain.0.log"), ios::binary);
+    vector<char> data((istreambuf_iterator<char>(fixture)), istreambuf_iterator<char>());
+
+    // cut in the middle of the second sample of a, before the declaration of b
+    size_t cut = 440;
+    auto path = tempLogPath("follow");
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write(data.data(), cut);
+    }
+
+    auto logfile = std::make_unique<LogFile>(path.string());
+    ASSERT_EQ(1, logfile->getStreams().size());
+    logfile->setFollow(true, base::Time::fromMicroseconds(5000000));
+
+    std::thread writer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ofstream file(path, ios::binary | ios::app);
+        file.write(data.data() + cut, 740 - cut);
+        file.flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        file.write(data.data() + 740, data.size() - 740);
+    });
+
+    vector<pair<uint16_t, int32_t>> expected = { { 0, 10 }, { 0, 20 }, { 0, 30 } };
+    for (auto e : expected) {
+        auto [index, time, value] = logfile->readNextSample().value();
+        ASSERT_EQ(e.first, index);
+        ASSERT_EQ(e.second, value.get<int32_t>());
+    }
+    for (float e : { 0.1f, 0.2f, 0.3f }) {
+        auto [index, time, value] = logfile->readNextSample().value();
+        ASSERT_EQ(1, index);
+        ASSERT_FLOAT_EQ(e, value.get<float>());
+    }
+    writer.join();
+
+    logfile->setFollow(true, base::Time::fromMicroseconds(10000));
+    ASSERT_FALSE(logfile->readNextSample().has_value());
+
+    ASSERT_EQ(3, logfile->getStream("a").getSize());
+    auto& b = logfile->getStream("b");
+    ASSERT_EQ(3, b.getSize());
+    std::vector<uint8_t> sample;
+    ASSERT_TRUE(b.getSampleData(sample, 2));
+    ASSERT_FLOAT_EQ(0.3f, *reinterpret_cast<float const*>(sample.data()));
+
+    logfile->removeAllIndexes();
+}
@@ -0,0 +1,39 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/MarshallingPlan.hpp>
+#include <pocolog_cpp/InputDataStream.hpp>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct MarshallingPlanTest : public helpers::Test {
+};
+
+TEST_F(MarshallingPlanTest, it_decodes_flat_types_with_a_copy) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto const& plan = logfile.getStreamDescriptions()[0].getMarshallingPlan();
+    ASSERT_TRUE(plan.isFlat());
+
+    int32_t value = 0;
+    int32_t marshalled = 42;
+    plan.load(reinterpret_cast<uint8_t*>(&value), reinterpret_cast<uint8_t*>(&marshalled), sizeof(marshalled));
+    ASSERT_EQ(42, value);
+}
+
+TEST_F(MarshallingPlanTest, it_rejects_samples_that_do_not_match_the_type) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto const& plan = logfile.getStreamDescriptions()[0].getMarshallingPlan();
+
+    int32_t value = 0;
+    uint8_t marshalled[2] = { 0, 0 };
+    ASSERT_ANY_THROW(plan.load(reinterpret_cast<uint8_t*>(&value), marshalled, sizeof(marshalled)));
+}
+
+TEST_F(MarshallingPlanTest, it_is_used_by_the_stream_accessors) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto& stream = dynamic_cast<InputDataStream&>(logfile.getStream("a"));
+    ASSERT_EQ(stream.getType(), &stream.getMarshallingPlan().getType());
+
+    int32_t value = 0;
+    ASSERT_TRUE(stream.getSample(value, 1));
+    ASSERT_EQ(20, value);
+}
@@ -0,0 +1,233 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/MultiFileIndex.hpp>
+#include <pocolog_cpp/Stream.hpp>
+#include <thread>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct MultiFileIndexTest : public helpers::Test {
+    base::Time sampleTime(MultiFileIndex const& index, size_t i) {
+        return index.getSampleStream(i)->getFileIndex().getSampleTime(index.getPosInStream(i));
+    }
+};
+
+TEST_F(MultiFileIndexTest, it_orders_the_samples_of_all_streams_by_time) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    MultiFileIndex index(false);
+    index.setUseCache(false);
+    index.createIndex(vector<LogFile*> { &logfile });
+
+    ASSERT_EQ(6, index.getSize());
+    map<Stream*, size_t> nextSample;
+    for (size_t i = 0; i < index.getSize(); ++i) {
+        if (i > 0) {
+            ASSERT_LE(sampleTime(index, i - 1), sampleTime(index, i));
+        }
+        ASSERT_EQ(nextSample[index.getSampleStream(i)]++, index.getPosInStream(i));
+    }
+}
+
+TEST_F(MultiFileIndexTest, it_keeps_the_stream_order_for_samples_with_the_same_time) {
+    auto& first = openFixtureLogfile("plain.0.log");
+    auto& second = openFixtureLogfile("plain.0.log");
+    MultiFileIndex index(false);
+    index.setUseCache(false);
+    index.createIndex(vector<LogFile*> { &first, &second });
+
+    ASSERT_EQ(12, index.getSize());
+    for (size_t i = 0; i < index.getSize(); i += 2) {
+        ASSERT_EQ(sampleTime(index, i), sampleTime(index, i + 1));
+        ASSERT_EQ(index.getGlobalStreamIdx(i) + 2, index.getGlobalStreamIdx(i + 1));
+    }
+}
+
+TEST_F(MultiFileIndexTest, it_reuses_the_cached_ordering) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    MultiFileIndex first(false);
+    first.setUseCache(true);
+    first.createIndex(vector<LogFile*> { &logfile });
+    ASSERT_FALSE(first.isLoadedFromCache());
+
+    MultiFileIndex second(false);
+    second.setUseCache(true);
+    second.createIndex(vector<LogFile*> { &logfile });
+    second.removeCache();
+    ASSERT_TRUE(second.isLoadedFromCache());
+
+    ASSERT_EQ(first.getSize(), second.getSize());
+    for (size_t i = 0; i < first.getSize(); ++i) {
+        ASSERT_EQ(first.getSampleStream(i), second.getSampleStream(i));
+        ASSERT_EQ(first.getPosInStream(i), second.getPosInStream(i));
+    }
+}
+
+TEST_F(MultiFileIndexTest, it_rebuilds_a_corrupted_cache) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    MultiFileIndex first(false);
+    first.setUseCache(true);
+    first.createIndex(vector<LogFile*> { &logfile });
+
+    // the last entry refers to a stream that does not exist
+    {
+        fstream cache(logfile.getFileBaseName() + ".mfi", ios::in | ios::out | ios::binary);
+        cache.seekp(-8, ios::end);
+        uint64_t entry = ~uint64_t(0);
+        cache.write(reinterpret_cast<char const*>(&entry), sizeof(entry));
+    }
+
+    MultiFileIndex second(false);
+    second.setUseCache(true);
+    second.createIndex(vector<LogFile*> { &logfile });
+    ASSERT_FALSE(second.isLoadedFromCache());
+    ASSERT_EQ(first.getSize(), second.getSize());
+    for (size_t i = 0; i < first.getSize(); ++i) {
+        ASSERT_EQ(first.getSampleStream(i), second.getSampleStream(i));
+        ASSERT_EQ(first.getPosInStream(i), second.getPosInStream(i));
+    }
+
+    // the cache got rebuilt
+    MultiFileIndex third(false);
+    third.setUseCache(true);
+    third.createIndex(vector<LogFile*> { &logfile });
+    third.removeCache();
+    ASSERT_TRUE(third.isLoadedFromCache());
+}
+
+TEST_F(MultiFileIndexTest, it_does_not_use_the_cache_if_the_selected_streams_changed) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    MultiFileIndex first(false);
+    first.setUseCache(true);
+    first.createIndex(vector<LogFile*> { &logfile });
+
+    MultiFileIndex second(false);
+    second.setUseCache(true);
+    second.registerStreamCheck([](Stream* stream) { return stream->getName() == "a"; });
+    second.createIndex(vector<LogFile*> { &logfile });
+    second.removeCache();
+    ASSERT_FALSE(second.isLoadedFromCache());
+    ASSERT_EQ(3, second.getSize());
+}
+
+TEST_F(MultiFileIndexTest, it_does_not_write_a_cache_unless_asked_to) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    MultiFileIndex index(false);
+    index.createIndex(vector<LogFile*> { &logfile });
+    ASSERT_FALSE(index.isLoadedFromCache());
+    ASSERT_FALSE(filesystem::exists(logfile.getFileBaseName() + ".mfi"));
+}
+
+TEST_F(MultiFileIndexTest, it_creates_the_index_if_the_cache_can_not_be_written) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    // the cache file can not replace a directory
+    filesystem::path cachePath(logfile.getFileBaseName() + ".mfi");
+    filesystem::create_directory(cachePath);
+
+    MultiFileIndex index(false);
+    index.setUseCache(true);
+    bool created = index.createIndex(vector<LogFile*> { &logfile });
+    ASSERT_TRUE(filesystem::is_directory(cachePath));
+    filesystem::remove(cachePath);
+    ASSERT_TRUE(created);
+    ASSERT_FALSE(index.isLoadedFromCache());
+
+    // the temporary file is removed
+    for (auto const& entry : filesystem::directory_iterator(cachePath.parent_path())) {
+        ASSERT_EQ(string::npos, entry.path().string().find(".mfi")) << entry.path();
+    }
+
+    size_t numSamples = 0;
+    for (auto stream : logfile.getStreams()) {
+        numSamples += stream->getSize();
+    }
+    ASSERT_EQ(numSamples, index.getSize());
+}
+
+TEST_F(MultiFileIndexTest, it_replaces_the_index_of_a_previous_call) {
+    auto plain = helpers::fixturePath("plain.0.log").string();
+    vector<string> fileNames { plain, helpers::fixturePath("vector.0.log").string() };
+
+    MultiFileIndex index(false);
+    index.createIndex(fileNames);
+    size_t numStreams = index.getAllStreams().size();
+    size_t numSamples = index.getSize();
+    index.createIndex(fileNames);
+    ASSERT_EQ(fileNames.size(), index.getLogFiles().size());
+    ASSERT_EQ(numStreams, index.getAllStreams().size());
+    ASSERT_EQ(numSamples, index.getSize());
+
+    index.createIndex(vector<string> { plain });
+    ASSERT_EQ(1, index.getLogFiles().size());
+    ASSERT_EQ(index.getLogFiles()[0]->getStreams().size(), index.getAllStreams().size());
+    for (size_t i = 0; i < index.getSize(); ++i) {
+        ASSERT_EQ(plain, index.getSampleStream(i)->getDescription().getFileName());
+    }
+
+    index.getLogFiles()[0]->removeAllIndexes();
+    filesystem::remove(helpers::fixturePath("vector.0.id2"));
+}
+
+TEST_F(MultiFileIndexTest, it_opens_the_log_files_concurrently_in_file_order) {
+    vector<string> fileNames;
+    for (auto name : { "plain.0.log", "vector.0.log", "metadata.0.log", "opaques.0.log" }) {
+        fileNames.push_back(helpers::fixturePath(name).string());
+    }
+
+    MultiFileIndex serial(false);
+    serial.setUseCache(false);
+    serial.setLoadThreads(1);
+    serial.createIndex(fileNames);
+
+    MultiFileIndex parallel(false);
+    parallel.setUseCache(false);
+    parallel.setLoadThreads(4);
+    parallel.createIndex(fileNames);
+
+    ASSERT_EQ(fileNames.size(), parallel.getLogFiles().size());
+    for (size_t i = 0; i < fileNames.size(); ++i) {
+        ASSERT_EQ(fileNames[i], parallel.getLogFiles()[i]->getFileName());
+    }
+    ASSERT_EQ(serial.getAllStreams().size(), parallel.getAllStreams().size());
+    for (size_t i = 0; i < serial.getAllStreams().size(); ++i) {
+        ASSERT_EQ(serial.getAllStreams()[i]->getName(), parallel.getAllStreams()[i]->getName());
+    }
+    ASSERT_EQ(serial.getSize(), parallel.getSize());
+    for (size_t i = 0; i < serial.getSize(); ++i) {
+        ASSERT_EQ(serial.getGlobalStreamIdx(i), parallel.getGlobalStreamIdx(i));
+        ASSERT_EQ(serial.getPosInStream(i), parallel.getPosInStream(i));
+    }
+
+    for (auto logfile : parallel.getLogFiles()) {
+        logfile->removeAllIndexes();
+    }
+}
+
+TEST_F(MultiFileIndexTest, it_divides_the_cores_among_the_index_scans_of_the_log_files) {
+    vector<string> fileNames;
+    for (auto name : { "plain.0.log", "vector.0.log", "metadata.0.log", "opaques.0.log" }) {
+        fileNames.push_back(helpers::fixturePath(name).string());
+    }
+
+    size_t cores = std::thread::hardware_concurrency();
+    for (size_t loadThreads : { 1, 2, 4, 8 }) {
+        MultiFileIndex index(false);
+        index.setUseCache(false);
+        index.setLoadThreads(loadThreads);
+        index.createIndex(fileNames);
+        size_t expected = std::max<size_t>(1, cores / std::min(loadThreads, fileNames.size()));
+        for (auto logfile : index.getLogFiles()) {
+            ASSERT_EQ(expected, logfile->getIndexThreads());
+            logfile->removeAllIndexes();
+        }
+    }
+}
+
+TEST_F(MultiFileIndexTest, it_reports_errors_of_the_concurrent_loading) {
+    MultiFileIndex index(false);
+    index.setUseCache(false);
+    index.setLoadThreads(2);
+    vector<string> fileNames { helpers::fixturePath("plain.0.log").string(), "does_not_exist.0.log" };
+    ASSERT_ANY_THROW(index.createIndex(fileNames));
+    ASSERT_TRUE(index.getLogFiles().empty());
+    filesystem::remove(helpers::fixturePath("plain.0.id2"));
+}
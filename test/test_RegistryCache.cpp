@@ -0,0 +1,72 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/RegistryCache.hpp>
+#include <pocolog_cpp/InputDataStream.hpp>
+#include <typelib/registry.hh>
+#include <thread>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct RegistryCacheTest : public helpers::Test {
+};
+
+TEST_F(RegistryCacheTest, it_returns_the_same_registry_for_the_same_description) {
+    auto first = RegistryCache::get("<typelib><opaque name=\"/first\" size=\"0\" /></typelib>");
+    auto second = RegistryCache::get(string("<typelib><opaque name=\"/first\" size=\"0\" /></typelib>"));
+    auto other = RegistryCache::get("<typelib><opaque name=\"/other\" size=\"0\" /></typelib>");
+    ASSERT_EQ(first, second);
+    ASSERT_NE(first, other);
+}
+
+TEST_F(RegistryCacheTest, it_releases_registries_that_are_no_longer_used) {
+    size_t used = RegistryCache::size();
+    auto registry = RegistryCache::get("<typelib><opaque name=\"/released\" size=\"0\" /></typelib>");
+    ASSERT_EQ(used + 1, RegistryCache::size());
+    registry.reset();
+    ASSERT_EQ(used, RegistryCache::size());
+}
+
+TEST_F(RegistryCacheTest, it_builds_derived_types_without_modifying_the_shared_registry) {
+    string tlb = "<typelib><numeric name=\"/int32_t\" category=\"sint\" size=\"4\" /></typelib>";
+    auto registry = RegistryCache::get(tlb);
+    auto derived = registry;
+    auto type = RegistryCache::build(derived, "/int32_t[12]");
+    ASSERT_EQ("/int32_t[12]", type->getName());
+    ASSERT_NE(registry, derived);
+    ASSERT_EQ(nullptr, registry->get("/int32_t[12]"));
+
+    auto other = RegistryCache::get(tlb);
+    ASSERT_EQ(type, RegistryCache::build(other, "/int32_t[12]"));
+    ASSERT_EQ(derived, other);
+}
+
+TEST_F(RegistryCacheTest, it_returns_the_same_types_to_concurrent_callers) {
+    string tlb = "<typelib><numeric name=\"/concurrent\" category=\"sint\" size=\"4\" /></typelib>";
+    vector<shared_ptr<const Typelib::Registry>> registries(8);
+    vector<Typelib::Type const*> types(8);
+    vector<thread> threads;
+    for (size_t i = 0; i < registries.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            registries[i] = RegistryCache::get(tlb);
+            types[i] = RegistryCache::build(registries[i], "/concurrent[2]");
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 1; i < registries.size(); ++i) {
+        ASSERT_EQ(registries[0], registries[i]);
+        ASSERT_EQ(types[0], types[i]);
+    }
+}
+
+TEST_F(RegistryCacheTest, it_shares_the_registries_of_streams_with_the_same_description) {
+    auto& first = openFixtureLogfile("plain.0.log");
+    auto& second = openFixtureLogfile("plain.0.log");
+
+    auto& firstStream = dynamic_cast<InputDataStream&>(first.getStream("a"));
+    auto& secondStream = dynamic_cast<InputDataStream&>(second.getStream("a"));
+    ASSERT_EQ(&firstStream.getStreamRegistry(), &secondStream.getStreamRegistry());
+    ASSERT_EQ(firstStream.getType(), secondStream.getType());
+    ASSERT_EQ(firstStream.getType(), &first.getStreamDescriptions()[firstStream.getIndex()].getTypelibType());
+}
@@ -0,0 +1,106 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/StreamingMultiFileIndex.hpp>
+#include <pocolog_cpp/MultiFileIndex.hpp>
+#include <pocolog_cpp/Stream.hpp>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct StreamingMultiFileIndexTest : public helpers::Test {
+    base::Time sampleTime(StreamingMultiFileIndex const& index) {
+        return index.getSampleStream()->getFileIndex().getSampleTime(index.getPosInStream());
+    }
+};
+
+TEST_F(StreamingMultiFileIndexTest, it_returns_the_samples_in_the_order_of_the_full_index) {
+    auto& first = openFixtureLogfile("plain.0.log");
+    auto& second = openFixtureLogfile("plain.0.log");
+    vector<LogFile*> logfiles { &first, &second };
+
+    MultiFileIndex full(false);
+    full.setUseCache(false);
+    full.createIndex(logfiles);
+
+    //a window smaller than the number of samples
+    StreamingMultiFileIndex index(5);
+    index.createIndex(logfiles);
+    ASSERT_EQ(full.getSize(), index.getSize());
+
+    for (size_t i = 0; i < full.getSize(); ++i) {
+        ASSERT_TRUE(index.next());
+        ASSERT_EQ(i, index.getGlobalPos());
+        ASSERT_EQ(full.getSampleStream(i), index.getSampleStream());
+        ASSERT_EQ(full.getPosInStream(i), index.getPosInStream());
+    }
+    ASSERT_FALSE(index.next());
+}
+
+TEST_F(StreamingMultiFileIndexTest, it_seeks_to_the_first_sample_at_or_after_a_time) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    StreamingMultiFileIndex index(2);
+    index.createIndex(vector<LogFile*> { &logfile });
+
+    vector<base::Time> times;
+    while (index.next()) {
+        times.push_back(sampleTime(index));
+    }
+    ASSERT_EQ(6, times.size());
+
+    index.seek(times[3]);
+    ASSERT_TRUE(index.next());
+    ASSERT_EQ(3, index.getGlobalPos());
+    ASSERT_EQ(times[3], sampleTime(index));
+    size_t remaining = 1;
+    while (index.next()) {
+        ++remaining;
+    }
+    ASSERT_EQ(3, remaining);
+
+    index.seek(times.back() + base::Time::fromMicroseconds(1));
+    ASSERT_FALSE(index.next());
+
+    index.rewind();
+    ASSERT_TRUE(index.next());
+    ASSERT_EQ(0, index.getGlobalPos());
+    ASSERT_EQ(times[0], sampleTime(index));
+}
+
+TEST_F(StreamingMultiFileIndexTest, it_throws_if_there_is_no_current_sample) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    StreamingMultiFileIndex index;
+    index.createIndex(vector<LogFile*> { &logfile });
+    ASSERT_THROW(index.getSampleStream(), std::runtime_error);
+}
+
+TEST_F(StreamingMultiFileIndexTest, it_keeps_merging_while_samples_are_appended_to_the_indices) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    vector<LogFile*> logfiles { &logfile };
+
+    // what a followed log file does, the index data moves as it grows
+    auto appendSamples = [&](int count) {
+        for (auto stream : logfile.getStreams()) {
+            Index& streamIndex = stream->getFileIndex();
+            base::Time last = streamIndex.getLastSampleTime();
+            for (int i = 0; i < count; ++i) {
+                streamIndex.addSample(logfile.getFileSize(), last, last, 4);
+            }
+        }
+    };
+    appendSamples(1);
+
+    MultiFileIndex full(false);
+    full.setUseCache(false);
+    full.createIndex(logfiles);
+
+    StreamingMultiFileIndex index(1);
+    index.createIndex(logfiles);
+    ASSERT_TRUE(index.next());
+    appendSamples(10000);
+
+    for (size_t i = 1; i < full.getSize(); ++i) {
+        ASSERT_TRUE(index.next());
+        ASSERT_EQ(full.getSampleStream(i), index.getSampleStream());
+        ASSERT_EQ(full.getPosInStream(i), index.getPosInStream());
+    }
+    ASSERT_FALSE(index.next());
+}
@@ -0,0 +1,246 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/SuperBlock.hpp>
+#include <pocolog_cpp/Write.hpp>
+#include <pocolog_cpp/LogFile.hpp>
+#include <pocolog_cpp/IndexFile.hpp>
+#include <fstream>
+#include <array>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+typedef array<int32_t, 12> ImuSample;
+
+struct SuperBlockTest : public helpers::Test {
+    string typeDef = plainTypeDef();
+    std::filesystem::path path = tempLogPath("super_block");
+    std::filesystem::path indexPath = std::filesystem::path(path).replace_extension(".id2");
+
+    /** Sample i of the 'imu' stream, which changes slowly like a sensor reading */
+    ImuSample makeSample(int32_t i) {
+        ImuSample sample;
+        for (int32_t j = 0; j < 12; ++j) {
+            sample[j] = 1000 * j + i / 10;
+        }
+        return sample;
+    }
+
+    base::Time sampleTime(int32_t i) {
+        return base::Time::fromMicroseconds(1000000 + 1000 * i);
+    }
+
+    /**
+     * Writes numSamples samples into 'imu', in super-blocks of
+     * superBlockSamples samples if it is nonzero, and a sample into the
+     * plain stream 'b' every 100 samples
+     */
+    void writeLog(CompressionCodec codec, size_t superBlockSamples, int32_t numSamples, bool indexed = false) {
+        ofstream file(path, ios::binary);
+        Output output(file, 4096);
+        if (indexed) {
+            output.setIndexFile(indexPath.string(), 4096);
+        }
+
+        vector<StreamMetadata> metadata = { { Compression::METADATA_KEY, Compression::getName(codec) } };
+        if (superBlockSamples) {
+            metadata.push_back({ SuperBlock::METADATA_KEY, to_string(superBlockSamples) });
+        }
+        uint16_t imu = output.newStreamIndex();
+        output.writeStreamDeclaration(imu, DataStreamType, "imu", "/int32_t[12]", typeDef, metadata);
+        uint16_t b = output.newStreamIndex();
+        output.writeStreamDeclaration(b, DataStreamType, "b", "/int32_t", typeDef, vector<StreamMetadata>());
+
+        for (int32_t i = 0; i < numSamples; ++i) {
+            auto sample = makeSample(i);
+            output.writeSample(imu, sampleTime(i), sampleTime(i), sample.data(), sizeof(sample));
+            if (i % 100 == 0) {
+                output.writeSample(b, sampleTime(i), sampleTime(i), &i, sizeof(i));
+            }
+        }
+    }
+};
+
+TEST_F(SuperBlockTest, it_reads_the_samples_back_in_stream_order) {
+    const int32_t numSamples = 1050;
+    for (auto codec : availableCodecs(true)) {
+        writeLog(codec, 100, numSamples);
+
+        for (bool prefetch : { false, true }) {
+            for (bool mapped : { false, true }) {
+                LogFile logfile(path.string(), true, mapped);
+                if (prefetch) {
+                    logfile.setPrefetchDepth(4);
+                }
+                int32_t imuCount = 0, bCount = 0;
+                while (auto sample = logfile.readNextSample()) {
+                    auto& [index, time, value] = *sample;
+                    if (index == 0) {
+                        ASSERT_EQ(makeSample(imuCount), value.get<ImuSample>()) << Compression::getName(codec);
+                        ASSERT_EQ(sampleTime(imuCount), time);
+                        imuCount++;
+                    }
+                    else {
+                        ASSERT_EQ(bCount * 100, value.get<int32_t>());
+                        bCount++;
+                    }
+                }
+                ASSERT_EQ(numSamples, imuCount);
+                ASSERT_EQ(11, bCount);
+                logfile.removeAllIndexes();
+            }
+        }
+    }
+}
+
+TEST_F(SuperBlockTest, it_gives_random_access_to_the_samples_of_super_blocks) {
+    const int32_t numSamples = 1050;
+    for (auto codec : availableCodecs(true)) {
+        writeLog(codec, 100, numSamples);
+
+        for (bool mapped : { false, true }) {
+            LogFile logfile(path.string(), true, mapped);
+            auto& stream = logfile.getStream("imu");
+            ASSERT_EQ(numSamples, stream.getSize());
+
+            // backwards, so that each super-block is read from scratch
+            vector<uint8_t> data;
+            for (int32_t i = numSamples - 1; i >= 0; i -= 7) {
+                ASSERT_TRUE(stream.getSampleData(data, i));
+                ASSERT_EQ(sizeof(ImuSample), data.size());
+                ASSERT_EQ(makeSample(i), *reinterpret_cast<ImuSample const*>(data.data()));
+                ASSERT_EQ(sampleTime(i), stream.getFileIndex().getSampleTime(i));
+            }
+
+            FileView view;
+            ASSERT_TRUE(stream.getSampleView(view, 555));
+            ASSERT_EQ(makeSample(555), *reinterpret_cast<ImuSample const*>(view.data));
+
+            ImuSample sample;
+            ASSERT_TRUE(stream.readSample(sample, 1049));
+            ASSERT_EQ(makeSample(1049), sample);
+
+            vector<vector<uint8_t>> results;
+            ASSERT_TRUE(stream.getSampleDataBatch(results, { 3, 999, 4 }));
+            ASSERT_EQ(makeSample(999), *reinterpret_cast<ImuSample const*>(results[1].data()));
+            ASSERT_EQ(makeSample(4), *reinterpret_cast<ImuSample const*>(results[2].data()));
+
+            int32_t b = -1;
+            ASSERT_TRUE(logfile.getStream("b").readSample(b, 10));
+            ASSERT_EQ(1000, b);
+            logfile.removeAllIndexes();
+        }
+    }
+}
+
+TEST_F(SuperBlockTest, the_recorded_and_the_scanned_indexes_are_the_same) {
+    for (auto codec : availableCodecs(true)) {
+        writeLog(codec, 64, 2000, true);
+        string recordedIndex = helpers::readFile(indexPath);
+        std::filesystem::remove(indexPath);
+
+        LogFile logfile(path.string());
+        ASSERT_EQ(recordedIndex, helpers::readFile(indexPath)) << Compression::getName(codec);
+
+        logfile.rewind();
+        auto parallelPath = std::filesystem::path(path).replace_extension(".par.id2");
+        IndexFile(logfile).createIndexFile(parallelPath.string(), logfile, 3, 1);
+        ASSERT_EQ(recordedIndex, helpers::readFile(parallelPath)) << Compression::getName(codec);
+        logfile.removeAllIndexes();
+    }
+}
+
+TEST_F(SuperBlockTest, it_writes_the_dictionary_once_per_stream) {
+    for (auto codec : availableCodecs(true)) {
+        if (codec == NoCompression) {
+            continue;
+        }
+
+        writeLog(codec, 100, 1050);
+        LogFile logfile(path.string());
+        logfile.rewind();
+        int dictionaries = 0, superBlocks = 0;
+        while (logfile.readNextBlockHeader()) {
+            if (logfile.getCurBlockHeader().type != DataBlockType) {
+                continue;
+            }
+            logfile.readSampleHeader();
+            dictionaries += logfile.getCurSampleHeader().compressed == SuperBlockDictionary;
+            superBlocks += logfile.getCurSampleHeader().compressed == SuperBlockSample;
+        }
+        ASSERT_EQ(1, dictionaries) << Compression::getName(codec);
+        ASSERT_EQ(11, superBlocks) << Compression::getName(codec);
+        logfile.removeAllIndexes();
+    }
+}
+
+TEST_F(SuperBlockTest, it_makes_small_samples_smaller) {
+    for (auto codec : availableCodecs(true)) {
+        writeLog(codec, 0, 10000);
+        auto plainSize = std::filesystem::file_size(path);
+        writeLog(codec, 1000, 10000);
+        auto superBlockSize = std::filesystem::file_size(path);
+
+        // without compression, only the headers are saved
+        ASSERT_LT(superBlockSize, plainSize * (codec == NoCompression ? 0.9 : 0.3)) << Compression::getName(codec);
+    }
+}
+
+TEST_F(SuperBlockTest, it_refuses_to_read_super_blocks_as_single_samples) {
+    writeLog(NoCompression, 100, 150);
+    LogFile logfile(path.string());
+    logfile.rewind();
+    int superBlocks = 0;
+    while (logfile.readNextBlockHeader()) {
+        if (logfile.getCurBlockHeader().type != DataBlockType) {
+            continue;
+        }
+        logfile.readSampleHeader();
+        if (logfile.getCurSampleHeader().compressed != SuperBlockSample) {
+            continue;
+        }
+
+        vector<uint8_t> data;
+        FileView view;
+        ASSERT_THROW(logfile.getSampleData(data), std::logic_error);
+        ASSERT_THROW(logfile.getSampleView(view), std::logic_error);
+        ASSERT_THROW(logfile.getSample(), std::logic_error);
+        superBlocks++;
+    }
+    ASSERT_EQ(2, superBlocks);
+    logfile.removeAllIndexes();
+}
+
+TEST_F(SuperBlockTest, it_decodes_the_little_endian_layout_of_the_format_documentation) {
+    vector<uint8_t> data;
+    auto append = [&](uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            data.push_back(value >> (8 * i));
+        }
+    };
+    // header
+    append(2, 4);
+    append(NoCompression, 1);
+    append(0, 1);
+    append(2 * sizeof(SuperBlock::Entry), 4);
+    append(0, 8);
+    append(0, 4);
+    // table
+    for (uint32_t i = 0; i < 2; ++i) {
+        append(100 + i, 4);
+        append(10 + i, 4);
+        append(200 + i, 4);
+        append(20 + i, 4);
+        append(1 + i, 4);
+    }
+    // body
+    data.insert(data.end(), { 'a', 'b', 'c' });
+
+    FileStream file;
+    SuperBlockReader reader;
+    reader.decode(file, 0, data.data(), data.size());
+    ASSERT_EQ(2, reader.getNumSamples());
+    ASSERT_EQ(base::Time::fromSeconds(101, 11), reader.getEntry(1).getRealtime());
+    ASSERT_EQ(base::Time::fromSeconds(201, 21), reader.getEntry(1).getTimestamp());
+    auto sample = reader.getSample(1);
+    ASSERT_EQ("bc", string(sample.begin(), sample.end()));
+}
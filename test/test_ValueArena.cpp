@@ -0,0 +1,52 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/ValueArena.hpp>
+#include <pocolog_cpp/MarshallingPlan.hpp>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct ValueArenaTest : public helpers::Test {
+};
+
+TEST_F(ValueArenaTest, it_decodes_the_samples_of_a_window_into_the_arena) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+
+    ValueArena arena;
+    vector<LogFile::ArenaSample> window(6);
+    for (auto& sample : window) {
+        ASSERT_TRUE(logfile.readNextSample(arena, sample));
+    }
+    LogFile::ArenaSample sample;
+    ASSERT_FALSE(logfile.readNextSample(arena, sample));
+
+    ASSERT_EQ(0, window[0].streamIdx);
+    ASSERT_EQ(10, *reinterpret_cast<int32_t*>(window[0].value.getData()));
+    ASSERT_EQ(30, *reinterpret_cast<int32_t*>(window[2].value.getData()));
+    ASSERT_EQ(1, window[3].streamIdx);
+    ASSERT_FLOAT_EQ(0.1, *reinterpret_cast<float*>(window[3].value.getData()));
+    ASSERT_LE(6 * sizeof(int32_t), arena.getUsedSize());
+    arena.reset();
+}
+
+TEST_F(ValueArenaTest, it_reuses_its_memory_after_a_reset) {
+    auto& logfile = openFixtureLogfile("plain.0.log");
+    auto const& plan = logfile.getStreamDescriptions()[0].getMarshallingPlan();
+
+    // a chunk size that makes the window span several chunks
+    ValueArena arena(32);
+    int32_t marshalled = 42;
+    for (int i = 0; i < 5; ++i) {
+        arena.load(plan, reinterpret_cast<uint8_t*>(&marshalled), sizeof(marshalled));
+    }
+    arena.reset();
+    size_t capacity = arena.getCapacity();
+    ASSERT_EQ(0, arena.getUsedSize());
+
+    for (int i = 0; i < 5; ++i) {
+        auto value = arena.load(plan, reinterpret_cast<uint8_t*>(&marshalled), sizeof(marshalled));
+        ASSERT_EQ(42, *reinterpret_cast<int32_t*>(value.getData()));
+    }
+    ASSERT_EQ(capacity, arena.getCapacity());
+    arena.reset();
+    ASSERT_EQ(capacity, arena.getCapacity());
+}
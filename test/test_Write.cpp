@@ -0,0 +1,197 @@
+#include "Helpers.hpp"
+#include <pocolog_cpp/Write.hpp>
+#include <pocolog_cpp/LogFile.hpp>
+#include <pocolog_cpp/IndexFile.hpp>
+#include <pocolog_cpp/RegistryCache.hpp>
+#include <fstream>
+#include <sstream>
+#include <functional>
+
+using namespace pocolog_cpp;
+using namespace std;
+
+struct WriteTest : public helpers::Test {
+    string typeDef = plainTypeDef();
+
+    /** Writes samples 0 to numSamples - 1 into an int32_t stream called 'a' */
+    string writeLog(size_t bufferSize, int32_t numSamples) {
+        ostringstream stream;
+        {
+            Output output(stream, bufferSize);
+            uint16_t idx = output.newStreamIndex();
+            output.writeStreamDeclaration(idx, DataStreamType, "a", "/int32_t", typeDef, vector<StreamMetadata>());
+            for (int32_t i = 0; i < numSamples; ++i) {
+                base::Time time = base::Time::fromMicroseconds(1000 + i);
+                output.writeSample(idx, time, time, &i, sizeof(i));
+            }
+        }
+        return stream.str();
+    }
+
+    /** Writes numSamples samples into an indexed log, and calls \c beforeClose before closing it */
+    void writeIndexedLog(std::filesystem::path const& logPath, off_t checkpointSize, int32_t numSamples,
+                         function<void(Output&)> beforeClose = function<void(Output&)>()) {
+        ofstream file(logPath, ios::binary);
+        Output output(file, 4096);
+        output.setIndexFile(std::filesystem::path(logPath).replace_extension(".id2").string(), checkpointSize);
+        uint16_t a = output.newStreamIndex();
+        output.writeStreamDeclaration(a, DataStreamType, "a", "/int32_t", typeDef, vector<StreamMetadata>());
+        for (int32_t i = 0; i < numSamples; ++i) {
+            base::Time time = base::Time::fromMicroseconds(1000 + i);
+            output.writeSample(a, time, time, &i, sizeof(i));
+            if (i == numSamples / 2) {
+                uint16_t b = output.newStreamIndex();
+                output.writeStreamDeclaration(b, DataStreamType, "b", "/int32_t", typeDef, vector<StreamMetadata>());
+                output.writeSample(b, time, time, &i, sizeof(i));
+            }
+        }
+        if (beforeClose) {
+            beforeClose(output);
+        }
+    }
+};
+
+TEST_F(WriteTest, it_writes_the_same_bytes_with_and_without_buffer) {
+    string expected = writeLog(0, 1000);
+    for (size_t bufferSize : { size_t(1), size_t(7), size_t(64), size_t(1024 * 1024) }) {
+        ASSERT_EQ(expected, writeLog(bufferSize, 1000));
+    }
+}
+
+TEST_F(WriteTest, it_writes_the_buffered_data_before_returning_the_stream) {
+    ostringstream stream;
+    Output output(stream, 1024);
+    uint16_t idx = output.newStreamIndex();
+    output.writeStreamDeclaration(idx, DataStreamType, "a", "/int32_t", typeDef, vector<StreamMetadata>());
+    size_t size = output.getStream().tellp();
+    ASSERT_EQ(size, stream.str().size());
+    ASSERT_LT(0, size);
+}
+
+TEST_F(WriteTest, it_writes_a_buffered_log_that_can_be_read_back) {
+    auto path = tempLogPath("write");
+    {
+        ofstream file(path, ios::binary);
+        file << writeLog(4096, 1000);
+    }
+
+    {
+        LogFile logfile(path.string());
+        for (int32_t i = 0; i < 1000; ++i) {
+            auto [index, time, value] = logfile.readNextSample().value();
+            ASSERT_EQ(0, index);
+            ASSERT_EQ(i, value.get<int32_t>());
+            ASSERT_EQ(1000 + i, time.toMicroseconds());
+        }
+        ASSERT_FALSE(logfile.readNextSample().has_value());
+        logfile.removeAllIndexes();
+    }
+}
+
+TEST_F(WriteTest, it_writes_the_index_that_the_scan_of_the_log_creates) {
+    auto path = tempLogPath("indexed_write");
+    auto indexPath = std::filesystem::path(path).replace_extension(".id2");
+    writeIndexedLog(path, 1024, 1000);
+    string recordedIndex = helpers::readFile(indexPath);
+
+    {
+        // the recorded index is used as is
+        LogFile logfile(path.string());
+        ASSERT_EQ(recordedIndex, helpers::readFile(indexPath));
+        ASSERT_EQ(2, logfile.getStreamDescriptions().size());
+    }
+
+    std::filesystem::remove(indexPath);
+    {
+        LogFile logfile(path.string());
+        ASSERT_EQ(recordedIndex, helpers::readFile(indexPath));
+    }
+}
+
+TEST_F(WriteTest, it_indexes_the_payloads_written_through_a_stream_writer) {
+    auto path = tempLogPath("stream_writer");
+    auto indexPath = std::filesystem::path(path).replace_extension(".id2");
+    {
+        ofstream file(path, ios::binary);
+        Output output(file, 4096);
+        output.setIndexFile(indexPath.string(), 1024);
+        StreamWriter writer("a", "/int32_t", *RegistryCache::get(typeDef), vector<StreamMetadata>(), output);
+        for (int32_t i = 0; i < 1000; ++i) {
+            ASSERT_TRUE(writer.writeSampleHeader(base::Time::fromMicroseconds(1000 + i), sizeof(i)));
+            writer.getStream().write(reinterpret_cast<char const*>(&i), sizeof(i));
+        }
+    }
+    string recordedIndex = helpers::readFile(indexPath);
+
+    std::filesystem::remove(indexPath);
+    {
+        LogFile logfile(path.string());
+        ASSERT_EQ(recordedIndex, helpers::readFile(indexPath));
+    }
+}
+
+TEST_F(WriteTest, it_keeps_the_index_in_a_journal_while_recording) {
+    auto path = tempLogPath("indexed_write");
+    auto indexPath = std::filesystem::path(path).replace_extension(".id2");
+    auto journalPath = IndexFile::getJournalFileName(indexPath.string());
+
+    writeIndexedLog(path, 1024, 1000, [&](Output& output) {
+        ASSERT_FALSE(std::filesystem::exists(indexPath));
+        ASSERT_LE(8 + 1002 * sizeof(IndexFile::JournalEntry), std::filesystem::file_size(journalPath));
+
+        // the log can be opened during the recording
+        output.flush();
+        LogFile logfile(path.string());
+        ASSERT_EQ(1000, logfile.getStream("a").getSize());
+        ASSERT_EQ(1, logfile.getStream("b").getSize());
+    });
+    ASSERT_FALSE(std::filesystem::exists(journalPath));
+    string recordedIndex = helpers::readFile(indexPath);
+
+    std::filesystem::remove(indexPath);
+    {
+        LogFile logfile(path.string());
+        ASSERT_EQ(recordedIndex, helpers::readFile(indexPath));
+    }
+}
+
+TEST_F(WriteTest, it_leaves_a_journal_that_covers_the_log_up_to_the_last_checkpoint_on_a_crash) {
+    auto path = tempLogPath("indexed_write");
+    auto crashPath = tempLogPath("crashed_write");
+    auto crashIndexPath = std::filesystem::path(crashPath).replace_extension(".id2");
+    auto crashJournalPath = IndexFile::getJournalFileName(crashIndexPath.string());
+
+    writeIndexedLog(path, 1024, 1000, [&](Output& output) {
+        output.flush();
+        std::filesystem::copy_file(path, crashPath, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::copy_file(IndexFile::getJournalFileName(std::filesystem::path(path).replace_extension(".id2").string()),
+                                   crashJournalPath, std::filesystem::copy_options::overwrite_existing);
+    });
+
+    ASSERT_TRUE(IndexFile::mergeJournal(crashJournalPath, crashIndexPath.string(), std::filesystem::file_size(crashPath)));
+    IndexFile::IndexFileHeader header;
+    ifstream(crashIndexPath, ios::binary).read(reinterpret_cast<char*>(&header), sizeof(header));
+    ASSERT_LT(0, header.indexedPos);
+    ASSERT_LT(header.indexedPos, std::filesystem::file_size(crashPath));
+    std::filesystem::remove(crashIndexPath);
+
+    {
+        LogFile logfile(crashPath.string());
+        int32_t count = 0;
+        while (auto sample = logfile.readNextSample()) {
+            count++;
+        }
+        ASSERT_EQ(1001, count);
+        ASSERT_EQ(1000, logfile.getStream("a").getSize());
+        ASSERT_EQ(1, logfile.getStream("b").getSize());
+    }
+
+    // the result is the index that the scan of the log creates
+    string mergedIndex = helpers::readFile(crashIndexPath);
+    std::filesystem::remove(crashIndexPath);
+    std::filesystem::remove(crashJournalPath);
+    {
+        LogFile logfile(crashPath.string());
+        ASSERT_EQ(mergedIndex, helpers::readFile(crashIndexPath));
+    }
+}